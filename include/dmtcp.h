@@ -459,6 +459,13 @@ void dmtcp_plugin_enable_ckpt(void);
 
 void dmtcp_add_to_ckpt_header(const char *key, const char *value);
 
+// Records a statistic of the current checkpoint or restart, e.g. the time
+// spent in some phase, from the checkpoint thread.  The statistics are sent to
+// the coordinator when the process resumes, and exported by
+// 'dmtcp_coordinator --metrics-port' as dmtcp_worker_stat{name="<name>"}.
+// Reporting a name again in the same checkpoint replaces its value.
+void dmtcp_report_worker_stat(const char *name, double value);
+
 typedef struct dt_tag {
   char *base_addr;   /* Base address shared object is loaded at. */
 
@@ -0,0 +1,21 @@
+/****************************************************************************
+ * TODO: Replace this header with appropriate header showing MIT OR BSD     *
+ *       License                                                            *
+ *   Copyright (C) 2006-2008 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ * This file, dmtcp.h, is placed in the public domain.                *
+ * The motivation for this is to allow anybody to freely use this file      *
+ * without restriction to statically link this file with any software.      *
+ * This allows that software to communicate with the DMTCP libraries.       *
+ * -  Jason Ansel, Kapil Arya, and Gene Cooperman                           *
+ *      jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu           *
+ ****************************************************************************/
+
+#ifndef __DMTCP_VERSION_H__
+#define __DMTCP_VERSION_H__
+
+/* Define to the version of this package. */
+#define DMTCP_PACKAGE_VERSION "3.0.0"
+
+#endif // ifndef __DMTCP_VERSION_H__
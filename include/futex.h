@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <unistd.h>
 #include <linux/futex.h>
 #include <sys/syscall.h>
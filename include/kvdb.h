@@ -30,7 +30,9 @@ enum class KVDBRequest {
   OR,
   XOR,
   MIN,
-  MAX
+  MAX,
+  MSET,
+  MGET
 };
 
 enum class KVDBResponse {
@@ -66,6 +68,15 @@ KVDBResponse set(string const& id,
                  string const& val,
                  string *oldVal = nullptr);
 
+// Sets or looks up many keys of a database with a single coordinator round
+// trip.  mget() returns KEY_NOT_FOUND if any key is missing; the values of
+// the missing keys are left empty.
+KVDBResponse mset(string const& id, map<string, string> const& kvmap);
+
+KVDBResponse mget(string const& id,
+                  vector<string> const& keys,
+                  vector<string> *vals);
+
 ostream &operator<<(ostream &o, const KVDBRequest &id);
 ostream &operator<<(ostream &o, const KVDBResponse &id);
 }
@@ -26,6 +26,9 @@ class ProcSelfMaps
 
     int getNextArea(ProcMapsArea *area);
 
+    // Restarts getNextArea() at the first area.
+    void rewind() { dataIdx = 0; }
+
     const char* getData() const { return data; }
 
   private:
@@ -33,15 +33,10 @@
 #include "dmtcpalloc.h"
 
 #define PTS_PATH_MAX             32
-#define MAX_PID_MAPS             32768
-#define MAX_IPC_ID_MAPS          256
-#define MAX_PTY_NAME_MAPS        256
-#define MAX_INCOMING_CONNECTIONS 10240
-#define MAX_INODE_PID_MAPS       10240
 #define CON_ID_LEN \
   (sizeof(DmtcpUniqueProcessId) + sizeof(int64_t))
 
-#define SHM_VERSION_STR          "DMTCP_GLOBAL_AREA_V0.99"
+#define SHM_VERSION_STR          "DMTCP_GLOBAL_AREA_V1.0"
 #define VIRT_PTS_PREFIX_STR      "/dev/pts/v"
 
 #define SYSV_SHM_ID              1
@@ -92,6 +87,19 @@ typedef struct InodeConnIdMap {
   char id[CON_ID_LEN];
 } InodeConnIdMap;
 
+// An AF_UNIX connection to be restored at restart, keyed by the id of its
+// accepting end.  For the accepting end, 'addr' is the UDS restore socket of
+// the process holding it.
+struct LocalSockMap {
+  char id[CON_ID_LEN];
+  uint32_t isAcceptEnd;
+  struct sockaddr_un addr;
+  union {
+    socklen_t len;
+    uint64_t _pad;
+  };
+};
+
 struct BarrierInfo {
   uint64_t numCkptPeers;
 
@@ -103,6 +111,21 @@ struct BarrierInfo {
   pthread_barrier_t barrier;
 };
 
+// The maps below grow on demand.  Each one lives in an extent of the shared
+// file, which is replaced by one twice as large when it fills up; see
+// shareddata.cpp.  The whole file is limited to 256 MB, or to 32 MB if a
+// 32-bit process shares it.
+struct Extent {
+  uint64_t size;        // bytes, including this header
+  uint64_t capacity;    // entries
+  uint64_t entrySize;
+  uint64_t indexSize;   // slots in the hash index that follows the entries
+};
+
+struct Table {
+  uint64_t offset;      // file offset of the current extent, or 0
+};
+
 typedef enum {
   DMTCP_ARCH_32,
   DMTCP_ARCH_64,
@@ -115,6 +138,13 @@ struct Header {
   char tmpDir[PATH_MAX];
   char installDir[PATH_MAX];
 
+  // Bytes of the shared file in use; new extents are carved from the end.
+  uint64_t size;
+
+  // Limit on 'size': the smallest address range reserved for the file by
+  // the processes sharing it (256 MB, or 32 MB in a 32-bit process).
+  uint64_t maxSize;
+
   struct sockaddr_storage localIPAddr;
 
   int64_t dlsymOffset;
@@ -133,20 +163,22 @@ struct Header {
 
   uint64_t numIncomingConMaps;
   uint64_t numInodeConnIdMaps;
+  uint64_t numLocalSockMaps;
 
   union {
     struct BarrierInfo barrierInfo;
     char pad[128];
   };
 
-  struct PidMap pidMap[MAX_PID_MAPS];
-  struct IPCIdMap sysvShmIdMap[MAX_IPC_ID_MAPS];
-  struct IPCIdMap sysvSemIdMap[MAX_IPC_ID_MAPS];
-  struct IPCIdMap sysvMsqIdMap[MAX_IPC_ID_MAPS];
-  struct IPCIdMap sysvShmKeyMap[MAX_IPC_ID_MAPS];
-  struct PtyNameMap ptyNameMap[MAX_PTY_NAME_MAPS];
-  struct IncomingConMap incomingConMap[MAX_INCOMING_CONNECTIONS];
-  InodeConnIdMap inodeConnIdMap[MAX_INODE_PID_MAPS];
+  struct Table pidMaps;
+  struct Table sysvShmIdMaps;
+  struct Table sysvSemIdMaps;
+  struct Table sysvMsqIdMaps;
+  struct Table sysvShmKeyMaps;
+  struct Table ptyNameMaps;
+  struct Table incomingConMaps;
+  struct Table inodeConnIdMaps;
+  struct Table localSockMaps;
 
   char versionStr[32];
   DmtcpUniqueProcessId compId;
@@ -218,6 +250,9 @@ void getMissingConMaps(struct IncomingConMap **map, uint32_t *nmaps);
 
 void insertInodeConnIdMaps(vector<InodeConnIdMap> &maps);
 bool getCkptLeaderForFile(dev_t devnum, ino_t inode, void *id);
+
+void registerLocalSockets(vector<LocalSockMap> &maps);
+bool getLocalSocket(const void *id, bool isAcceptEnd, LocalSockMap *out);
 }
 }
 #endif // ifndef SHARED_DATA_H
@@ -37,8 +37,23 @@
 
 #define MAX_VIRTUAL_ID 999
 
+// Number of attempts a reader makes at a lock-free lookup while writers keep
+// changing the table, before it takes the lock.
+#define VIRTUAL_ID_TABLE_READ_RETRIES 64
+
 namespace dmtcp
 {
+/*
+ * _idMapTable is the authoritative map; it is only accessed with tblLock
+ * held.  Every change to it is mirrored in a flat open-addressing index,
+ * keyed both by virtual and by real id, which virtualToReal(),
+ * realToVirtual() and friends read without taking the lock.  The index is
+ * guarded by a sequence counter that writers make odd while they change the
+ * index; a reader retries if the counter was odd or changed while it probed.
+ * Erased slots are purged in place once they fill the index; the index is
+ * only replaced by a larger one when the live mappings need it.  A replaced
+ * index is freed once no reader is probing it.
+ */
 template<typename IdType>
 class VirtualIdTable
 {
@@ -65,15 +80,17 @@ class VirtualIdTable
                    IdType base,
                    size_t max = MAX_VIRTUAL_ID,
                    size_t reserveSize = MAX_VIRTUAL_ID)
+      : _index(NULL), _seq(0), _numReaders(0)
     {
       DmtcpMutexInit(&tblLock, DMTCP_MUTEX_LLL);
       _do_lock_tbl();
       _idMapTable.clear();
       _idMapTable.reserve(reserveSize);
-      _do_unlock_tbl();
       _typeStr = typeStr;
       _base = base;
       _max = max;
+      _resetIndexes();
+      _do_unlock_tbl();
       resetNextVirtualId();
     }
 
@@ -105,6 +122,7 @@ class VirtualIdTable
     {
       _do_lock_tbl();
       _idMapTable.clear();
+      _resetIndexes();
       resetNextVirtualId();
       _do_unlock_tbl();
     }
@@ -113,6 +131,7 @@ class VirtualIdTable
     {
       _do_lock_tbl();
       _idMapTable.clear();
+      _resetIndexes();
       resetNextVirtualId();
       _do_unlock_tbl();
     }
@@ -121,28 +140,38 @@ class VirtualIdTable
     {
       _base = newBase;
       DmtcpMutexInit(&tblLock, DMTCP_MUTEX_LLL);
+
+      // Another thread of the parent may have been changing or probing the
+      // index; only this thread exists in the child.
+      _seq &= ~1U;
+      _numReaders = 0;
+      _do_lock_tbl();
+      _resetIndexes();
+      _freeRetiredIndexes();
+      _do_unlock_tbl();
       resetNextVirtualId();
     }
 
+    // Only the ids in this table's own range count against _max; mappings
+    // for ids created elsewhere (e.g., child processes in the pid table) do
+    // not.  The id is reserved until it is mapped and then erased.
     bool getNewVirtualId(IdType *id)
     {
-      bool res = false;
+      size_t bit;
 
       _do_lock_tbl();
-      if (_idMapTable.size() < _max) {
-        size_t count = 0;
-        while (1) {
-          IdType newId = addOneToNextVirtualId();
-          id_iterator i = _idMapTable.find(newId);
-          if (i == _idMapTable.end()) {
-            *id = newId;
-            res = true;
-            break;
-          }
-          if (++count == _max) {
-            break;
-          }
-        }
+      size_t start = (size_t)_nextVirtualId - (size_t)_base - 1;
+      bool res = _findFreeId(start, &bit);
+      if (!res) {
+        // Drop the reservations of ids that were never mapped.
+        _rebuildIdBitmap();
+        res = _findFreeId(start, &bit);
+      }
+      if (res) {
+        _idBitmap[bit / 64] |= 1ULL << (bit % 64);
+        *id = (IdType)((size_t)_base + 1 + bit);
+        _nextVirtualId = *id;
+        addOneToNextVirtualId();
       }
       _do_unlock_tbl();
       return res;
@@ -156,44 +185,32 @@ class VirtualIdTable
 
     bool virtualIdExists(IdType id)
     {
-      bool retVal = false;
+      IdType realId;
 
-      _do_lock_tbl();
-      id_iterator j = _idMapTable.find(id);
-      if (j != _idMapTable.end()) {
-        retVal = true;
-      }
-
-      _do_unlock_tbl();
-      return retVal;
+      return _lookup(id, &realId);
     }
 
     bool realIdExists(IdType id)
     {
-      bool retval = false;
+      IdType virtualId;
 
-      _do_lock_tbl();
-      for (id_iterator i = _idMapTable.begin(); i != _idMapTable.end(); ++i) {
-        if (i->second == id) {
-          retval = true;
-          break;
-        }
-      }
-      _do_unlock_tbl();
-      return retval;
+      return _lookup(id, &virtualId, true);
     }
 
     void updateMapping(IdType virtualId, IdType realId)
     {
       _do_lock_tbl();
-      _idMapTable[virtualId] = realId;
+      _setMapping(virtualId, realId);
       _do_unlock_tbl();
     }
 
     void erase(IdType virtualId)
     {
       _do_lock_tbl();
-      _idMapTable.erase(virtualId);
+      id_iterator i = _idMapTable.find(virtualId);
+      if (i != _idMapTable.end()) {
+        _eraseMapping(i);
+      }
       _do_unlock_tbl();
     }
 
@@ -229,14 +246,9 @@ class VirtualIdTable
       /* This code is called from MTCP while the checkpoint thread is holding
          the JASSERT log lock. Therefore, don't call JTRACE/JASSERT/JINFO/etc. in
          this function. */
-      _do_lock_tbl();
-      id_iterator i = _idMapTable.find(virtualId);
-      if (i == _idMapTable.end()) {
+      if (!_lookup(virtualId, &retVal)) {
         retVal = virtualId;
-      } else {
-        retVal = i->second;
       }
-      _do_unlock_tbl();
       return retVal;
     }
 
@@ -245,16 +257,12 @@ class VirtualIdTable
       /* This code is called from MTCP while the checkpoint thread is holding
          the JASSERT log lock. Therefore, don't call JTRACE/JASSERT/JINFO/etc. in
          this function. */
-      _do_lock_tbl();
-      for (id_iterator i = _idMapTable.begin(); i != _idMapTable.end(); ++i) {
-        if (realId == i->second) {
-          _do_unlock_tbl();
-          return i->first;
-        }
-      }
+      IdType retVal;
 
-      _do_unlock_tbl();
-      return realId;
+      if (!_lookup(realId, &retVal, true)) {
+        retVal = realId;
+      }
+      return retVal;
     }
 
     void serialize(jalib::JBinarySerializer &o)
@@ -262,6 +270,11 @@ class VirtualIdTable
       JSERIALIZE_ASSERT_POINT("VirtualIdTable:");
       o & _idMapTable;
       JSERIALIZE_ASSERT_POINT("EOF");
+      if (o.isReader()) {
+        _do_lock_tbl();
+        _resetIndexes();
+        _do_unlock_tbl();
+      }
       printMaps();
     }
 
@@ -303,6 +316,7 @@ class VirtualIdTable
       while (!maprd.isEOF()) {
         maprd & _idMapTable;
       }
+      _resetIndexes();
 
       _do_unlock_tbl();
 
@@ -316,16 +330,347 @@ class VirtualIdTable
       return _typeStr;
     }
 
-  private:
-    string _typeStr;
-    DmtcpMutex tblLock;
-
   protected:
     typedef typename dmtcp::unordered_map<IdType, IdType>::iterator id_iterator;
+
+    // Called with tblLock held.
+    void _setMapping(IdType virtualId, IdType realId)
+    {
+      id_iterator i = _idMapTable.find(virtualId);
+      bool replacing = i != _idMapTable.end();
+      IdType oldRealId = replacing ? i->second : realId;
+
+      _idMapTable[virtualId] = realId;
+      _markId(virtualId, true);
+      IdSlots *t = &_index->byVirtual;
+      if (_index->byReal.numFilled > t->numFilled) {
+        t = &_index->byReal;
+      }
+      if (2 * (t->numFilled + 1) > _index->numSlots) {
+        // If erased slots (e.g., from short-lived threads) make up half of
+        // the filled ones, purge them in place; otherwise grow the index.
+        bool grow = 2 * t->numErased < t->numFilled;
+        _rebuildIndex(grow ? 2 * _index->numSlots : 0);
+        return;
+      }
+      _freeRetiredIndexes();
+
+      _beginIndexWrite();
+      if (replacing && oldRealId != realId) {
+        _eraseSlot(&_index->byReal, _index->numSlots, oldRealId, virtualId);
+      }
+      _insertSlot(&_index->byVirtual, _index->numSlots, virtualId, realId);
+      _insertSlot(&_index->byReal, _index->numSlots, realId, virtualId);
+      _endIndexWrite();
+    }
+
+    // Called with tblLock held; returns the iterator following 'i'.
+    id_iterator _eraseMapping(id_iterator i)
+    {
+      _beginIndexWrite();
+      _eraseSlot(&_index->byVirtual, _index->numSlots, i->first, i->second);
+
+      // If a stale mapping shares the real id, the reverse slot points at the
+      // newer of the two and is left alone.
+      _eraseSlot(&_index->byReal, _index->numSlots, i->second, i->first);
+      _endIndexWrite();
+      _freeRetiredIndexes();
+      _markId(i->first, false);
+      return _idMapTable.erase(i);
+    }
+
     dmtcp::unordered_map<IdType, IdType>_idMapTable;
     IdType _base;
     size_t _max;
     IdType _nextVirtualId;
+
+  private:
+    enum { ID_SLOT_EMPTY = 0, ID_SLOT_USED, ID_SLOT_ERASED };
+
+    struct IdSlot {
+      IdType key;
+      IdType value;
+      uint32_t state;
+    };
+
+    struct IdSlots {
+      size_t numFilled;  // slots that are used or erased
+      size_t numErased;
+      IdSlot *slots;
+    };
+
+    // Two open-addressing tables of the same size: virtual-to-real and
+    // real-to-virtual.
+    struct IdIndex {
+      size_t numSlots;   // a power of two
+      IdSlots byVirtual;
+      IdSlots byReal;
+    };
+
+    static size_t _hash(IdType id)
+    {
+      return (size_t)(((uint64_t)id * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+
+    void _beginIndexWrite()
+    {
+      __atomic_store_n(&_seq, _seq + 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    void _endIndexWrite()
+    {
+      __atomic_store_n(&_seq, _seq + 1, __ATOMIC_RELEASE);
+    }
+
+    static void _insertSlot(IdSlots *t, size_t numSlots,
+                            IdType key, IdType value)
+    {
+      IdSlot *slot = NULL;
+      size_t mask = numSlots - 1;
+
+      for (size_t i = _hash(key) & mask;; i = (i + 1) & mask) {
+        IdSlot *s = &t->slots[i];
+        if (s->state == ID_SLOT_EMPTY) {
+          if (slot == NULL) {
+            slot = s;
+            t->numFilled++;
+          }
+          break;
+        }
+        if (s->state == ID_SLOT_ERASED) {
+          if (slot == NULL) {
+            slot = s;
+          }
+        } else if (s->key == key) {
+          slot = s;
+          break;
+        }
+      }
+      if (slot->state == ID_SLOT_ERASED) {
+        t->numErased--;
+      }
+      __atomic_store_n(&slot->key, key, __ATOMIC_RELAXED);
+      __atomic_store_n(&slot->value, value, __ATOMIC_RELAXED);
+      __atomic_store_n(&slot->state, ID_SLOT_USED, __ATOMIC_RELAXED);
+    }
+
+    // Erases 'key' only if it still maps to 'value'.
+    static void _eraseSlot(IdSlots *t, size_t numSlots,
+                           IdType key, IdType value)
+    {
+      size_t mask = numSlots - 1;
+
+      for (size_t i = _hash(key) & mask;; i = (i + 1) & mask) {
+        IdSlot *s = &t->slots[i];
+        if (s->state == ID_SLOT_EMPTY) {
+          break;
+        }
+        if (s->state == ID_SLOT_USED && s->key == key) {
+          if (s->value == value) {
+            __atomic_store_n(&s->state, ID_SLOT_ERASED, __ATOMIC_RELAXED);
+            t->numErased++;
+          }
+          break;
+        }
+      }
+    }
+
+    // Bit i of _idBitmap stands for the id _base + 1 + i; see
+    // addOneToNextVirtualId() for the range.  Bits past the range are set.
+    void _markId(IdType id, bool used)
+    {
+      size_t bit = (size_t)id - (size_t)_base - 1;
+
+      if ((size_t)id <= (size_t)_base || bit >= _max - 1) {
+        return;
+      }
+      if (used) {
+        _idBitmap[bit / 64] |= 1ULL << (bit % 64);
+      } else {
+        _idBitmap[bit / 64] &= ~(1ULL << (bit % 64));
+      }
+    }
+
+    bool _findFreeId(size_t start, size_t *bit)
+    {
+      size_t numWords = _idBitmap.size();
+
+      if (numWords == 0) {
+        return false;
+      }
+
+      size_t w = start / 64;
+      uint64_t free = ~_idBitmap[w] & (~0ULL << (start % 64));
+
+      // Scan from 'start' to the end, then wrap around to 'start' again.
+      for (size_t n = 0; n <= numWords; n++) {
+        if (free != 0) {
+          *bit = w * 64 + __builtin_ctzll(free);
+          return true;
+        }
+        w = (w + 1) % numWords;
+        free = ~_idBitmap[w];
+      }
+      return false;
+    }
+
+    void _rebuildIdBitmap()
+    {
+      size_t numIds = _max - 1;
+
+      _idBitmap.assign((numIds + 63) / 64, 0);
+      if (numIds % 64 != 0) {
+        _idBitmap.back() = ~0ULL << (numIds % 64);
+      }
+      for (id_iterator i = _idMapTable.begin(); i != _idMapTable.end(); ++i) {
+        _markId(i->first, true);
+      }
+    }
+
+    // Called with tblLock held, whenever _idMapTable or _base is replaced.
+    void _resetIndexes()
+    {
+      _rebuildIndex();
+      _rebuildIdBitmap();
+    }
+
+    // Called with tblLock held; fills 'index' from _idMapTable.
+    void _fillIndex(IdIndex *index)
+    {
+      IdSlot *slots = index->byVirtual.slots;
+
+      for (size_t i = 0; i < 2 * index->numSlots; i++) {
+        __atomic_store_n(&slots[i].state, ID_SLOT_EMPTY, __ATOMIC_RELAXED);
+      }
+      index->byVirtual.numFilled = index->byVirtual.numErased = 0;
+      index->byReal.numFilled = index->byReal.numErased = 0;
+      for (id_iterator i = _idMapTable.begin(); i != _idMapTable.end(); ++i) {
+        _insertSlot(&index->byVirtual, index->numSlots, i->first, i->second);
+        _insertSlot(&index->byReal, index->numSlots, i->second, i->first);
+      }
+    }
+
+    // Called with tblLock held.  Leaves at least three quarters of the index
+    // empty, with at least 'minSlots' slots.  The current index is purged in
+    // place if it is large enough, and is replaced otherwise.
+    void _rebuildIndex(size_t minSlots = 0)
+    {
+      size_t numSlots = 64;
+
+      while (numSlots < 4 * _idMapTable.size() || numSlots < minSlots) {
+        numSlots *= 2;
+      }
+
+      if (_index != NULL && _index->numSlots >= numSlots) {
+        _beginIndexWrite();
+        _fillIndex(_index);
+        _endIndexWrite();
+        return;
+      }
+
+      IdIndex *index = (IdIndex *)JALLOC_HELPER_MALLOC(
+          sizeof(IdIndex) + 2 * numSlots * sizeof(IdSlot));
+      index->numSlots = numSlots;
+      index->byVirtual.slots = (IdSlot *)(index + 1);
+      index->byReal.slots = index->byVirtual.slots + numSlots;
+      _fillIndex(index);
+
+      _beginIndexWrite();
+      if (_index != NULL) {
+        _retiredIndexes.push_back(_index);
+      }
+      __atomic_store_n(&_index, index, __ATOMIC_SEQ_CST);
+      _endIndexWrite();
+      _freeRetiredIndexes();
+    }
+
+    // Called with tblLock held.  A reader that registers after the swap in
+    // _rebuildIndex() sees the new index, so the retired ones can go once no
+    // reader is registered.
+    void _freeRetiredIndexes()
+    {
+      if (_retiredIndexes.empty() ||
+          __atomic_load_n(&_numReaders, __ATOMIC_SEQ_CST) != 0) {
+        return;
+      }
+      for (size_t i = 0; i < _retiredIndexes.size(); i++) {
+        JALLOC_HELPER_FREE(_retiredIndexes[i]);
+      }
+      _retiredIndexes.clear();
+    }
+
+    static bool _probe(IdSlot *slots, size_t numSlots,
+                       IdType key, IdType *value)
+    {
+      size_t mask = numSlots - 1;
+      size_t i = _hash(key) & mask;
+
+      // Bounded, since a reader racing with a writer may see a full index.
+      for (size_t n = 0; n < numSlots; n++, i = (i + 1) & mask) {
+        IdSlot *s = &slots[i];
+        uint32_t state = __atomic_load_n(&s->state, __ATOMIC_RELAXED);
+        if (state == ID_SLOT_EMPTY) {
+          break;
+        }
+        if (state == ID_SLOT_USED &&
+            __atomic_load_n(&s->key, __ATOMIC_RELAXED) == key) {
+          *value = __atomic_load_n(&s->value, __ATOMIC_RELAXED);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool _lookup(IdType id, IdType *result, bool byReal = false)
+    {
+      bool found = false;
+
+      // Keeps the index we probe from being freed under us.
+      __atomic_add_fetch(&_numReaders, 1, __ATOMIC_SEQ_CST);
+      for (int i = 0; i < VIRTUAL_ID_TABLE_READ_RETRIES; i++) {
+        uint32_t seq = __atomic_load_n(&_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+          continue;
+        }
+        IdIndex *index = __atomic_load_n(&_index, __ATOMIC_SEQ_CST);
+        IdSlots *t = byReal ? &index->byReal : &index->byVirtual;
+        IdType value = 0;
+        found = _probe(t->slots, index->numSlots, id, &value);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&_seq, __ATOMIC_RELAXED) == seq) {
+          __atomic_sub_fetch(&_numReaders, 1, __ATOMIC_RELEASE);
+          if (found) {
+            *result = value;
+          }
+          return found;
+        }
+      }
+      __atomic_sub_fetch(&_numReaders, 1, __ATOMIC_RELEASE);
+
+      found = false;
+      _do_lock_tbl();
+      if (!byReal) {
+        id_iterator i = _idMapTable.find(id);
+        if (i != _idMapTable.end()) {
+          *result = i->second;
+          found = true;
+        }
+      } else {
+        found = _probe(_index->byReal.slots, _index->numSlots, id, result);
+      }
+      _freeRetiredIndexes();
+      _do_unlock_tbl();
+      return found;
+    }
+
+    string _typeStr;
+    DmtcpMutex tblLock;
+    IdIndex *_index;
+    uint32_t _seq;
+    uint32_t _numReaders;  // lock-free lookups in progress
+    vector<IdIndex *>_retiredIndexes;
+    vector<uint64_t>_idBitmap;
 };
 }
 #endif // ifndef VIRTUAL_ID_TABLE_H
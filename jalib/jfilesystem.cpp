@@ -248,10 +248,19 @@ jalib::Filesystem::ResolveSymlink(const dmtcp::string &path)
   return buf;
 }
 
+// /proc/self/fd/<fd> is always a symbolic link, so unlike ResolveSymlink,
+// this skips the lstat() and reads the link directly.
 dmtcp::string
 jalib::Filesystem::GetDeviceName(int fd)
 {
-  return ResolveSymlink("/proc/self/fd/" + jalib::XToString(fd));
+  char buf[PATH_MAX];
+  dmtcp::string path = "/proc/self/fd/" + jalib::XToString(fd);
+  ssize_t len = readlink(path.c_str(), buf, sizeof(buf) - 1);
+
+  if (len <= 0) {
+    return "";
+  }
+  return dmtcp::string(buf, len);
 }
 
 bool
@@ -64,9 +64,10 @@ using namespace dmtcp;
 
 static int forked_ckpt_status = -1;
 static pid_t ckpt_extcomp_child_pid = -1;
+static uint64_t rawImageBytes = 0;
 static struct sigaction saved_sigchld_action;
 static int open_ckpt_to_write(int fd, int pipe_fds[2], char **extcomp_args);
-void mtcp_writememoryareas(int fd) __attribute__((weak));
+uint64_t mtcp_writememoryareas(int fd) __attribute__((weak));
 
 /* We handle SIGCHLD while checkpointing. */
 static void
@@ -421,6 +422,7 @@ CkptSerializer::writeCkptImage(void *mtcpHdr,
                                const string& ckptFilename)
 {
   JTRACE("Thread performing checkpoint.") (dmtcp_gettid());
+  rawImageBytes = 0;
   createCkptDir();
   forked_ckpt_status = test_and_prepare_for_forked_ckpt();
   if (forked_ckpt_status == FORKED_CKPT_PARENT) {
@@ -447,7 +449,7 @@ CkptSerializer::writeCkptImage(void *mtcpHdr,
   JASSERT(Util::writeAll(fd, mtcpHdr, mtcpHdrLen) == (ssize_t)mtcpHdrLen);
 
   JTRACE("MTCP is about to write checkpoint image.")(ckptFilename);
-  mtcp_writememoryareas(fd);
+  rawImageBytes += mtcpHdrLen + mtcp_writememoryareas(fd);
 
   if (use_compression) {
     /* In perform_open_ckpt_image_fd(), we set SIGCHLD to our own handler.
@@ -487,4 +489,11 @@ CkptSerializer::writeDmtcpHeader(int fd)
   ssize_t remaining = pagesize - (written % pagesize);
   char buf[remaining];
   JASSERT(Util::writeAll(fd, buf, remaining) == remaining);
+  rawImageBytes += written + remaining;
+}
+
+uint64_t
+CkptSerializer::rawImageSize()
+{
+  return rawImageBytes;
 }
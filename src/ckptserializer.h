@@ -36,6 +36,10 @@ void writeCkptImage(void *mtcpHdr,
                     size_t mtcpHdrLen,
                     const string& ckptFilename);
 void writeDmtcpHeader(int fd);
+
+// Uncompressed size of the last image written by this process.  This is 0
+// if the image was written by a forked child process.
+uint64_t rawImageSize();
 }
 }
 #endif // ifndef CKPT_SERIZLIZER_H
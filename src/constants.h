@@ -54,9 +54,13 @@
 // Not used
 // #define X11_LISTENER_PORT_START 6000
 
-// Virtual pids used by coordinator.
+// Virtual pids used by coordinator.  Each process gets VIRTUAL_PID_STRIDE
+// virtual pids: its own and those of its threads.  A process is leased up to
+// VIRTUAL_PID_LEASE_SIZE virtual pids at a time for its children.
 #define INITIAL_VIRTUAL_PID         40000
 #define MAX_VIRTUAL_PID             400000000
+#define VIRTUAL_PID_STRIDE          1000
+#define VIRTUAL_PID_LEASE_SIZE      16
 
 // NEEDED FOR STRINGIFY(DEFAULT_PORT)
 #define QUOTE(arg) #arg
@@ -99,6 +103,7 @@
 
 #define ENV_VAR_COORD_LOGFILE       "DMTCP_COORD_LOG_FILENAME"
 #define ENV_VAR_COORD_WRITE_KVDB    "DMTCP_COORD_WRITE_KV_DATA"
+#define ENV_VAR_COORD_RECONNECT_TIMEOUT "DMTCP_COORD_RECONNECT_TIMEOUT"
 
 // it is not yet safe to change these; these names are hard-wired in the code
 #define ENV_VAR_STDERR_PATH         "JALIB_STDERR_PATH"
@@ -127,6 +132,7 @@
   ENV_VAR_NAME_HOST,                  \
   ENV_VAR_NAME_PORT,                  \
   ENV_VAR_CKPT_INTR,                  \
+  ENV_VAR_COORD_RECONNECT_TIMEOUT,    \
   ENV_VAR_REMOTE_SHELL_CMD,           \
   ENV_VAR_ORIG_LD_PRELOAD,            \
   ENV_VAR_HIJACK_LIBS,                \
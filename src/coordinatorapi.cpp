@@ -28,6 +28,7 @@
 #include <netdb.h>
 #include <poll.h>
 #include <semaphore.h>  // for sem_post(&sem_launch)
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -53,6 +54,28 @@ const int coordinatorSocket = PROTECTED_COORD_FD;
 int nsSock = -1;
 static int childCoordinatorSocket = -1;
 
+// Virtual pids leased from the coordinator for the children of this process,
+// packed as (base << 32 | count).  A process asks for a lease on its first
+// fork.  Only a forking thread, which holds the wrapper lock exclusively, uses
+// 'leasedPids'.  The checkpoint thread stores a newly granted lease into
+// 'nextLeasedPids'.
+static uint64_t leasedPids = 0;
+static uint64_t nextLeasedPids = 0;
+static bool leaseRequested = false;
+
+// Set up by atForkPrepare() for the child.  If the child's virtual pid came
+// from the lease, the child reads the coordinator's DMT_ACCEPT itself.
+static pid_t childVirtualPid = -1;
+static bool childAcceptPending = false;
+
+// Set while this process holds the checkpoint write token.  With forked
+// checkpointing, the copy in the child writing the image is the one that
+// releases it.
+static bool hasCkptWriteToken = false;
+
+// Statistics recorded by the checkpoint thread, sent when the process resumes.
+static map<string, double> *workerStats = NULL;
+
 // Shared between getCoordHostAndPort() and setCoordPort()
 static int _cachedPort = 0;
 static string *_cachedHost = nullptr;
@@ -68,6 +91,7 @@ DmtcpMessage sendRecvHandshake(int fd,
                                DmtcpMessage msg,
                                string progname,
                                UniquePid *compId = NULL);
+static DmtcpMessage recvHandshake(int fd, UniquePid *compId = NULL);
 
 void sendMsgToCoordinatorRaw(int fd,
                              DmtcpMessage msg,
@@ -133,9 +157,23 @@ pluginDescr()
   return coordinatorAPIPlugin;
 }
 
+static uint64_t
+packLease(const DmtcpMessage &msg)
+{
+  if (msg.numLeasedPids == 0) {
+    return 0;
+  }
+  return ((uint64_t)(uint32_t)msg.leasedPidBase << 32) | msg.numLeasedPids;
+}
+
 void
 restart()
 {
+  // The lease belongs to the coordinator of the checkpointed computation.
+  leasedPids = 0;
+  nextLeasedPids = 0;
+  leaseRequested = false;
+
   _real_close(nsSock);
   nsSock = -1;
 }
@@ -268,8 +306,25 @@ void atForkParent()
   _real_close(childCoordinatorSocket);
 }
 
+static void
+finishChildHandshake()
+{
+  if (childAcceptPending) {
+    DmtcpMessage hello_remote = recvHandshake(childCoordinatorSocket);
+    JASSERT(hello_remote.virtualPid == childVirtualPid)
+      (hello_remote.virtualPid) (childVirtualPid);
+    childAcceptPending = false;
+  }
+
+  // The parent's lease and its pending request are not ours.
+  leasedPids = 0;
+  nextLeasedPids = 0;
+  leaseRequested = false;
+}
+
 void atForkChild()
 {
+  finishChildHandshake();
   resetCoordinatorSocket(childCoordinatorSocket);
 
   _real_close(nsSock);
@@ -278,6 +333,7 @@ void atForkChild()
 
 void vforkChild()
 {
+  finishChildHandshake();
   resetCoordinatorSocket(childCoordinatorSocket);
   JASSERT(nsSock == -1) .Text("Not Implemented");
 }
@@ -351,13 +407,18 @@ sendMsgToCoordinatorRaw(int fd,
                         const void *extraData,
                         size_t len)
 {
-  if (extraData != NULL) {
-    msg.extraBytes = len;
-  }
-  JASSERT(Util::writeAll(fd, &msg, sizeof(msg)) == sizeof(msg));
-  if (extraData != NULL) {
-    JASSERT(Util::writeAll(fd, extraData, len) == (ssize_t)len);
+  if (extraData == NULL) {
+    JASSERT(Util::writeAll(fd, &msg, sizeof(msg)) == sizeof(msg));
+    return;
   }
+
+  // One write for the message and its data: with Nagle's algorithm, a second
+  // small write waits for the coordinator to ACK the first one.
+  msg.extraBytes = len;
+  vector<char> buf(sizeof(msg) + len);
+  memcpy(&buf[0], &msg, sizeof(msg));
+  memcpy(&buf[sizeof(msg)], extraData, len);
+  JASSERT(Util::writeAll(fd, &buf[0], buf.size()) == (ssize_t)buf.size());
 }
 
 void
@@ -421,8 +482,17 @@ void sendMsgToCoordinator(const DmtcpMessage &msg, const string &data)
 
 void recvMsgFromCoordinator(DmtcpMessage *msg, void **extraData)
 {
-  msg->poison();
-  recvMsgFromCoordinatorRaw(coordinatorSocket, msg, extraData);
+  // A lease requested by a forking thread may arrive at any time; whoever is
+  // reading from the coordinator installs it.
+  while (true) {
+    msg->poison();
+    recvMsgFromCoordinatorRaw(coordinatorSocket, msg, extraData);
+    if (!msg->isValid() || msg->type != DMT_LEASED_VIRTUAL_PIDS) {
+      break;
+    }
+    __atomic_store_n(&nextLeasedPids, packLease(*msg), __ATOMIC_RELEASE);
+    __atomic_store_n(&leaseRequested, false, __ATOMIC_RELEASE);
+  }
 }
 
 bool waitForBarrier(const string& barrier,
@@ -573,11 +643,8 @@ createNewConnToCoord(CoordinatorMode mode)
   JASSERT(Util::isValidFd(coordinatorSocket));
 }
 
-DmtcpMessage
-sendRecvHandshake(int fd,
-                  DmtcpMessage msg,
-                  string progname,
-                  UniquePid *compId)
+static void
+sendHandshake(int fd, DmtcpMessage msg, string progname)
 {
   if (dmtcp_virtual_to_real_pid) {
     msg.realPid = dmtcp_virtual_to_real_pid(getpid());
@@ -595,6 +662,12 @@ sendRecvHandshake(int fd,
   strcpy(&buf[hostname.length() + 1], progname.c_str());
 
   sendMsgToCoordinatorRaw(fd, msg, buf, buflen);
+}
+
+static DmtcpMessage
+recvHandshake(int fd, UniquePid *compId)
+{
+  DmtcpMessage msg;
 
   recvMsgFromCoordinatorRaw(fd, &msg);
   msg.assertValid();
@@ -609,6 +682,11 @@ sendRecvHandshake(int fd,
     JASSERT(false) (*compId)
     .Text("Connection rejected by the coordinator.\n"
           " Reason: This process has a different computation group.");
+  } else if (msg.type == DMT_REJECT_VIRTUAL_PID_IN_USE) {
+    JASSERT(false) (msg.virtualPid)
+    .Text("Connection rejected by the coordinator.\n"
+          " Reason: The virtual pid leased to this process by its parent is"
+          " already in use.");
   }
   // Coordinator also prints this, but its stderr may go to /dev/null
   if (msg.type == DMT_REJECT_NOT_RESTARTING) {
@@ -625,6 +703,16 @@ sendRecvHandshake(int fd,
   return msg;
 }
 
+DmtcpMessage
+sendRecvHandshake(int fd,
+                  DmtcpMessage msg,
+                  string progname,
+                  UniquePid *compId)
+{
+  sendHandshake(fd, msg, progname);
+  return recvHandshake(fd, compId);
+}
+
 void
 connectToCoordOnStartup(CoordinatorMode mode,
                         string progname,
@@ -661,6 +749,32 @@ connectToCoordOnStartup(CoordinatorMode mode,
   memcpy(localIP, &hello_remote.ipAddr, sizeof hello_remote.ipAddr);
 }
 
+// Returns the next virtual pid of the lease, or -1 if the lease ran out.
+static pid_t
+takeLeasedPid()
+{
+  if (leasedPids == 0) {
+    leasedPids = __atomic_exchange_n(&nextLeasedPids, 0, __ATOMIC_ACQ_REL);
+  }
+
+  // Ask for the next lease in the background once half of this one is used.
+  if ((uint32_t)leasedPids <= VIRTUAL_PID_LEASE_SIZE / 2 &&
+      __atomic_load_n(&nextLeasedPids, __ATOMIC_ACQUIRE) == 0 &&
+      !__atomic_exchange_n(&leaseRequested, true, __ATOMIC_ACQ_REL)) {
+    sendMsgToCoordinator(DmtcpMessage(DMT_LEASE_VIRTUAL_PIDS));
+  }
+
+  if (leasedPids == 0) {
+    return -1;
+  }
+
+  pid_t pid = (pid_t)(leasedPids >> 32);
+  uint32_t count = (uint32_t)leasedPids - 1;
+  leasedPids = count == 0 ? 0 :
+    ((uint64_t)(uint32_t)(pid + VIRTUAL_PID_STRIDE) << 32) | count;
+  return pid;
+}
+
 int
 createNewConnectionBeforeFork(string& progname)
 {
@@ -672,14 +786,31 @@ createNewConnectionBeforeFork(string& progname)
   JASSERT(sock != -1);
 
   DmtcpMessage hello_local(DMT_NEW_WORKER);
-  DmtcpMessage hello_remote = sendRecvHandshake(sock, hello_local, progname);
-  JASSERT(hello_remote.virtualPid != -1);
+  pid_t leasedPid = -1;
+
+  // Without the pid plugin, virtual pids are not used.
+  if (dmtcp_virtual_to_real_pid) {
+    leasedPid = takeLeasedPid();
+  }
+
+  if (leasedPid != -1) {
+    // Don't wait for the coordinator; the child reads the reply.
+    hello_local.virtualPid = leasedPid;
+    sendHandshake(sock, hello_local, progname);
+    childVirtualPid = leasedPid;
+    childAcceptPending = true;
+  } else {
+    DmtcpMessage hello_remote = sendRecvHandshake(sock, hello_local, progname);
+    JASSERT(hello_remote.virtualPid != -1);
+    childVirtualPid = hello_remote.virtualPid;
+    childAcceptPending = false;
+  }
 
   if (dmtcp_virtual_to_real_pid) {
-    JTRACE("Got virtual pid from coordinator") (hello_remote.virtualPid);
+    JTRACE("Got virtual pid for child") (childVirtualPid) (leasedPid);
     pid_t pid = getpid();
     pid_t realPid = dmtcp_virtual_to_real_pid(pid);
-    Util::setVirtualPidEnvVar(hello_remote.virtualPid, pid, realPid);
+    Util::setVirtualPidEnvVar(childVirtualPid, pid, realPid);
   }
   return sock;
 }
@@ -720,8 +851,72 @@ connectToCoordOnRestart(CoordinatorMode  mode,
   JTRACE("Coordinator handshake RECEIVED!!!!!");
 }
 
+/* Called by the checkpoint thread if the coordinator connection is lost while
+ * the computation is running.  A coordinator restarted with --journal at the
+ * same address adopts the process again.  Retries until the timeout given by
+ * dmtcp_launch --coord-reconnect-timeout expires; returns false if it did.
+ */
+bool
+reconnectToCoordinator()
+{
+  const char *timeoutStr = getenv(ENV_VAR_COORD_RECONNECT_TIMEOUT);
+  if (timeoutStr == NULL) {
+    return false;
+  }
+
+  time_t deadline = time(NULL) + jalib::StringToInt(timeoutStr);
+  struct sockaddr_storage addr;
+  uint32_t len;
+  SharedData::getCoordAddr((struct sockaddr *)&addr, &len);
+
+  JNOTE("Lost connection to the coordinator; trying to reconnect")
+    (timeoutStr);
+  _real_close(coordinatorSocket);
+  if (nsSock != -1) {
+    _real_close(nsSock);
+    nsSock = -1;
+  }
+
+  DmtcpMessage hello_local(DMT_RECONNECT_WORKER);
+  hello_local.compGroup = SharedData::getCompId();
+  DmtcpMessage hello_remote;
+  int sock = -1;
+
+  // Until the new coordinator is up, connect() may fail or the connection may
+  // be dropped by whatever still holds the old listener; keep trying.
+  while (true) {
+    sock = jalib::JClientSocket((struct sockaddr *)&addr, len).sockfd();
+    if (sock != -1) {
+      sendHandshake(sock, hello_local, jalib::Filesystem::GetProgramName());
+      recvMsgFromCoordinatorRaw(sock, &hello_remote);
+      if (hello_remote.isValid()) {
+        break;
+      }
+      _real_close(sock);
+    }
+    if (time(NULL) >= deadline) {
+      JWARNING(false) .Text("Failed to reconnect to the coordinator");
+      return false;
+    }
+    sleep(1);
+  }
+
+  JASSERT(hello_remote.type == DMT_ACCEPT) (hello_remote.type)
+  .Text("The new coordinator refused this process.");
+
+  Util::changeFd(sock, PROTECTED_COORD_FD);
+  JASSERT(Util::isValidFd(coordinatorSocket));
+
+  // A pending lease request died with the old connection.  The remaining
+  // lease stays usable: the new coordinator recovered the next virtual pid
+  // from its journal, which is past every lease.
+  __atomic_store_n(&leaseRequested, false, __ATOMIC_RELEASE);
+  JNOTE("Reconnected to the coordinator");
+  return true;
+}
+
 void
-sendCkptFilename()
+sendCkptFilename(uint64_t rawImageSize)
 {
   // Tell coordinator to record our filename in the restart script
   string ckptFilename = ProcessInfo::instance().getCkptFilename();
@@ -740,6 +935,13 @@ sendCkptFilename()
   }
   JTRACE("recording filenames") (ckptFilename) (hostname) (shellType);
 
+  // Report the image size so the coordinator can track bytes per generation.
+  struct stat st;
+  if (stat(ckptFilename.c_str(), &st) == 0) {
+    msg.ckptImageSize = st.st_size;
+  }
+  msg.ckptRawImageSize = rawImageSize;
+
   size_t buflen = hostname.length() + shellType.length() +
                   ckptFilename.length() + 3;
   char buf[buflen];
@@ -751,6 +953,68 @@ sendCkptFilename()
   sendMsgToCoordinator(msg, buf, buflen);
 }
 
+void
+waitForCkptWriteToken(uint64_t imageSize)
+{
+  DmtcpMessage msg(DMT_CKPT_WRITE_TOKEN_REQUEST);
+  msg.ckptImageSize = imageSize;
+  sendMsgToCoordinator(msg);
+
+  JTRACE("waiting for DMT_CKPT_WRITE_TOKEN_GRANTED message") (imageSize);
+  DmtcpMessage reply;
+  recvMsgFromCoordinator(&reply);
+
+  // Coordinator sends a duplicate DMTCP_DO_CHECKPOINT msg if we reconnected
+  // after exec. It's safe to ignore. We'll wait again for the token.
+  if (reply.isValid() && reply.type == DMT_DO_CHECKPOINT) {
+    recvMsgFromCoordinator(&reply);
+  }
+
+  reply.assertValid();
+  JASSERT(reply.type == DMT_CKPT_WRITE_TOKEN_GRANTED) (reply.type);
+  hasCkptWriteToken = true;
+}
+
+void
+releaseCkptWriteToken()
+{
+  if (!hasCkptWriteToken) {
+    return;
+  }
+  hasCkptWriteToken = false;
+  sendMsgToCoordinator(DmtcpMessage(DMT_CKPT_WRITE_TOKEN_RELEASE));
+}
+
+void
+recordWorkerStat(const string &name, double value)
+{
+  JASSERT(!name.empty() && name.find_first_of("=\n") == string::npos)
+    (name).Text("Invalid worker statistic name");
+
+  if (workerStats == NULL) {
+    workerStats = new map<string, double>();
+  }
+  (*workerStats)[name] = value;
+}
+
+void
+sendWorkerStats()
+{
+  if (workerStats == NULL || workerStats->empty()) {
+    return;
+  }
+
+  ostringstream o;
+  for (map<string, double>::const_iterator it = workerStats->begin();
+       it != workerStats->end();
+       ++it) {
+    o << it->first << "=" << it->second << "\n";
+  }
+  workerStats->clear();
+
+  sendMsgToCoordinator(DmtcpMessage(DMT_WORKER_STATS), o.str());
+}
+
 kvdb::KVDBResponse
 kvdbRequest(DmtcpMessage const& msg,
             string const& key,
@@ -773,11 +1037,13 @@ kvdbRequest(DmtcpMessage const& msg,
     sock = nsSock;
   }
 
-  JASSERT(Util::writeAll(sock, &msg, sizeof(msg)) == sizeof(msg));
-  JASSERT(Util::writeAll(sock, key.data(), msg.keyLen) ==
-    (ssize_t)msg.keyLen);
-  JASSERT(Util::writeAll(sock, val.data(), msg.valLen) ==
-    (ssize_t)msg.valLen);
+  // A single write: with Nagle's algorithm, the key and the value would wait
+  // for the coordinator's delayed ACK, costing tens of ms per request.
+  vector<char> buf(sizeof(msg) + msg.keyLen + msg.valLen);
+  memcpy(&buf[0], &msg, sizeof(msg));
+  memcpy(&buf[sizeof(msg)], key.data(), msg.keyLen);
+  memcpy(&buf[sizeof(msg) + msg.keyLen], val.data(), msg.valLen);
+  JASSERT(Util::writeAll(sock, &buf[0], buf.size()) == (ssize_t)buf.size());
 
   DmtcpMessage reply;
   reply.poison();
@@ -786,11 +1052,12 @@ kvdbRequest(DmtcpMessage const& msg,
   JASSERT(reply.type == DMT_KVDB_RESPONSE);
 
   if (reply.extraBytes != 0) {
-    char valBuf[reply.extraBytes];
-    JASSERT(Util::readAll(sock, valBuf, reply.valLen) ==
+    // An MGET reply holds many NUL-separated values; keep all of them.
+    vector<char> valBuf(reply.extraBytes);
+    JASSERT(Util::readAll(sock, &valBuf[0], reply.valLen) ==
             (ssize_t)reply.valLen);
     if (oldVal != nullptr) {
-      *oldVal = valBuf;
+      oldVal->assign(&valBuf[0], reply.valLen - 1);
     }
   }
 
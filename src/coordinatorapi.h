@@ -77,8 +77,19 @@ char *connectAndSendUserCommand(char c,
                                 int *isRunning = NULL,
                                 int *ckptInterval = NULL);
 
-void sendCkptFilename();
+bool reconnectToCoordinator();
 
+void sendCkptFilename(uint64_t rawImageSize);
+
+void waitForCkptWriteToken(uint64_t imageSize);
+
+// Releases the write token, if held, once the image has been written.
+void releaseCkptWriteToken();
+
+// Records a statistic of the current checkpoint or restart; sent to the
+// coordinator, and cleared, by sendWorkerStats().
+void recordWorkerStat(const string &name, double value);
+void sendWorkerStats();
 
 kvdb::KVDBResponse
 kvdbRequest(DmtcpMessage const& msg,
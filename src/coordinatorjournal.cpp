@@ -0,0 +1,338 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2013 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#include "coordinatorjournal.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../jalib/jassert.h"
+#include "../jalib/jconvert.h"
+#include "util.h"
+
+using namespace dmtcp;
+
+// Record types
+#define JOURNAL_COMPUTATION      'C'
+#define JOURNAL_NEXT_VIRTUAL_PID 'N'
+#define JOURNAL_CKPT_INTERVAL    'I'
+#define JOURNAL_PORT             'P'
+#define JOURNAL_KVDB_SET         'K'
+#define JOURNAL_KVDB_RESET       'R'
+#define JOURNAL_CKPT_FILE        'F'
+#define JOURNAL_CKPT_TIMESTAMP   'T'
+
+void
+CoordinatorJournal::encode(string *out, char type, const vector<string> &fields)
+{
+  *out += type;
+  for (size_t i = 0; i < fields.size(); i++) {
+    *out += " " + jalib::XToString(fields[i].length()) + ":" + fields[i];
+  }
+  *out += "\n";
+}
+
+// Returns the number of fields carried by records of the given type, or -1
+// for an unknown type.
+static int
+numFields(char type)
+{
+  switch (type) {
+  case JOURNAL_COMPUTATION:
+    return 5;
+
+  case JOURNAL_KVDB_SET:
+  case JOURNAL_CKPT_FILE:
+    return 3;
+
+  case JOURNAL_NEXT_VIRTUAL_PID:
+  case JOURNAL_CKPT_INTERVAL:
+  case JOURNAL_PORT:
+  case JOURNAL_CKPT_TIMESTAMP:
+    return 1;
+
+  case JOURNAL_KVDB_RESET:
+    return 0;
+
+  default:
+    return -1;
+  }
+}
+
+size_t
+CoordinatorJournal::replay(const string &data, State *state)
+{
+  size_t pos = 0;
+
+  while (pos < data.length()) {
+    size_t start = pos;
+    char type = data[pos++];
+    vector<string> fields;
+    bool complete = false;
+
+    while (pos < data.length()) {
+      if (data[pos] == '\n') {
+        pos++;
+        complete = true;
+        break;
+      }
+      size_t colon = data.find(':', pos + 1);
+      if (data[pos] != ' ' || colon == string::npos || colon == pos + 1 ||
+          data.find_first_not_of("0123456789", pos + 1) != colon) {
+        break;
+      }
+      size_t len = jalib::StringToX<size_t>(data.substr(pos + 1,
+                                                          colon - pos - 1));
+      if (len > data.length() - colon - 1) {
+        break;
+      }
+      fields.push_back(data.substr(colon + 1, len));
+      pos = colon + 1 + len;
+    }
+
+    // An append-only log ends at its last valid record: a coordinator that
+    // died mid-write leaves a torn record, and the replacement coordinator
+    // must still recover everything before it.
+    if (!complete) {
+      JWARNING(false) (start) .Text("Ignoring truncated journal record");
+      return start;
+    }
+    if (numFields(type) != (int)fields.size()) {
+      JWARNING(false) (start) (type) (fields.size())
+      .Text("Ignoring invalid journal record and everything after it");
+      return start;
+    }
+
+    switch (type) {
+    case JOURNAL_COMPUTATION:
+      state->compId = UniquePid(jalib::StringToX<uint64_t>(fields[0]),
+                                jalib::StringToInt(fields[1]),
+                                jalib::StringToX<uint64_t>(fields[2]),
+                                jalib::StringToInt(fields[3]));
+      state->curTimeStamp = jalib::StringToX<uint64_t>(fields[4]);
+      break;
+
+    case JOURNAL_NEXT_VIRTUAL_PID:
+      state->nextVirtualPid = jalib::StringToInt(fields[0]);
+      break;
+
+    case JOURNAL_CKPT_INTERVAL:
+      state->ckptInterval = jalib::StringToX<uint32_t>(fields[0]);
+      break;
+
+    case JOURNAL_PORT:
+      state->port = jalib::StringToInt(fields[0]);
+      break;
+
+    case JOURNAL_KVDB_SET:
+      state->kvdb[fields[0]][fields[1]] = fields[2];
+      break;
+
+    case JOURNAL_KVDB_RESET:
+      state->kvdb.clear();
+      break;
+
+    case JOURNAL_CKPT_FILE:
+    {
+      CkptFile file = { fields[0], fields[1], fields[2] };
+      state->ckptFiles.push_back(file);
+      break;
+    }
+
+    case JOURNAL_CKPT_TIMESTAMP:
+      state->ckptTimeStamp = jalib::StringToX<time_t>(fields[0]);
+      break;
+    }
+  }
+  return pos;
+}
+
+bool
+CoordinatorJournal::open(const string &path, State *state)
+{
+  _path = path;
+  _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  JASSERT(_fd != -1) (path) (JASSERT_ERRNO)
+  .Text("Failed to open coordinator journal");
+
+  struct stat st;
+  JASSERT(fstat(_fd, &st) == 0) (path) (JASSERT_ERRNO);
+  if (st.st_size == 0) {
+    return false;
+  }
+
+  string data(st.st_size, '\0');
+  JASSERT(pread(_fd, &data[0], st.st_size, 0) == st.st_size)
+    (path) (JASSERT_ERRNO);
+  size_t valid = replay(data, state);
+  if (valid < data.length()) {
+    // Drop the invalid tail so that new records are not appended after it.
+    JWARNING(ftruncate(_fd, valid) == 0) (path) (JASSERT_ERRNO);
+  }
+  return state->compId != UniquePid(0, 0, 0);
+}
+
+void
+CoordinatorJournal::writeRecords(const string &records)
+{
+  if (_fd == -1) {
+    return;
+  }
+
+  // The records go to the page cache; the journal protects against the
+  // coordinator process dying, not against the loss of its host.
+  JASSERT(Util::writeAll(_fd, records.data(), records.length()) ==
+          (ssize_t)records.length()) (_path) (JASSERT_ERRNO);
+}
+
+void
+CoordinatorJournal::append(char type, const vector<string> &fields)
+{
+  string record;
+
+  encode(&record, type, fields);
+  writeRecords(record);
+}
+
+void
+CoordinatorJournal::computation(const UniquePid &compId, uint64_t curTimeStamp)
+{
+  vector<string> fields;
+
+  fields.push_back(jalib::XToString(compId.hostid()));
+  fields.push_back(jalib::XToString(compId.pid()));
+  fields.push_back(jalib::XToString(compId.time()));
+  fields.push_back(jalib::XToString(compId.computationGeneration()));
+  fields.push_back(jalib::XToString(curTimeStamp));
+  append(JOURNAL_COMPUTATION, fields);
+}
+
+void
+CoordinatorJournal::nextVirtualPid(pid_t pid)
+{
+  append(JOURNAL_NEXT_VIRTUAL_PID, vector<string>(1, jalib::XToString(pid)));
+}
+
+void
+CoordinatorJournal::ckptInterval(uint32_t interval)
+{
+  append(JOURNAL_CKPT_INTERVAL,
+         vector<string>(1, jalib::XToString(interval)));
+}
+
+void
+CoordinatorJournal::port(int port)
+{
+  _port = port;
+  append(JOURNAL_PORT, vector<string>(1, jalib::XToString(port)));
+}
+
+void
+CoordinatorJournal::kvdbSet(const string &id,
+                            const string &key,
+                            const string &val)
+{
+  vector<string> fields;
+
+  fields.push_back(id);
+  fields.push_back(key);
+  fields.push_back(val);
+  append(JOURNAL_KVDB_SET, fields);
+}
+
+void
+CoordinatorJournal::kvdbReset()
+{
+  append(JOURNAL_KVDB_RESET, vector<string>());
+}
+
+void
+CoordinatorJournal::rewrite(const State &state)
+{
+  if (_fd == -1) {
+    return;
+  }
+
+  string records;
+  vector<string> fields;
+
+  fields.push_back(jalib::XToString(state.compId.hostid()));
+  fields.push_back(jalib::XToString(state.compId.pid()));
+  fields.push_back(jalib::XToString(state.compId.time()));
+  fields.push_back(jalib::XToString(state.compId.computationGeneration()));
+  fields.push_back(jalib::XToString(state.curTimeStamp));
+  encode(&records, JOURNAL_COMPUTATION, fields);
+  encode(&records, JOURNAL_NEXT_VIRTUAL_PID,
+         vector<string>(1, jalib::XToString(state.nextVirtualPid)));
+  encode(&records, JOURNAL_CKPT_INTERVAL,
+         vector<string>(1, jalib::XToString(state.ckptInterval)));
+  encode(&records, JOURNAL_PORT,
+         vector<string>(1, jalib::XToString(state.port)));
+  encode(&records, JOURNAL_CKPT_TIMESTAMP,
+         vector<string>(1, jalib::XToString(state.ckptTimeStamp)));
+
+  for (size_t i = 0; i < state.ckptFiles.size(); i++) {
+    fields.clear();
+    fields.push_back(state.ckptFiles[i].hostname);
+    fields.push_back(state.ckptFiles[i].shell);
+    fields.push_back(state.ckptFiles[i].filename);
+    encode(&records, JOURNAL_CKPT_FILE, fields);
+  }
+
+  map<string, LookupService::KeyValueMap>::const_iterator db;
+  for (db = state.kvdb.begin(); db != state.kvdb.end(); ++db) {
+    LookupService::KeyValueMap::const_iterator kv;
+    for (kv = db->second.begin(); kv != db->second.end(); ++kv) {
+      fields.clear();
+      fields.push_back(db->first);
+      fields.push_back(kv->first);
+      fields.push_back(kv->second);
+      encode(&records, JOURNAL_KVDB_SET, fields);
+    }
+  }
+
+  // Write the snapshot next to the journal and rename it into place, so that
+  // a crash leaves either the old or the new journal behind.
+  string tmpPath = _path + ".tmp";
+  int fd = ::open(tmpPath.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+  JASSERT(fd != -1) (tmpPath) (JASSERT_ERRNO);
+  JASSERT(Util::writeAll(fd, records.data(), records.length()) ==
+          (ssize_t)records.length()) (tmpPath) (JASSERT_ERRNO);
+  JASSERT(fsync(fd) == 0) (tmpPath) (JASSERT_ERRNO);
+  JASSERT(rename(tmpPath.c_str(), _path.c_str()) == 0)
+    (tmpPath) (_path) (JASSERT_ERRNO);
+
+  close(_fd);
+  _fd = fd;
+}
+
+void
+CoordinatorJournal::clear()
+{
+  if (_fd == -1) {
+    return;
+  }
+  JASSERT(ftruncate(_fd, 0) == 0) (_path) (JASSERT_ERRNO);
+  if (_port != -1) {
+    port(_port);
+  }
+}
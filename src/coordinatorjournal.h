@@ -0,0 +1,106 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2013 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#ifndef COORDINATORJOURNAL_H
+#define COORDINATORJOURNAL_H
+
+#include "dmtcpalloc.h"
+#include "lookup_service.h"
+#include "uniquepid.h"
+
+namespace dmtcp
+{
+/*
+ * Append-only journal of the coordinator state that outlives the worker
+ * connections (see dmtcp_coordinator --journal).  A coordinator started with
+ * an existing journal replays it and resumes the computation; the workers
+ * reconnect with DMT_RECONNECT_WORKER.
+ *
+ * Each record is a single type character followed by length-prefixed fields
+ * ("<len>:<bytes>") and a newline.  A record cut short by a crash of the
+ * coordinator is ignored on replay.  The journal is rewritten from a
+ * snapshot after replay and after every checkpoint to bound its size.
+ */
+class CoordinatorJournal
+{
+  public:
+    struct CkptFile {
+      string hostname;
+      string shell;
+      string filename;
+    };
+
+    struct State {
+      State()
+        : curTimeStamp(0),
+        ckptTimeStamp(0),
+        nextVirtualPid(0),
+        ckptInterval(0),
+        port(-1)
+      {}
+
+      UniquePid compId;
+      uint64_t curTimeStamp;
+      time_t ckptTimeStamp;
+      pid_t nextVirtualPid;
+      uint32_t ckptInterval;
+      int port;
+      map<string, LookupService::KeyValueMap>kvdb;
+      vector<CkptFile>ckptFiles;
+    };
+
+    CoordinatorJournal() : _fd(-1), _port(-1) {}
+
+    // Opens (creating if needed) the journal and replays it into 'state'.
+    // Returns true if the journal describes a computation.
+    bool open(const string &path, State *state);
+    bool isOpen() const { return _fd != -1; }
+
+    void computation(const UniquePid &compId, uint64_t curTimeStamp);
+    void nextVirtualPid(pid_t pid);
+    void ckptInterval(uint32_t interval);
+    void port(int port);
+    void kvdbSet(const string &id, const string &key, const string &val);
+    void kvdbReset();
+
+    // Atomically replaces the journal with a snapshot of 'state'.  The
+    // checkpoint files are only journaled this way, once a checkpoint has
+    // completed.
+    void rewrite(const State &state);
+
+    // Drops all state but the port; called once the computation has ended.
+    void clear();
+
+  private:
+    void append(char type, const vector<string> &fields);
+    void writeRecords(const string &records);
+    static void encode(string *out, char type, const vector<string> &fields);
+
+    // Replays the records of 'data' into 'state', stopping at the first torn
+    // or unrecognized record.  Returns the length of the valid prefix.
+    static size_t replay(const string &data, State *state);
+
+    string _path;
+    int _fd;
+    int _port;
+};
+}
+#endif // ifndef COORDINATORJOURNAL_H
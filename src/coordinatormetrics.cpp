@@ -0,0 +1,403 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2013 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#include "coordinatormetrics.h"
+#include <time.h>
+#include <algorithm>
+#include "../jalib/jassert.h"
+#include "dmtcp_coordinator.h"
+
+using namespace dmtcp;
+
+// Upper bounds (in seconds) of the latency histogram buckets.
+static const double latencyBuckets[] = {
+  0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60, 300
+};
+static const size_t numLatencyBuckets =
+  sizeof(latencyBuckets) / sizeof(latencyBuckets[0]);
+
+const double CoordinatorMetrics::STRAGGLER_FACTOR = 3.0;
+const double CoordinatorMetrics::STRAGGLER_MIN_EXCESS = 1.0;
+const size_t CoordinatorMetrics::STRAGGLER_MIN_WORKERS = 3;
+
+// Escape a label value as required by the Prometheus text format.
+static string
+labelValue(const string &value)
+{
+  string escaped;
+
+  for (size_t i = 0; i < value.length(); i++) {
+    if (value[i] == '\\' || value[i] == '"') {
+      escaped += '\\';
+      escaped += value[i];
+    } else if (value[i] == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += value[i];
+    }
+  }
+  return escaped;
+}
+
+static void
+printHeader(ostringstream &o,
+            const char *name,
+            const char *type,
+            const char *help)
+{
+  o << "# HELP " << name << " " << help << "\n"
+    << "# TYPE " << name << " " << type << "\n";
+}
+
+CoordinatorMetrics::Histogram::Histogram()
+  : _buckets(numLatencyBuckets, 0),
+  _count(0),
+  _sum(0.0)
+{}
+
+void
+CoordinatorMetrics::Histogram::observe(double value)
+{
+  for (size_t i = 0; i < numLatencyBuckets; i++) {
+    if (value <= latencyBuckets[i]) {
+      _buckets[i]++;
+    }
+  }
+  _count++;
+  _sum += value;
+}
+
+void
+CoordinatorMetrics::Histogram::print(ostringstream &o,
+                                     const string &name,
+                                     const string &labels) const
+{
+  string sep = labels.empty() ? "" : ",";
+
+  for (size_t i = 0; i < numLatencyBuckets; i++) {
+    o << name << "_bucket{" << labels << sep
+      << "le=\"" << latencyBuckets[i] << "\"} " << _buckets[i] << "\n";
+  }
+  o << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << _count << "\n"
+    << name << "_sum{" << labels << "} " << _sum << "\n"
+    << name << "_count{" << labels << "} " << _count << "\n";
+}
+
+CoordinatorMetrics::CoordinatorMetrics()
+  : _phaseStart(0.0),
+  _barrierStart(0.0)
+{}
+
+double
+CoordinatorMetrics::now()
+{
+  struct timespec value;
+
+  JASSERT(clock_gettime(CLOCK_MONOTONIC, &value) == 0);
+  return value.tv_sec + value.tv_nsec / 1e9;
+}
+
+string
+CoordinatorMetrics::workerId(const CoordClient *client)
+{
+  ostringstream o;
+
+  o << client->identity();
+  return o.str();
+}
+
+void
+CoordinatorMetrics::startPhase(const string &phase)
+{
+  _phase = phase;
+  _phaseStart = _barrierStart = now();
+  _arrivals.clear();
+}
+
+void
+CoordinatorMetrics::endPhase(const string &phase)
+{
+  if (_phase != phase) {
+    return;
+  }
+
+  double duration = now() - _phaseStart;
+  _phaseDuration[phase].observe(duration);
+  _lastPhaseDuration[phase] = duration;
+  _phase.clear();
+}
+
+void
+CoordinatorMetrics::barrierArrived(const CoordClient *client,
+                                   const string &barrier)
+{
+  string worker = workerId(client);
+  double lag = now() - _barrierStart;
+
+  _arrivals[worker] = lag;
+  _hosts[worker] = client->hostname();
+  _barrierArrivalLag[barrier].observe(lag);
+  _lastArrivalLag[barrier][worker] = lag;
+}
+
+map<string, double>
+CoordinatorMetrics::findStragglers() const
+{
+  map<string, double> stragglers;
+
+  if (_arrivals.size() < STRAGGLER_MIN_WORKERS) {
+    return stragglers;
+  }
+
+  vector<double> lags;
+  for (map<string, double>::const_iterator it = _arrivals.begin();
+       it != _arrivals.end();
+       ++it) {
+    lags.push_back(it->second);
+  }
+  std::nth_element(lags.begin(), lags.begin() + lags.size() / 2, lags.end());
+  double median = lags[lags.size() / 2];
+
+  for (map<string, double>::const_iterator it = _arrivals.begin();
+       it != _arrivals.end();
+       ++it) {
+    if (it->second > STRAGGLER_FACTOR * median &&
+        it->second - median >= STRAGGLER_MIN_EXCESS) {
+      stragglers[it->first] = it->second;
+    }
+  }
+  return stragglers;
+}
+
+map<string, double>
+CoordinatorMetrics::barrierReleased(const string &barrier)
+{
+  double releaseTime = now();
+  SlowestWorker slowest = { "", "", -1.0 };
+
+  for (map<string, double>::const_iterator it = _arrivals.begin();
+       it != _arrivals.end();
+       ++it) {
+    if (it->second > slowest.lag) {
+      slowest.worker = it->first;
+      slowest.lag = it->second;
+    }
+  }
+  if (!slowest.worker.empty()) {
+    slowest.host = _hosts[slowest.worker];
+    _slowestWorker[barrier] = slowest;
+  }
+
+  map<string, double> stragglers = findStragglers();
+  _numStragglers[barrier] += stragglers.size();
+
+  _barrierLatency[barrier].observe(releaseTime - _barrierStart);
+  _barrierStart = releaseTime;
+  _arrivals.clear();
+  return stragglers;
+}
+
+void
+CoordinatorMetrics::ckptImageWritten(const CoordClient *client,
+                                     uint64_t imageSize,
+                                     uint64_t rawImageSize)
+{
+  WorkerImage &image = _images[workerId(client)];
+
+  image.host = client->hostname();
+  image.imageSize = imageSize;
+  image.rawImageSize = rawImageSize;
+}
+
+void
+CoordinatorMetrics::workerStats(const CoordClient *client, const string &stats)
+{
+  WorkerStats &worker = _workerStats[workerId(client)];
+  istringstream in(stats);
+  string line;
+
+  worker.host = client->hostname();
+  worker.stats.clear();
+  while (getline(in, line)) {
+    size_t eq = line.find('=');
+    if (eq == string::npos || eq == 0) {
+      JWARNING(false) (line).Text("Ignoring malformed worker statistic");
+      continue;
+    }
+    worker.stats[line.substr(0, eq)] = strtod(line.c_str() + eq + 1, NULL);
+  }
+}
+
+void
+CoordinatorMetrics::removeWorker(const CoordClient *client)
+{
+  string worker = workerId(client);
+
+  _arrivals.erase(worker);
+  _hosts.erase(worker);
+  _images.erase(worker);
+  _workerStats.erase(worker);
+  for (map<string, map<string, double> >::iterator it = _lastArrivalLag.begin();
+       it != _lastArrivalLag.end();
+       ++it) {
+    it->second.erase(worker);
+  }
+}
+
+double
+CoordinatorMetrics::currentBarrierElapsed() const
+{
+  return now() - _barrierStart;
+}
+
+string
+CoordinatorMetrics::prometheusText(size_t numPeers, uint32_t generation) const
+{
+  ostringstream o;
+
+  printHeader(o, "dmtcp_peers", "gauge",
+              "Number of worker processes connected to the coordinator.");
+  o << "dmtcp_peers " << numPeers << "\n";
+
+  printHeader(o, "dmtcp_computation_generation", "gauge",
+              "Checkpoint generation of the current computation.");
+  o << "dmtcp_computation_generation " << generation << "\n";
+
+  printHeader(o, "dmtcp_phase_duration_seconds", "histogram",
+              "Duration of checkpoint and restart phases.");
+  for (map<string, Histogram>::const_iterator it = _phaseDuration.begin();
+       it != _phaseDuration.end();
+       ++it) {
+    it->second.print(o, "dmtcp_phase_duration_seconds",
+                     "phase=\"" + labelValue(it->first) + "\"");
+  }
+
+  printHeader(o, "dmtcp_phase_last_duration_seconds", "gauge",
+              "Duration of the most recent checkpoint and restart phases.");
+  for (map<string, double>::const_iterator it = _lastPhaseDuration.begin();
+       it != _lastPhaseDuration.end();
+       ++it) {
+    o << "dmtcp_phase_last_duration_seconds{phase=\""
+      << labelValue(it->first) << "\"} " << it->second << "\n";
+  }
+
+  printHeader(o, "dmtcp_barrier_latency_seconds", "histogram",
+              "Time from the start of a barrier until its release.");
+  for (map<string, Histogram>::const_iterator it = _barrierLatency.begin();
+       it != _barrierLatency.end();
+       ++it) {
+    it->second.print(o, "dmtcp_barrier_latency_seconds",
+                     "barrier=\"" + labelValue(it->first) + "\"");
+  }
+
+  printHeader(o, "dmtcp_barrier_arrival_lag_seconds", "histogram",
+              "Time from the start of a barrier until a worker arrives.");
+  for (map<string, Histogram>::const_iterator it = _barrierArrivalLag.begin();
+       it != _barrierArrivalLag.end();
+       ++it) {
+    it->second.print(o, "dmtcp_barrier_arrival_lag_seconds",
+                     "barrier=\"" + labelValue(it->first) + "\"");
+  }
+
+  printHeader(o, "dmtcp_barrier_worker_arrival_lag_seconds", "gauge",
+              "Arrival lag of each worker at the most recent barrier.");
+  for (map<string, map<string, double> >::const_iterator
+       it = _lastArrivalLag.begin(); it != _lastArrivalLag.end(); ++it) {
+    for (map<string, double>::const_iterator w = it->second.begin();
+         w != it->second.end();
+         ++w) {
+      o << "dmtcp_barrier_worker_arrival_lag_seconds{barrier=\""
+        << labelValue(it->first) << "\",worker=\"" << labelValue(w->first)
+        << "\"} " << w->second << "\n";
+    }
+  }
+
+  printHeader(o, "dmtcp_barrier_slowest_worker_seconds", "gauge",
+              "Arrival lag of the last worker to reach each barrier.");
+  for (map<string, SlowestWorker>::const_iterator it = _slowestWorker.begin();
+       it != _slowestWorker.end();
+       ++it) {
+    o << "dmtcp_barrier_slowest_worker_seconds{barrier=\""
+      << labelValue(it->first)
+      << "\",worker=\"" << labelValue(it->second.worker)
+      << "\",host=\"" << labelValue(it->second.host)
+      << "\"} " << it->second.lag << "\n";
+  }
+
+  printHeader(o, "dmtcp_barrier_stragglers_total", "counter",
+              "Number of workers flagged as stragglers at each barrier.");
+  for (map<string, uint64_t>::const_iterator it = _numStragglers.begin();
+       it != _numStragglers.end();
+       ++it) {
+    o << "dmtcp_barrier_stragglers_total{barrier=\""
+      << labelValue(it->first) << "\"} " << it->second << "\n";
+  }
+
+  printHeader(o, "dmtcp_ckpt_image_bytes", "gauge",
+              "Size of the last checkpoint image written by each worker.");
+  for (map<string, WorkerImage>::const_iterator it = _images.begin();
+       it != _images.end();
+       ++it) {
+    o << "dmtcp_ckpt_image_bytes{worker=\"" << labelValue(it->first)
+      << "\",host=\"" << labelValue(it->second.host) << "\"} "
+      << it->second.imageSize << "\n";
+  }
+
+  printHeader(o, "dmtcp_ckpt_image_raw_bytes", "gauge",
+              "Uncompressed size of the last checkpoint image of each worker.");
+  for (map<string, WorkerImage>::const_iterator it = _images.begin();
+       it != _images.end();
+       ++it) {
+    o << "dmtcp_ckpt_image_raw_bytes{worker=\"" << labelValue(it->first)
+      << "\",host=\"" << labelValue(it->second.host) << "\"} "
+      << it->second.rawImageSize << "\n";
+  }
+
+  printHeader(o, "dmtcp_ckpt_compression_ratio", "gauge",
+              "Uncompressed over on-disk size of the last checkpoint image.");
+  for (map<string, WorkerImage>::const_iterator it = _images.begin();
+       it != _images.end();
+       ++it) {
+    if (it->second.imageSize > 0 && it->second.rawImageSize > 0) {
+      o << "dmtcp_ckpt_compression_ratio{worker=\"" << labelValue(it->first)
+        << "\",host=\"" << labelValue(it->second.host) << "\"} "
+        << (double)it->second.rawImageSize / it->second.imageSize << "\n";
+    }
+  }
+
+  printHeader(o, "dmtcp_worker_stat", "gauge",
+              "Statistics reported by each worker for its last checkpoint or "
+              "restart.");
+  for (map<string, WorkerStats>::const_iterator it = _workerStats.begin();
+       it != _workerStats.end();
+       ++it) {
+    for (map<string, double>::const_iterator s = it->second.stats.begin();
+         s != it->second.stats.end();
+         ++s) {
+      o << "dmtcp_worker_stat{worker=\"" << labelValue(it->first)
+        << "\",host=\"" << labelValue(it->second.host)
+        << "\",name=\"" << labelValue(s->first) << "\"} "
+        << s->second << "\n";
+    }
+  }
+
+  return o.str();
+}
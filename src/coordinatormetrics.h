@@ -0,0 +1,140 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2013 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#ifndef COORDINATORMETRICS_H
+#define COORDINATORMETRICS_H
+
+#include "dmtcpalloc.h"
+
+namespace dmtcp
+{
+class CoordClient;
+
+/*
+ * Checkpoint and restart timings collected by the coordinator, exported in
+ * the Prometheus text format (see dmtcp_coordinator --metrics-port).
+ *
+ * A phase (checkpoint or restart) is a sequence of barriers.  For each
+ * barrier, the arrival lag of a worker is the time between the release of the
+ * previous barrier (or the start of the phase) and the worker's DMT_BARRIER
+ * message.  The barrier latency is the lag of the last worker to arrive.
+ *
+ * A worker is a straggler at a barrier if its arrival lag exceeds
+ * STRAGGLER_FACTOR times the median lag of all workers by at least
+ * STRAGGLER_MIN_EXCESS seconds.  At least STRAGGLER_MIN_WORKERS workers are
+ * needed for the median to be meaningful.
+ */
+class CoordinatorMetrics
+{
+  public:
+    class Histogram
+    {
+      public:
+        Histogram();
+        void observe(double value);
+        void print(ostringstream &o,
+                   const string &name,
+                   const string &labels) const;
+
+      private:
+        vector<uint64_t>_buckets;
+        uint64_t _count;
+        double _sum;
+    };
+
+    static const double STRAGGLER_FACTOR;
+    static const double STRAGGLER_MIN_EXCESS;
+    static const size_t STRAGGLER_MIN_WORKERS;
+
+    CoordinatorMetrics();
+
+    void startPhase(const string &phase);
+    void endPhase(const string &phase);
+    bool inPhase() const { return !_phase.empty(); }
+
+    void barrierArrived(const CoordClient *client, const string &barrier);
+
+    // Returns the stragglers (worker -> arrival lag) of the released barrier.
+    map<string, double> barrierReleased(const string &barrier);
+
+    void ckptImageWritten(const CoordClient *client,
+                          uint64_t imageSize,
+                          uint64_t rawImageSize);
+    // Replaces the statistics of a worker with those of its last checkpoint
+    // or restart, given as "name=value" lines.
+    void workerStats(const CoordClient *client, const string &stats);
+    void removeWorker(const CoordClient *client);
+
+    // Time (in seconds) since the start of the current barrier.
+    double currentBarrierElapsed() const;
+
+    // Arrival lags (in seconds) of the workers at the current barrier.
+    const map<string, double> &currentBarrierArrivals() const
+    {
+      return _arrivals;
+    }
+
+    string prometheusText(size_t numPeers, uint32_t generation) const;
+
+    static string workerId(const CoordClient *client);
+    static double now();
+
+  private:
+    map<string, double> findStragglers() const;
+
+    struct SlowestWorker {
+      string worker;
+      string host;
+      double lag;
+    };
+
+    struct WorkerImage {
+      string host;
+      uint64_t imageSize;
+      uint64_t rawImageSize;
+    };
+
+    string _phase;
+    double _phaseStart;
+    double _barrierStart;
+
+    map<string, double>_arrivals;
+    map<string, string>_hosts;
+
+    map<string, Histogram>_barrierLatency;
+    map<string, Histogram>_barrierArrivalLag;
+    map<string, SlowestWorker>_slowestWorker;
+    map<string, map<string, double> >_lastArrivalLag;
+    map<string, uint64_t>_numStragglers;
+
+    map<string, Histogram>_phaseDuration;
+    map<string, double>_lastPhaseDuration;
+
+    struct WorkerStats {
+      string host;
+      map<string, double> stats;
+    };
+
+    map<string, WorkerImage>_images;
+    map<string, WorkerStats>_workerStats;
+};
+}
+#endif // ifndef COORDINATORMETRICS_H
@@ -70,6 +70,7 @@
 #include <sys/prctl.h>
 #include <time.h>
 #include <unistd.h>
+#include <math.h>
 #include <algorithm>
 #include <iomanip>
 #include "dmtcp_coordinator.h"
@@ -78,6 +79,8 @@
 #include "../jalib/jfilesystem.h"
 #include "../jalib/jtimer.h"
 #include "constants.h"
+#include "coordinatorjournal.h"
+#include "coordinatormetrics.h"
 #include "dmtcpmessagetypes.h"
 #include "lookup_service.h"
 #include "protectedfds.h"
@@ -138,6 +141,34 @@ static const char *theUsage =
   "  -i, --interval (environment variable DMTCP_CHECKPOINT_INTERVAL):\n"
   "      Time in seconds between automatic checkpoints\n"
   "      (default: 0, disabled)\n"
+  "  --mtbf seconds\n"
+  "      Estimated mean time between failures of the computation.  Enables\n"
+  "      an adaptive checkpoint interval, recomputed after every checkpoint\n"
+  "      from the measured checkpoint cost (Young/Daly formula).  Without\n"
+  "      --interval, the first checkpoint is taken after MTBF/10 seconds.\n"
+  "  --ckpt-write-limit N\n"
+  "      Allow at most N processes to write their checkpoint images at the\n"
+  "      same time; the largest images are written first\n"
+  "      (default: 0, no limit).  Processes using forked checkpointing\n"
+  "      (DMTCP_FORKED_CHECKPOINT) are not limited.\n"
+  "  --ckpt-write-limit-per-host N\n"
+  "      Allow at most N processes per host to write their checkpoint images\n"
+  "      at the same time (default: 0, no limit)\n"
+  "  --barrier-timeout seconds\n"
+  "      If a checkpoint or restart barrier is not reached by all processes\n"
+  "      within <seconds>, report the missing processes and, for processes\n"
+  "      on the coordinator host, the state of their threads\n"
+  "      (default: 0, disabled)\n"
+  "  --journal FILE\n"
+  "      Record the state of the computation in FILE.  If the coordinator\n"
+  "      dies, a new coordinator started with the same FILE (and port)\n"
+  "      resumes the computation; the processes reconnect to it if they were\n"
+  "      launched with --coord-reconnect-timeout (default: disabled)\n"
+  "  --metrics-port PORT\n"
+  "      Serve checkpoint/restart metrics (barrier latencies, image sizes,\n"
+  "      phase timings, per-worker statistics) in the Prometheus text\n"
+  "      format over HTTP on the loopback interface, at 127.0.0.1:PORT\n"
+  "      (default: disabled)\n"
   "  --coord-logfile PATH (environment variable DMTCP_COORD_LOG_FILENAME\n"
   "              Coordinator will dump its logs to the given file\n"
   "  -q, --quiet \n"
@@ -166,6 +197,12 @@ static int blockUntilDoneRemote = -1;
 static time_t timeout = 0; // used with --timeout
 static time_t start_time = 0; // used with --timeout
 static unsigned int staleTimeout = 0; // used with --stale-timeout
+static size_t ckptWriteLimit = 0; // used with --ckpt-write-limit
+static size_t ckptWriteLimitPerHost = 0; // --ckpt-write-limit-per-host
+static int metricsPort = -1; // used with --metrics-port
+static uint32_t barrierTimeout = 0; // used with --barrier-timeout
+static bool barrierTimeoutReported = false;
+static string journalFile; // used with --journal
 
 static DmtcpCoordinator prog;
 
@@ -199,6 +236,15 @@ static uint32_t theDefaultCheckpointInterval = 0; /* Reset to this on new comp.
                                                      */
 static bool timerExpired = false;
 
+/* If --mtbf is given, theCheckpointInterval is recomputed after every
+ * checkpoint from the measured checkpoint cost (see
+ * updateAdaptiveCheckpointInterval()).
+ */
+static uint32_t theMtbf = 0; /* Mean time between failures, in seconds */
+static double theAvgCkptCost = 0.0; /* Smoothed checkpoint cost, in seconds */
+static uint64_t theCkptBytesWritten = 0; /* Total for last generation */
+static uint64_t ckptStartTimeNs = 0;
+
 static void resetCkptTimer();
 
 const int STDIN_FD = fileno(stdin);
@@ -217,6 +263,7 @@ static time_t curTimeStamp = -1;
 static time_t ckptTimeStamp = -1;
 
 static LookupService lookupService;
+static CoordinatorJournal journal;
 static bool writeKvData = false;
 
 static string coordHostname;
@@ -229,6 +276,26 @@ static string ckptDir;
 struct epoll_event events[MAX_EVENTS];
 int epollFd;
 static jalib::JSocket *listenSock = NULL;
+static jalib::JSocket *metricsSock = NULL;
+static CoordinatorMetrics metrics;
+
+namespace dmtcp
+{
+// A scraper connected to the metrics endpoint.  Its request is read and the
+// reply written only as epoll reports the socket ready, so a slow scraper
+// never stalls the barriers.
+struct MetricsClient {
+  int fd;
+  string request;
+  string reply;
+  size_t written;
+};
+}
+
+static set<MetricsClient *> metricsClients;
+
+// Scrape requests larger than this are answered without reading the rest.
+static const size_t MaxMetricsRequest = 8192;
 
 static void removeStaleSharedAreaFile();
 static void preExitCleanup();
@@ -245,7 +312,9 @@ CoordClient::CoordClient(const jalib::JSocket &sock,
                          DmtcpMessage &hello_remote,
                          int isNSWorker)
   : _sock(sock),
-    _barrier("")
+    _barrier(""),
+    _ckptImageSize(0),
+    _hasCkptWriteToken(false)
 {
   _isNSWorker = isNSWorker;
   _realPid = hello_remote.realPid;
@@ -268,27 +337,88 @@ CoordClient::readProcessInfo(DmtcpMessage &msg)
   }
 }
 
+bool
+DmtcpCoordinator::isVirtualPidInUse(pid_t pid) const
+{
+  return _virtualPidToClientMap.find(pid) != _virtualPidToClientMap.end() ||
+         _leasedVirtualPids.find(pid) != _leasedVirtualPids.end();
+}
+
 pid_t
 DmtcpCoordinator::getNewVirtualPid()
 {
   pid_t pid = -1;
 
-  JASSERT(_virtualPidToClientMap.size() < MAX_VIRTUAL_PID / 1000)
+  JASSERT(_virtualPidToClientMap.size() + _leasedVirtualPids.size() <
+          MAX_VIRTUAL_PID / VIRTUAL_PID_STRIDE)
   .Text("Exceeded maximum number of processes allowed");
   while (1) {
     pid = _nextVirtualPid;
-    _nextVirtualPid += 1000;
+    _nextVirtualPid += VIRTUAL_PID_STRIDE;
     if (_nextVirtualPid > MAX_VIRTUAL_PID) {
       _nextVirtualPid = INITIAL_VIRTUAL_PID;
     }
-    if (_virtualPidToClientMap.find(pid) == _virtualPidToClientMap.end()) {
+    if (!isVirtualPidInUse(pid)) {
       break;
     }
   }
   JASSERT(pid != -1).Text("Not Reachable");
+  journal.nextVirtualPid(_nextVirtualPid);
   return pid;
 }
 
+/*
+ * Leases a run of consecutive virtual pids to 'client', which assigns them to
+ * its children without asking the coordinator.  The pids stay reserved until
+ * a child connects with one of them.  A child may connect after its parent
+ * has disconnected, so the lease outlives the client; the pids that were
+ * never claimed are only reused once the computation is reset.
+ */
+void
+DmtcpCoordinator::leaseVirtualPids(CoordClient *client, DmtcpMessage *msg)
+{
+  msg->leasedPidBase = -1;
+  msg->numLeasedPids = 0;
+
+  if (_virtualPidToClientMap.size() + _leasedVirtualPids.size() +
+      VIRTUAL_PID_LEASE_SIZE >= MAX_VIRTUAL_PID / VIRTUAL_PID_STRIDE) {
+    return;
+  }
+
+  pid_t base = getNewVirtualPid();
+  uint32_t n = 1;
+  _leasedVirtualPids[base] = client;
+  while (n < VIRTUAL_PID_LEASE_SIZE &&
+         _nextVirtualPid == base + (pid_t)n * VIRTUAL_PID_STRIDE &&
+         !isVirtualPidInUse(_nextVirtualPid)) {
+    _leasedVirtualPids[_nextVirtualPid] = client;
+    _nextVirtualPid += VIRTUAL_PID_STRIDE;
+    n++;
+  }
+  if (_nextVirtualPid > MAX_VIRTUAL_PID) {
+    _nextVirtualPid = INITIAL_VIRTUAL_PID;
+  }
+  if (n > 1) {
+    journal.nextVirtualPid(_nextVirtualPid);
+  }
+
+  msg->leasedPidBase = base;
+  msg->numLeasedPids = n;
+}
+
+void
+DmtcpCoordinator::releaseVirtualPids(CoordClient *client)
+{
+  map<pid_t, CoordClient *>::iterator i = _leasedVirtualPids.begin();
+
+  // Keep the pids reserved for children that have yet to connect.
+  for (; i != _leasedVirtualPids.end(); ++i) {
+    if (i->second == client) {
+      i->second = NULL;
+    }
+  }
+}
+
 static string replyData = "";
 
 void
@@ -453,6 +583,11 @@ DmtcpCoordinator::printStatus(size_t numPeers, bool isRunning)
     o << theCheckpointInterval << std::endl;
   }
 
+  if (theMtbf > 0) {
+    o << "Adaptive interval: MTBF " << theMtbf << " s, checkpoint cost "
+      << theAvgCkptCost << " s" << std::endl;
+  }
+
   o << "Exit on last client: " << exitOnLast << std::endl
     << "Kill after checkpoint: " << killAfterCkpt << std::endl
 
@@ -528,6 +663,14 @@ DmtcpCoordinator::releaseBarrier(const string &barrier)
     recordEvent("Barrier-" + barrier);
     JTRACE("Releasing barrier") (barrier);
 
+    map<string, double> stragglers = metrics.barrierReleased(barrier);
+    for (map<string, double>::iterator it = stragglers.begin();
+         it != stragglers.end();
+         ++it) {
+      JNOTE("Straggler at barrier") (barrier) (it->first) (it->second);
+    }
+    barrierTimeoutReported = false;
+
     prevBarrier = currentBarrier;
     currentBarrier.clear();
     workersAtCurrentBarrier = 0;
@@ -614,6 +757,7 @@ DmtcpCoordinator::recordCkptFilename(CoordClient *client, const char *extraData)
       .Text("Shell command not supported. Report this to DMTCP community.");
   }
   _numRestartFilenames++;
+  theCkptBytesWritten += client->ckptImageSize();
 
   if (_numRestartFilenames == _numCkptWorkers) {
     const string restartScriptPath =
@@ -630,7 +774,11 @@ DmtcpCoordinator::recordCkptFilename(CoordClient *client, const char *extraData)
     JNOTE("Checkpoint complete. Wrote restart script") (restartScriptPath);
 
     JTIMER_STOP(checkpoint);
+    updateAdaptiveCheckpointInterval(
+      (getCurrTimestamp() - ckptStartTimeNs) / 1e9);
     recordEvent("Ckpt-Complete");
+    metrics.endPhase("checkpoint");
+    journal.rewrite(journalState());
     serializeKVDB();
 
     if (blockUntilDone) {
@@ -695,6 +843,7 @@ DmtcpCoordinator::onData(CoordClient *client)
       if (s.minimumStateUnanimous && s.minimumState == WorkerState::RUNNING) {
         JTIMER_STOP(restart);
         recordEvent("Restart-Complete");
+        metrics.endPhase("restart");
         serializeKVDB();
       }
     }
@@ -711,18 +860,43 @@ DmtcpCoordinator::onData(CoordClient *client)
     // Warn if we have two consecutive barriers of the same name.
     JWARNING(barrier != client->barrier()) (barrier) (client->barrier());
     client->setBarrier(barrier);
+    metrics.barrierArrived(client, barrier);
     processBarrier(barrier);
     break;
   }
 
+  case DMT_CKPT_WRITE_TOKEN_REQUEST:
+    requestCkptWriteToken(client, msg.ckptImageSize);
+    break;
+
+  case DMT_CKPT_WRITE_TOKEN_RELEASE:
+    releaseCkptWriteToken(client);
+    break;
+
+  case DMT_LEASE_VIRTUAL_PIDS:
+  {
+    DmtcpMessage reply(DMT_LEASED_VIRTUAL_PIDS);
+    leaseVirtualPids(client, &reply);
+    client->sock() << reply;
+    break;
+  }
+
   case DMT_UNIQUE_CKPT_FILENAME:
     uniqueCkptFilenames = true;
 
   // Fall though
   case DMT_CKPT_FILENAME:
+    client->ckptImageSize(msg.ckptImageSize);
+    metrics.ckptImageWritten(client, msg.ckptImageSize, msg.ckptRawImageSize);
     recordCkptFilename(client, extraData);
     break;
 
+  case DMT_WORKER_STATS:
+    JASSERT(extraData != 0)
+    .Text("extra data expected with DMT_WORKER_STATS message");
+    metrics.workerStats(client, extraData);
+    break;
+
   case DMT_GET_CKPT_DIR:
   {
     DmtcpMessage reply(DMT_GET_CKPT_DIR_RESULT);
@@ -789,6 +963,22 @@ DmtcpCoordinator::onData(CoordClient *client)
   {
     JTRACE("received DMT_KVDB_REQUEST msg") (client->identity());
     lookupService.processRequest(client->sock(), msg, extraData);
+    if (journal.isOpen() && msg.kvdbRequest != kvdb::KVDBRequest::GET &&
+        msg.kvdbRequest != kvdb::KVDBRequest::MGET) {
+      vector<string> keys;
+      if (msg.kvdbRequest == kvdb::KVDBRequest::MSET) {
+        LookupService::unpack(extraData, msg.keyLen, &keys);
+      } else {
+        keys.push_back(extraData);
+      }
+      for (size_t i = 0; i < keys.size(); i++) {
+        string val;
+        if (lookupService.get(msg.kvdbId, keys[i], &val) ==
+            kvdb::KVDBResponse::SUCCESS) {
+          journal.kvdbSet(msg.kvdbId, keys[i], val);
+        }
+      }
+    }
     break;
   }
 
@@ -841,12 +1031,18 @@ DmtcpCoordinator::onDisconnect(CoordClient *client)
   client->sock().close();
   JNOTE("client disconnected") (client->identity()) (client->progname());
   _virtualPidToClientMap.erase(client->virtualPid());
+  releaseVirtualPids(client);
+  metrics.removeWorker(client);
+
+  // Hand over the write token (if any) to the next waiting worker.
+  releaseCkptWriteToken(client);
 
   ComputationStatus s = getStatus();
   if (clients.size() == 0) {
     setStaleTimeout();
   }
   if (s.numPeers < 1) {
+    journal.clear();
     if (exitOnLast) {
       JNOTE("last client exited, shutting down..");
       handleUserCommand('q');
@@ -888,6 +1084,7 @@ DmtcpCoordinator::initializeComputation()
   killInProgress = false;
 
   // _nextVirtualPid = INITIAL_VIRTUAL_PID;
+  _leasedVirtualPids.clear();
 
   // drop current computation group to 0
   compId = UniquePid(0, 0, 0);
@@ -953,7 +1150,7 @@ DmtcpCoordinator::onConnect()
 
   // If no client is connected to Coordinator, then there can be only zero data
   // sockets OR there can be one data socket and that should be STDIN.
-  if (clients.size() == 0) {
+  if (clients.size() == 0 && hello_remote.type != DMT_RECONNECT_WORKER) {
     initializeComputation();
   }
 
@@ -975,13 +1172,37 @@ DmtcpCoordinator::onConnect()
     // Comping from dmtcp_launch or fork(), ssh(), etc.
     JASSERT(hello_remote.state == WorkerState::RUNNING ||
             hello_remote.state == WorkerState::UNKNOWN);
-    JASSERT(hello_remote.virtualPid == -1);
-    client->virtualPid(getNewVirtualPid());
+    if (hello_remote.virtualPid == -1) {
+      client->virtualPid(getNewVirtualPid());
+    } else {
+      // The parent assigned a virtual pid from its lease.  The child has
+      // already taken that pid, so it can't be given another one.
+      pid_t pid = hello_remote.virtualPid;
+      if (_virtualPidToClientMap.find(pid) != _virtualPidToClientMap.end()) {
+        JWARNING(false) (pid) (hello_remote.from)
+          .Text("Leased virtual pid is already in use.  Rejecting.");
+        DmtcpMessage hello_local(DMT_REJECT_VIRTUAL_PID_IN_USE);
+        hello_local.virtualPid = pid;
+        remote << hello_local;
+        remote.close();
+        delete client;
+        return;
+      }
+      _leasedVirtualPids.erase(pid);
+      client->virtualPid(pid);
+    }
     if (!validateNewWorkerProcess(hello_remote, remote, client,
                                   &remoteAddr, remoteLen)) {
       return;
     }
     _virtualPidToClientMap[client->virtualPid()] = client;
+  } else if (hello_remote.type == DMT_RECONNECT_WORKER) {
+    // A running process that lost its connection to a previous coordinator.
+    if (!validateReconnectingWorkerProcess(hello_remote, remote, client,
+                                           &remoteAddr, remoteLen)) {
+      return;
+    }
+    _virtualPidToClientMap[client->virtualPid()] = client;
   } else {
     JASSERT(false) (hello_remote.type)
     .Text("Connect request from Unknown Remote Process Type");
@@ -1056,6 +1277,7 @@ DmtcpCoordinator::validateRestartingWorkerProcess(
 
   if (compId == UniquePid(0, 0, 0)) {
     lookupService.reset();
+    journal.kvdbReset();
     recordEvent("Restarting-Computation");
     JASSERT(minimumState() == WorkerState::UNKNOWN) (minimumState())
     .Text("Coordinator should be idle at this moment");
@@ -1066,8 +1288,11 @@ DmtcpCoordinator::validateRestartingWorkerProcess(
     curTimeStamp = getCurrTimestamp();
     JNOTE("FIRST restart connection. Set numRestartPeers. Generate timestamp")
       (numRestartPeers) (curTimeStamp) (compId);
+    journal.computation(compId, curTimeStamp);
     JTIMER_START(restart);
     recordEvent("Restart-Start");
+    metrics.startPhase("restart");
+    barrierTimeoutReported = false;
   } else if (minimumState() != WorkerState::RESTARTING) {
     JNOTE("Computation not in RESTARTING state."
           "  Reject incoming computation process requesting restart.")
@@ -1160,6 +1385,19 @@ DmtcpCoordinator::validateNewWorkerProcess(
   JASSERT(hello_remote.state == WorkerState::RUNNING ||
           hello_remote.state == WorkerState::UNKNOWN) (hello_remote.state);
 
+  // A child forked by a worker that runs user code again: the checkpoint or
+  // restart is over, even if the parent's DMT_WORKER_RESUMING, sent on its
+  // own socket, hasn't been read yet.
+  bool forkedByRunningWorker = false;
+  if (hello_remote.state == WorkerState::RUNNING) {
+    for (size_t i = 0; i < clients.size(); i++) {
+      if (clients[i]->identity() == hello_remote.from) {
+        forkedByRunningWorker = true;
+        break;
+      }
+    }
+  }
+
   if (workersRunningAndSuspendMsgSent == true) {
     // Handshake
     hello_local.compGroup = compId;
@@ -1167,7 +1405,8 @@ DmtcpCoordinator::validateNewWorkerProcess(
 
     ResendDoCheckpointMsgToWorker(client);
   } else if (s.numPeers > 0 && s.minimumState != WorkerState::RUNNING &&
-             s.minimumState != WorkerState::UNKNOWN) {
+             s.minimumState != WorkerState::UNKNOWN &&
+             !forkedByRunningWorker) {
     // If some of the processes are not in RUNNING state
     JNOTE("Current computation not in RUNNING state."
           "  Refusing to accept new connections.")
@@ -1200,6 +1439,7 @@ DmtcpCoordinator::validateNewWorkerProcess(
       numRestartPeers = -1;
       JTRACE("First process connected.  Creating new computation group.")
         (compId);
+      journal.computation(compId, curTimeStamp);
       recordEvent("Initializing-Computation");
     } else {
       JTRACE("New process connected")
@@ -1217,6 +1457,126 @@ DmtcpCoordinator::validateNewWorkerProcess(
   return true;
 }
 
+bool
+DmtcpCoordinator::validateReconnectingWorkerProcess(
+  DmtcpMessage &hello_remote,
+  jalib::JSocket &remote,
+  CoordClient *client,
+  const struct sockaddr_storage *remoteAddr,
+  socklen_t remoteLen)
+{
+  const struct sockaddr_in *sin = (const struct sockaddr_in *)remoteAddr;
+  string remoteIP = inet_ntoa(sin->sin_addr);
+  DmtcpMessage hello_local(DMT_ACCEPT);
+
+  JASSERT(hello_remote.state == WorkerState::RUNNING) (hello_remote.state);
+
+  if (compId == UniquePid(0, 0, 0) && clients.size() == 0) {
+    // No journal; adopt the computation of the first process to reconnect.
+    compId = hello_remote.compGroup;
+    curTimeStamp = getCurrTimestamp();
+    numRestartPeers = -1;
+    journal.computation(compId, curTimeStamp);
+    recordEvent("Reconnecting-Computation");
+  } else if (hello_remote.compGroup != compId) {
+    JNOTE("Reconnecting process not part of current computation. Rejecting.")
+      (compId) (hello_remote.compGroup);
+    hello_local.type = DMT_REJECT_WRONG_COMP;
+    remote << hello_local;
+    remote.close();
+    return false;
+  }
+
+  JNOTE("Process reconnected to the computation")
+    (hello_remote.from) (hello_remote.compGroup);
+  client->virtualPid(hello_remote.from.pid());
+  hello_local.virtualPid = client->virtualPid();
+  hello_local.compGroup = compId;
+  hello_local.coordTimeStamp = curTimeStamp;
+  if (Util::strStartsWith(remoteIP.c_str(), "127.")) {
+    memcpy(&hello_local.ipAddr, &localhostIPAddr, sizeof localhostIPAddr);
+  } else {
+    memcpy(&hello_local.ipAddr, &sin->sin_addr, sizeof localhostIPAddr);
+  }
+  remote << hello_local;
+
+  // A checkpoint started before this process reconnected; let it join.
+  if (workersRunningAndSuspendMsgSent) {
+    ResendDoCheckpointMsgToWorker(client);
+  }
+  return true;
+}
+
+CoordinatorJournal::State
+DmtcpCoordinator::journalState() const
+{
+  CoordinatorJournal::State state;
+
+  state.compId = compId;
+  state.curTimeStamp = curTimeStamp;
+  state.ckptTimeStamp = ckptTimeStamp;
+  state.nextVirtualPid = _nextVirtualPid;
+  state.ckptInterval = theCheckpointInterval;
+  state.port = thePort;
+  state.kvdb = lookupService.maps();
+
+  const map<string, vector<string> > *filenames[] =
+  { &_restartFilenames, &_rshCmdFileNames, &_sshCmdFileNames };
+  const char *shells[] = { "", "rsh", "ssh" };
+  for (size_t i = 0; i < 3; i++) {
+    map<string, vector<string> >::const_iterator it;
+    for (it = filenames[i]->begin(); it != filenames[i]->end(); ++it) {
+      for (size_t j = 0; j < it->second.size(); j++) {
+        CoordinatorJournal::CkptFile file = {
+          it->first, shells[i], it->second[j]
+        };
+        state.ckptFiles.push_back(file);
+      }
+    }
+  }
+  return state;
+}
+
+/* Resume the computation described by the journal of a previous coordinator.
+ * The worker processes are still running and reconnect on their own.
+ */
+void
+DmtcpCoordinator::recoverFromJournal(const CoordinatorJournal::State &state)
+{
+  compId = state.compId;
+  curTimeStamp = state.curTimeStamp;
+  ckptTimeStamp = state.ckptTimeStamp;
+  if (state.nextVirtualPid != 0) {
+    _nextVirtualPid = state.nextVirtualPid;
+  }
+  if (state.ckptInterval != 0) {
+    theCheckpointInterval = state.ckptInterval;
+  }
+
+  map<string, LookupService::KeyValueMap>::const_iterator db;
+  for (db = state.kvdb.begin(); db != state.kvdb.end(); ++db) {
+    LookupService::KeyValueMap::const_iterator kv;
+    for (kv = db->second.begin(); kv != db->second.end(); ++kv) {
+      lookupService.set(db->first, kv->first, kv->second);
+    }
+  }
+
+  for (size_t i = 0; i < state.ckptFiles.size(); i++) {
+    const CoordinatorJournal::CkptFile &file = state.ckptFiles[i];
+    if (file.shell.empty()) {
+      _restartFilenames[file.hostname].push_back(file.filename);
+    } else if (file.shell == "rsh") {
+      _rshCmdFileNames[file.hostname].push_back(file.filename);
+    } else {
+      _sshCmdFileNames[file.hostname].push_back(file.filename);
+    }
+  }
+
+  JNOTE("Recovered computation from journal")
+    (journalFile) (compId) (compId.computationGeneration())
+    (state.ckptFiles.size());
+}
+
 bool
 DmtcpCoordinator::startCheckpoint()
 {
@@ -1225,14 +1585,22 @@ DmtcpCoordinator::startCheckpoint()
       && !workersRunningAndSuspendMsgSent) {
     uniqueCkptFilenames = false;
     time(&ckptTimeStamp);
+    ckptStartTimeNs = getCurrTimestamp();
+    theCkptBytesWritten = 0;
     JTIMER_START(checkpoint);
     recordEvent("Ckpt-Start");
+    metrics.startPhase("checkpoint");
+    barrierTimeoutReported = false;
     _numRestartFilenames = 0;
     numRestartPeers = -1;
     _restartFilenames.clear();
     _rshCmdFileNames.clear();
     _sshCmdFileNames.clear();
+    _pendingCkptWriters.clear();
+    _numCkptWritersPerHost.clear();
+    _numCkptWriters = 0;
     compId.incrementGeneration();
+    journal.computation(compId, curTimeStamp);
     JNOTE("starting checkpoint; incrementing generation; suspending all nodes")
       (s.numPeers) (compId.computationGeneration());
 
@@ -1258,6 +1626,88 @@ DmtcpCoordinator::startCheckpoint()
   }
 }
 
+/*
+ * Checkpoint-write throttling.  If all workers write their images at once,
+ * they can overwhelm a shared filesystem.  With --ckpt-write-limit or
+ * --ckpt-write-limit-per-host, each worker asks for a write token after the
+ * PRECHECKPOINT event and returns it once its image has been written.  Tokens
+ * are handed out largest image first, so that the longest writes start early.
+ */
+void
+DmtcpCoordinator::requestCkptWriteToken(CoordClient *client,
+                                        uint64_t imageSize)
+{
+  JTRACE("checkpoint write token requested")
+    (client->identity()) (client->hostname()) (imageSize);
+  client->ckptImageSize(imageSize);
+  _pendingCkptWriters.push_back(client);
+  scheduleCkptWrites();
+}
+
+void
+DmtcpCoordinator::releaseCkptWriteToken(CoordClient *client)
+{
+  vector<CoordClient *>::iterator it =
+    std::find(_pendingCkptWriters.begin(), _pendingCkptWriters.end(), client);
+  if (it != _pendingCkptWriters.end()) {
+    _pendingCkptWriters.erase(it);
+  }
+
+  if (!client->hasCkptWriteToken()) {
+    return;
+  }
+
+  client->hasCkptWriteToken(false);
+  JASSERT(_numCkptWriters > 0);
+  _numCkptWriters--;
+  JASSERT(_numCkptWritersPerHost[client->hostname()] > 0);
+  _numCkptWritersPerHost[client->hostname()]--;
+  JTRACE("checkpoint write token released")
+    (client->identity()) (_numCkptWriters);
+
+  scheduleCkptWrites();
+}
+
+static bool
+largerCkptImageFirst(const CoordClient *a, const CoordClient *b)
+{
+  return a->ckptImageSize() > b->ckptImageSize();
+}
+
+void
+DmtcpCoordinator::scheduleCkptWrites()
+{
+  std::stable_sort(_pendingCkptWriters.begin(), _pendingCkptWriters.end(),
+                   largerCkptImageFirst);
+
+  vector<CoordClient *>::iterator it = _pendingCkptWriters.begin();
+  while (it != _pendingCkptWriters.end()) {
+    if (ckptWriteLimit > 0 && _numCkptWriters >= ckptWriteLimit) {
+      break;
+    }
+
+    CoordClient *client = *it;
+    size_t &hostWriters = _numCkptWritersPerHost[client->hostname()];
+    if (ckptWriteLimitPerHost > 0 && hostWriters >= ckptWriteLimitPerHost) {
+      // This host is saturated; a smaller image elsewhere may still proceed.
+      ++it;
+      continue;
+    }
+
+    it = _pendingCkptWriters.erase(it);
+    client->hasCkptWriteToken(true);
+    hostWriters++;
+    _numCkptWriters++;
+
+    JTRACE("granting checkpoint write token")
+      (client->identity()) (client->hostname()) (client->ckptImageSize())
+      (_numCkptWriters) (hostWriters);
+    DmtcpMessage msg(DMT_CKPT_WRITE_TOKEN_GRANTED);
+    msg.compGroup = compId;
+    client->sock() << msg;
+  }
+}
+
 void
 DmtcpCoordinator::broadcastMessage(DmtcpMessageType type,
                                    size_t extraBytes,
@@ -1271,6 +1721,7 @@ DmtcpCoordinator::broadcastMessage(DmtcpMessageType type,
   // From DMTCP coord viewpoint, we are killing peers after ckpt.
   // From DMTCP peer viewpoint, we will exit after ckpt.
   msg.exitAfterCkpt = killAfterCkpt || killAfterCkptOnce;
+  msg.throttleCkptWrites = ckptWriteLimit > 0 || ckptWriteLimitPerHost > 0;
   msg.extraBytes = extraBytes;
 
   if (msg.type == DMT_KILL_PEER && clients.size() > 0) {
@@ -1490,6 +1941,7 @@ DmtcpCoordinator::updateCheckpointInterval(uint32_t interval)
     } else { // Either we're changing the ckpt interval, or still a firstClient.
       int oldInterval = theCheckpointInterval;
       theCheckpointInterval = interval;
+      journal.ckptInterval(theCheckpointInterval);
       JNOTE("CheckpointInterval updated (for this computation only)")
         (oldInterval) (theCheckpointInterval);
       firstClient = false;
@@ -1498,6 +1950,49 @@ DmtcpCoordinator::updateCheckpointInterval(uint32_t interval)
   }
 }
 
+/*
+ * Adaptive checkpoint interval.  Given the checkpoint cost C and the mean
+ * time between failures M, Daly's first-order approximation of the optimal
+ * compute time between checkpoints is
+ *     T = sqrt(2 * C * M) - C     for C < M / 2,
+ *     T = M                       otherwise.
+ * (Young's formula is the same without the "- C" term.)  C is smoothed over
+ * generations since a single slow checkpoint shouldn't swing the interval.
+ */
+void
+DmtcpCoordinator::updateAdaptiveCheckpointInterval(double ckptCost)
+{
+  JTRACE("checkpoint cost") (ckptCost) (theCkptBytesWritten);
+  if (theMtbf == 0) {
+    return;
+  }
+
+  const double alpha = 0.5;
+  if (theAvgCkptCost == 0.0) {
+    theAvgCkptCost = ckptCost;
+  } else {
+    theAvgCkptCost = alpha * ckptCost + (1 - alpha) * theAvgCkptCost;
+  }
+
+  double interval;
+  if (theAvgCkptCost < theMtbf / 2.0) {
+    interval = sqrt(2 * theAvgCkptCost * theMtbf) - theAvgCkptCost;
+  } else {
+    interval = theMtbf;
+  }
+  uint32_t newInterval = std::max(1u, (uint32_t)(interval + 0.5));
+
+  JNOTE("Adapting checkpoint interval to measured checkpoint cost")
+    (ckptCost) (theAvgCkptCost) (theCkptBytesWritten) (theMtbf)
+    (theCheckpointInterval) (newInterval);
+
+  if (newInterval != theCheckpointInterval) {
+    theCheckpointInterval = newInterval;
+    journal.ckptInterval(theCheckpointInterval);
+    resetCkptTimer();
+  }
+}
+
 void
 DmtcpCoordinator::eventLoop(bool daemon)
 {
@@ -1511,6 +2006,13 @@ DmtcpCoordinator::eventLoop(bool daemon)
   JASSERT(epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSock->sockfd(), &ev) != -1)
     (JASSERT_ERRNO);
 
+  if (metricsSock != NULL) {
+    ev.events = EPOLLIN;
+    ev.data.ptr = metricsSock;
+    JASSERT(epoll_ctl(epollFd, EPOLL_CTL_ADD, metricsSock->sockfd(), &ev) != -1)
+      (JASSERT_ERRNO);
+  }
+
   if (!daemon &&
 
       // epoll_ctl below fails if STDIN is pointing to /dev/null.
@@ -1532,9 +2034,11 @@ DmtcpCoordinator::eventLoop(bool daemon)
     // has expired.
     int nfds;
     do {
-      nfds = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+      nfds = epoll_wait(epollFd, events, MAX_EVENTS, barrierWaitTimeout());
     } while (nfds < 0 && errno == EINTR && !timerExpired);
 
+    checkBarrierTimeout();
+
 
     // The ckpt timer has expired; it's time to checkpoint.
     //   NOTE:  We need minimumStateUnanimous and RUNNING, in case
@@ -1560,15 +2064,21 @@ DmtcpCoordinator::eventLoop(bool daemon)
           (events[n].events & EPOLLRDHUP) ||
 #endif // ifdef EPOLLRDHUP
           (events[n].events & EPOLLERR)) {
-        JASSERT(ptr != listenSock);
+        JASSERT(ptr != listenSock && (ptr != metricsSock || ptr == NULL));
         if (ptr == (void *)STDIN_FILENO) {
           JASSERT(epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, &ev) != -1)
             (JASSERT_ERRNO);
           close(STDIN_FD);
+        } else if (metricsClients.count((MetricsClient *)ptr) > 0) {
+          onMetricsData((MetricsClient *)ptr, events[n].events);
         } else {
           onDisconnect((CoordClient *)ptr);
         }
+      } else if (metricsClients.count((MetricsClient *)ptr) > 0) {
+        onMetricsData((MetricsClient *)ptr, events[n].events);
       } else if (events[n].events & EPOLLIN) {
+        // Stdin is tagged with NULL (STDIN_FILENO), which is also the value
+        // of metricsSock when --metrics-port is not given; test it first.
         if (ptr == (void *)listenSock) {
           onConnect();
         } else if (ptr == (void *)STDIN_FILENO) {
@@ -1583,6 +2093,8 @@ DmtcpCoordinator::eventLoop(bool daemon)
               (JASSERT_ERRNO);
             close(STDIN_FD);
           }
+        } else if (ptr == (void *)metricsSock) {
+          onMetricsRequest();
         } else {
           onData((CoordClient *)ptr);
         }
@@ -1591,6 +2103,210 @@ DmtcpCoordinator::eventLoop(bool daemon)
   }
 }
 
+/* Returns the epoll_wait() timeout (in ms) needed to notice that the current
+ * barrier has exceeded --barrier-timeout, or -1 if there is nothing to watch.
+ */
+int
+DmtcpCoordinator::barrierWaitTimeout()
+{
+  if (barrierTimeout == 0 || barrierTimeoutReported || !metrics.inPhase()) {
+    return -1;
+  }
+
+  double remaining = barrierTimeout - metrics.currentBarrierElapsed();
+  return remaining > 0 ? (int)(remaining * 1000) + 1 : 0;
+}
+
+static string
+readProcFile(const string &path)
+{
+  char buf[512];
+  int fd = open(path.c_str(), O_RDONLY);
+
+  if (fd == -1) {
+    return "";
+  }
+  ssize_t ret = Util::readAll(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  buf[ret > 0 ? ret : 0] = '\0';
+
+  string str = buf;
+  while (!str.empty() && str[str.length() - 1] == '\n') {
+    str.erase(str.length() - 1);
+  }
+  return str;
+}
+
+/* Log the scheduling state and wait channel of every thread of a local
+ * worker.  The checkpoint thread of a straggler is, by definition, not
+ * reading from the coordinator socket, so it can't be asked to report on
+ * itself; /proc is the only view we have of it.
+ */
+static void
+dumpThreadStates(pid_t pid)
+{
+  ostringstream taskDir;
+  taskDir << "/proc/" << pid << "/task";
+  if (!jalib::Filesystem::FileExists(taskDir.str())) {
+    return;
+  }
+
+  ostringstream o;
+  vector<string> tids = jalib::Filesystem::ListDirEntries(taskDir.str());
+  for (size_t i = 0; i < tids.size(); i++) {
+    if (tids[i] == "." || tids[i] == "..") {
+      continue;
+    }
+    string dir = taskDir.str() + "/" + tids[i];
+    string stat = readProcFile(dir + "/stat");
+    size_t pos = stat.rfind(')');
+    char state = (pos != string::npos && pos + 2 < stat.length())
+      ? stat[pos + 2] : '?';
+
+    o << "\n    " << tids[i] << " " << readProcFile(dir + "/comm")
+      << " state=" << state << " wchan=" << readProcFile(dir + "/wchan");
+  }
+  JNOTE("Threads of straggling process") (pid) (o.str());
+}
+
+/* Report the workers that have not yet reached the current barrier once it
+ * has been pending for longer than --barrier-timeout.  This is reported once
+ * per barrier; the barrier itself is still waited for.
+ */
+void
+DmtcpCoordinator::checkBarrierTimeout()
+{
+  if (barrierWaitTimeout() != 0) {
+    return;
+  }
+
+  barrierTimeoutReported = true;
+  string barrier = currentBarrier.empty() ? "(none)" : currentBarrier;
+  JWARNING(false) (barrier) (metrics.currentBarrierElapsed())
+    (workersAtCurrentBarrier) (getStatus().numPeers)
+  .Text("Barrier timeout; some processes have not reached the barrier");
+
+  for (size_t i = 0; i < clients.size(); i++) {
+    CoordClient *client = clients[i];
+    if (!currentBarrier.empty() && client->barrier() == currentBarrier) {
+      continue;
+    }
+    JNOTE("Process has not reached barrier")
+      (barrier) (client->identity()) (client->hostname())
+      (client->realPid()) (client->progname()) (client->state())
+      (client->barrier());
+    if (client->hostname() == coordHostname) {
+      dumpThreadStates(client->realPid());
+    }
+  }
+}
+
+/* Accept a scraper on the metrics endpoint.  The client socket is made
+ * non-blocking and handed to the event loop; see onMetricsData().
+ */
+void
+DmtcpCoordinator::onMetricsRequest()
+{
+  jalib::JSocket remote = metricsSock->accept();
+
+  if (!remote.isValid()) {
+    return;
+  }
+
+  int flags = fcntl(remote.sockfd(), F_GETFL);
+  if (flags == -1 ||
+      fcntl(remote.sockfd(), F_SETFL, flags | O_NONBLOCK) == -1) {
+    JTRACE("Failed to make metrics client non-blocking") (JASSERT_ERRNO);
+    remote.close();
+    return;
+  }
+
+  MetricsClient *client = new MetricsClient();
+  client->fd = remote.sockfd();
+  client->written = 0;
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = client;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, client->fd, &ev) == -1) {
+    JTRACE("Failed to add metrics client") (JASSERT_ERRNO);
+    remote.close();
+    delete client;
+    return;
+  }
+  metricsClients.insert(client);
+}
+
+/* Advance one scrape.  The request is read until its blank line (the request
+ * itself is ignored and every path returns the full metrics page); the reply
+ * is then written as the socket accepts it.  The client is dropped once the
+ * reply is sent or on any error.
+ */
+void
+DmtcpCoordinator::onMetricsData(MetricsClient *client, uint32_t events)
+{
+  bool done = (events & (EPOLLHUP | EPOLLERR)) != 0;
+
+  if (!done && client->reply.empty() && (events & EPOLLIN)) {
+    char buf[1024];
+    ssize_t ret;
+    while ((ret = read(client->fd, buf, sizeof(buf))) > 0) {
+      client->request.append(buf, ret);
+    }
+
+    bool complete = ret == 0 ||
+      client->request.find("\r\n\r\n") != string::npos ||
+      client->request.find("\n\n") != string::npos ||
+      client->request.length() >= MaxMetricsRequest;
+    if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      JTRACE("Failed to read metrics request") (JASSERT_ERRNO);
+      done = true;
+    } else if (complete) {
+      string body = metrics.prometheusText(getStatus().numPeers,
+                                           compId.computationGeneration());
+      ostringstream o;
+      o << "HTTP/1.0 200 OK\r\n"
+        << "Content-Type: text/plain; version=0.0.4\r\n"
+        << "Content-Length: " << body.length() << "\r\n"
+        << "\r\n"
+        << body;
+      client->reply = o.str();
+      client->request.clear();
+
+      struct epoll_event ev;
+      ev.events = EPOLLOUT;
+      ev.data.ptr = client;
+      if (epoll_ctl(epollFd, EPOLL_CTL_MOD, client->fd, &ev) == -1) {
+        JTRACE("Failed to poll metrics client") (JASSERT_ERRNO);
+        done = true;
+      }
+    }
+  } else if (!done && !client->reply.empty() && (events & EPOLLOUT)) {
+    while (client->written < client->reply.length()) {
+      ssize_t ret = write(client->fd, client->reply.data() + client->written,
+                          client->reply.length() - client->written);
+      if (ret < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          JTRACE("Failed to write metrics reply") (JASSERT_ERRNO);
+          done = true;
+        }
+        break;
+      }
+      client->written += ret;
+    }
+    if (client->written == client->reply.length()) {
+      done = true;
+    }
+  }
+
+  if (done) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    metricsClients.erase(client);
+    delete client;
+  }
+}
+
 void
 DmtcpCoordinator::addDataSocket(CoordClient *client)
 {
@@ -1730,6 +2446,24 @@ main(int argc, char **argv)
     } else if (argc > 1 && s == "--stale-timeout") {
       staleTimeout = atol(argv[1]);
       shift; shift;
+    } else if (argc > 1 && s == "--mtbf") {
+      theMtbf = jalib::StringToInt(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--ckpt-write-limit") {
+      ckptWriteLimit = jalib::StringToInt(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--ckpt-write-limit-per-host") {
+      ckptWriteLimitPerHost = jalib::StringToInt(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--barrier-timeout") {
+      barrierTimeout = jalib::StringToInt(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--journal") {
+      journalFile = argv[1];
+      shift; shift;
+    } else if (argc > 1 && s == "--metrics-port") {
+      metricsPort = jalib::StringToInt(argv[1]);
+      shift; shift;
     } else if (s == "--daemon") {
       daemon = true;
       shift;
@@ -1812,6 +2546,30 @@ main(int argc, char **argv)
     }
   }
 
+  // parse checkpoint interval; an interval recovered from the journal below
+  // takes precedence.
+  const char *interval = getenv(ENV_VAR_CKPT_INTR);
+  if (interval != NULL) {
+    theDefaultCheckpointInterval = jalib::StringToInt(interval);
+    theCheckpointInterval = theDefaultCheckpointInterval;
+  }
+  if (theMtbf > 0 && theDefaultCheckpointInterval == 0) {
+    // Daly's formula with an assumed checkpoint cost of MTBF/200.
+    theDefaultCheckpointInterval = std::max(1u, theMtbf / 10);
+    theCheckpointInterval = theDefaultCheckpointInterval;
+  }
+
+  if (!journalFile.empty()) {
+    CoordinatorJournal::State state;
+    if (journal.open(journalFile, &state)) {
+      // The workers reconnect to the address of the previous coordinator.
+      if (thePort == 0 && state.port > 0) {
+        thePort = state.port;
+      }
+      prog.recoverFromJournal(state);
+    }
+  }
+
   /*Test if the listener socket is already open*/
   if (fcntl(PROTECTED_COORD_FD, F_GETFD) != -1) {
     listenSock = new jalib::JServerSocket(PROTECTED_COORD_FD);
@@ -1833,13 +2591,17 @@ main(int argc, char **argv)
   if (!thePortFile.empty()) {
     Util::writeCoordPortToFile(thePort, thePortFile.c_str());
   }
+  journal.port(thePort);
+  if (compId != UniquePid(0, 0, 0)) {
+    journal.rewrite(prog.journalState());
+  }
   JTRACE("Listening on port")(thePort);
 
-  // parse checkpoint interval
-  const char *interval = getenv(ENV_VAR_CKPT_INTR);
-  if (interval != NULL) {
-    theDefaultCheckpointInterval = jalib::StringToInt(interval);
-    theCheckpointInterval = theDefaultCheckpointInterval;
+  if (metricsPort != -1) {
+    jalib::JSockAddr loopback("127.0.0.1");
+    metricsSock = new jalib::JServerSocket(loopback, metricsPort);
+    JASSERT(metricsSock->isValid()) (metricsPort) (JASSERT_ERRNO)
+    .Text("Failed to create metrics socket.");
   }
 
 #if 0
@@ -23,11 +23,14 @@
 #define DMTCPDMTCPCOORDINATOR_H
 
 #include "../jalib/jsocket.h"
+#include "coordinatorjournal.h"
 #include "dmtcpalloc.h"
 #include "dmtcpmessagetypes.h"
 
 namespace dmtcp
 {
+struct MetricsClient;
+
 class CoordClient
 {
   public:
@@ -73,6 +76,14 @@ class CoordClient
 
     int isNSWorker() { return _isNSWorker; }
 
+    uint64_t ckptImageSize() const { return _ckptImageSize; }
+
+    void ckptImageSize(uint64_t size) { _ckptImageSize = size; }
+
+    bool hasCkptWriteToken() const { return _hasCkptWriteToken; }
+
+    void hasCkptWriteToken(bool value) { _hasCkptWriteToken = value; }
+
     void readProcessInfo(DmtcpMessage &msg);
 
   private:
@@ -87,6 +98,8 @@ class CoordClient
     pid_t _realPid;
     pid_t _virtualPid;
     int _isNSWorker;
+    uint64_t _ckptImageSize;
+    bool _hasCkptWriteToken;
 };
 
 class DmtcpCoordinator
@@ -102,10 +115,13 @@ class DmtcpCoordinator
     void onData(CoordClient *client);
     void onConnect();
     void onDisconnect(CoordClient *client);
+    void onMetricsRequest();
+    void onMetricsData(MetricsClient *client, uint32_t events);
     void eventLoop(bool daemon);
 
     void addDataSocket(CoordClient *client);
     void updateCheckpointInterval(uint32_t timeout);
+    void updateAdaptiveCheckpointInterval(double ckptCost);
     void updateMinimumState();
     void initializeComputation();
     void broadcastMessage(DmtcpMessageType type,
@@ -117,10 +133,16 @@ class DmtcpCoordinator
 
     void processBarrier(const string &barrier);
     void releaseBarrier(const string &barrier);
+    int barrierWaitTimeout();
+    void checkBarrierTimeout();
 
     bool startCheckpoint();
     void recordCkptFilename(CoordClient *client, const char *barrierList);
 
+    void requestCkptWriteToken(CoordClient *client, uint64_t imageSize);
+    void releaseCkptWriteToken(CoordClient *client);
+    void scheduleCkptWrites();
+
     void handleUserCommand(char cmd, DmtcpMessage *reply = NULL);
     void writeStatusToFile();
     void printStatus(size_t numPeers, bool isRunning);
@@ -136,15 +158,26 @@ class DmtcpCoordinator
                                          jalib::JSocket &remote,
                                          const struct sockaddr_storage *addr,
                                          socklen_t len);
+    bool validateReconnectingWorkerProcess(DmtcpMessage &hello_remote,
+                                           jalib::JSocket &remote,
+                                           CoordClient *client,
+                                           const struct sockaddr_storage *addr,
+                                           socklen_t len);
     void ResendDoCheckpointMsgToWorker(CoordClient *client);
 
+    CoordinatorJournal::State journalState() const;
+    void recoverFromJournal(const CoordinatorJournal::State &state);
+
     ComputationStatus getStatus() const;
     WorkerState::eWorkerState minimumState() const
     {
       return getStatus().minimumState;
     }
 
+    bool isVirtualPidInUse(pid_t pid) const;
     pid_t getNewVirtualPid();
+    void leaseVirtualPids(CoordClient *client, DmtcpMessage *msg);
+    void releaseVirtualPids(CoordClient *client);
 
     void writeRestartScript();
 
@@ -159,6 +192,15 @@ class DmtcpCoordinator
     // map from hostname to checkpoint files
     map<string, vector<string> >_restartFilenames;
     map<pid_t, CoordClient *>_virtualPidToClientMap;
+
+    // Virtual pids leased to a client for its children, but not yet used.
+    map<pid_t, CoordClient *>_leasedVirtualPids;
+
+    // Checkpoint-write throttling: workers waiting for a write token, and the
+    // number of tokens currently held (in total and per host).
+    vector<CoordClient *>_pendingCkptWriters;
+    map<string, size_t>_numCkptWritersPerHost;
+    size_t _numCkptWriters;
 };
 }
 #endif // ifndef DMTCPDMTCPCOORDINATOR_H
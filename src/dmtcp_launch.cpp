@@ -82,6 +82,12 @@ static const char *theUsage =
   "                and otherwise with the default port: --port "
                                                   STRINGIFY(DEFAULT_PORT) ")\n"
   "              (This is the default.)\n"
+  "  --coord-reconnect-timeout SECONDS\n"
+  "              (environment variable DMTCP_COORD_RECONNECT_TIMEOUT)\n"
+  "              If the coordinator dies while the computation is running,\n"
+  "              keep running and try for SECONDS to reconnect to a new\n"
+  "              coordinator at the same address (see dmtcp_coordinator\n"
+  "              --journal).  (default: exit)\n"
   "  -i, --interval SECONDS (environment variable DMTCP_CHECKPOINT_INTERVAL)\n"
   "              Time in seconds between automatic checkpoints.\n"
   "              0 implies never (manual ckpt only);\n"
@@ -281,6 +287,9 @@ processArgs(int *orig_argc, const char ***orig_argv)
     } else if (s == "-i" || s == "--interval") {
       setenv(ENV_VAR_CKPT_INTR, argv[1], 1);
       shift; shift;
+    } else if (argc > 1 && s == "--coord-reconnect-timeout") {
+      setenv(ENV_VAR_COORD_RECONNECT_TIMEOUT, argv[1], 1);
+      shift; shift;
     } else if (s == "--coord-logfile") {
       setenv(ENV_VAR_COORD_LOGFILE, argv[1], 1);
       shift; shift;
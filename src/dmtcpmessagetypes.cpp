@@ -32,6 +32,8 @@ DmtcpMessage::DmtcpMessage(DmtcpMessageType t /*= DMT_NULL*/)
   , from(UniquePid::ThisProcess())
   , virtualPid(-1)
   , realPid(-1)
+  , leasedPidBase(-1)
+  , numLeasedPids(0)
   , keyLen(0)
   , valLen(0)
   , numPeers(0)
@@ -39,8 +41,12 @@ DmtcpMessage::DmtcpMessage(DmtcpMessageType t /*= DMT_NULL*/)
   , coordCmd('\0')
   , coordCmdStatus(CoordCmdStatus::NOERROR)
   , coordTimeStamp(0)
+  , ckptImageSize(0)
+  , ckptRawImageSize(0)
   , theCheckpointInterval(DMTCPMESSAGE_SAME_CKPT_INTERVAL)
   , exitAfterCkpt(0)
+  , throttleCkptWrites(0)
+  , _reserved(0)
 {
   // struct sockaddr_storage _addr;
   // socklen_t _addrlen;
@@ -93,10 +99,12 @@ dmtcp::operator<<(dmtcp::ostream &o, const DmtcpMessageType &s)
     OSHIFTPRINTF(DMT_NEW_WORKER)
     OSHIFTPRINTF(DMT_NAME_SERVICE_WORKER)
     OSHIFTPRINTF(DMT_RESTART_WORKER)
+    OSHIFTPRINTF(DMT_RECONNECT_WORKER)
     OSHIFTPRINTF(DMT_ACCEPT)
     OSHIFTPRINTF(DMT_REJECT_NOT_RESTARTING)
     OSHIFTPRINTF(DMT_REJECT_WRONG_COMP)
     OSHIFTPRINTF(DMT_REJECT_NOT_RUNNING)
+    OSHIFTPRINTF(DMT_REJECT_VIRTUAL_PID_IN_USE)
 
     OSHIFTPRINTF(DMT_UPDATE_PROCESS_INFO_AFTER_FORK)
     OSHIFTPRINTF(DMT_UPDATE_PROCESS_INFO_AFTER_INIT_OR_EXEC)
@@ -119,6 +127,15 @@ dmtcp::operator<<(dmtcp::ostream &o, const DmtcpMessageType &s)
 
     OSHIFTPRINTF(DMT_WORKER_RESUMING)
 
+    OSHIFTPRINTF(DMT_CKPT_WRITE_TOKEN_REQUEST)
+    OSHIFTPRINTF(DMT_CKPT_WRITE_TOKEN_GRANTED)
+    OSHIFTPRINTF(DMT_CKPT_WRITE_TOKEN_RELEASE)
+
+    OSHIFTPRINTF(DMT_LEASE_VIRTUAL_PIDS)
+    OSHIFTPRINTF(DMT_LEASED_VIRTUAL_PIDS)
+
+    OSHIFTPRINTF(DMT_WORKER_STATS)
+
     OSHIFTPRINTF(DMT_KILL_PEER)
 
     OSHIFTPRINTF(DMT_KVDB_REQUEST)
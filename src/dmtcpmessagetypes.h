@@ -37,10 +37,12 @@ enum DmtcpMessageType {
   DMT_NEW_WORKER,     // on connect established worker-coordinator
   DMT_NAME_SERVICE_WORKER,
   DMT_RESTART_WORKER,     // on connect established worker-coordinator
+  DMT_RECONNECT_WORKER,   // on reconnect to a replacement coordinator
   DMT_ACCEPT,          // on connect established coordinator-worker
   DMT_REJECT_NOT_RESTARTING,
   DMT_REJECT_WRONG_COMP,
   DMT_REJECT_NOT_RUNNING,
+  DMT_REJECT_VIRTUAL_PID_IN_USE,  // the pid leased by the parent is taken
 
   DMT_UPDATE_PROCESS_INFO_AFTER_FORK,
   DMT_UPDATE_PROCESS_INFO_AFTER_INIT_OR_EXEC,
@@ -81,6 +83,24 @@ enum DmtcpMessageType {
 
   DMT_WORKER_RESUMING,
 
+  // If the coordinator throttles checkpoint writes, each worker requests a
+  // write token after the PRECHECKPOINT event and releases it once the
+  // checkpoint image has been written.
+  DMT_CKPT_WRITE_TOKEN_REQUEST,  // worker -> coord, with ckptImageSize
+  DMT_CKPT_WRITE_TOKEN_GRANTED,  // coord -> worker
+  DMT_CKPT_WRITE_TOKEN_RELEASE,  // worker -> coord
+
+  // A worker hands out virtual pids for its children from a block leased from
+  // the coordinator (see CoordinatorAPI::createNewConnectionBeforeFork()).
+  // The worker asks for the next block in the background.
+  DMT_LEASE_VIRTUAL_PIDS,        // worker -> coord
+  DMT_LEASED_VIRTUAL_PIDS,       // coord -> worker, with leasedPidBase
+
+  // Statistics recorded by a worker during a checkpoint or restart (see
+  // dmtcp_report_worker_stat()), sent as "name=value" lines before the
+  // worker resumes.
+  DMT_WORKER_STATS,              // worker -> coord
+
   DMT_KILL_PEER,             // send kill message to peer
 
   DMT_KVDB_REQUEST,
@@ -130,6 +150,9 @@ struct DmtcpMessage {
   pid_t virtualPid;
   pid_t realPid;
 
+  pid_t leasedPidBase;
+  uint32_t numLeasedPids;
+
   uint32_t keyLen;
   uint32_t valLen;
 
@@ -139,12 +162,16 @@ struct DmtcpMessage {
   int32_t coordCmdStatus;
 
   uint64_t coordTimeStamp;
+  uint64_t ckptImageSize;
+  uint64_t ckptRawImageSize;
 
   uint32_t theCheckpointInterval;
   struct in_addr ipAddr;
 
   uint32_t uniqueIdOffset;
   uint32_t exitAfterCkpt;
+  uint32_t throttleCkptWrites;
+  uint32_t _reserved;
 
   DmtcpMessage(DmtcpMessageType t = DMT_NULL);
   void assertValid() const;
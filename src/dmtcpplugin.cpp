@@ -372,7 +372,7 @@ dmtcp_get_restart_env(const char *name,   // IN
       char *start_ptr = env_buf;
 
       // iterate over the flattened list of name-value pairs
-      while (start_ptr - env_buf < (int)sizeof(env_buf)) {
+      while (start_ptr - env_buf < count) {
         pos = NULL;
         if (strncmp(start_ptr, name, namelen) == 0) {
           if ((pos = strchr(start_ptr, '='))) {
@@ -395,7 +395,7 @@ dmtcp_get_restart_env(const char *name,   // IN
 
   close(env_fd);
   JWARNING(rc != RESTART_ENV_DMTCP_BUF_TOO_SMALL)
-    (name) (sizeof(env_buf)).Text("Resize env_buf[]");
+    (name) (size).Text("Resize env_buf[]");
   JALLOC_HELPER_FREE(env_buf);
   return rc;
 }
@@ -472,3 +472,9 @@ dmtcp_add_to_ckpt_header(const char *key, const char *value)
 {
   ProcessInfo::instance().addKeyValuePairToCkptHeader(key, value);
 }
+
+EXTERNC void
+dmtcp_report_worker_stat(const char *name, double value)
+{
+  CoordinatorAPI::recordWorkerStat(name, value);
+}
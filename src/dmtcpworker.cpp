@@ -27,6 +27,7 @@
 #include "../jalib/jconvert.h"
 #include "../jalib/jfilesystem.h"
 #include "../jalib/jsocket.h"
+#include "ckptserializer.h"
 #include "coordinatorapi.h"
 #include "kvdb.h"
 #include "pluginmanager.h"
@@ -51,6 +52,7 @@ EXTERNC ProcSelfMaps *procSelfMaps;
  */
 static ATOMIC_SHARED_GLOBAL bool exitInProgress = false;
 static bool exitAfterCkpt = 0;
+static bool throttleCkptWrites = false;
 static bool dmtcp_initialized = false;
 
 
@@ -336,6 +338,13 @@ DmtcpWorker::waitForPreSuspendMessage()
   DmtcpMessage msg;
   CoordinatorAPI::recvMsgFromCoordinator(&msg);
 
+  // The coordinator went away while we were running.  Keep the computation
+  // alive if a replacement coordinator takes us back.
+  while (!msg.isValid() && !exitInProgress &&
+         CoordinatorAPI::reconnectToCoordinator()) {
+    CoordinatorAPI::recvMsgFromCoordinator(&msg);
+  }
+
   // Before validating message; make sure we are not exiting.
   if (exitInProgress) {
     ckptThreadPerformExit();
@@ -353,6 +362,35 @@ DmtcpWorker::waitForPreSuspendMessage()
 
   ProcessInfo::instance().compGroup(SharedData::getCompId());
   exitAfterCkpt = msg.exitAfterCkpt;
+  // A forked checkpoint is written by a grandchild after the parent has
+  // resumed, so the parent cannot hold the write token for the duration of
+  // the write.  Such workers are not throttled.
+  throttleCkptWrites = msg.throttleCkptWrites &&
+    getenv(ENV_VAR_FORKED_CKPT) == NULL;
+}
+
+// The resident set size is a cheap upper bound on the number of non-zero
+// pages that will end up in the checkpoint image.  The coordinator uses it to
+// schedule the largest writers first.
+static uint64_t
+estimateCkptImageSize()
+{
+  char buf[128] = {0};
+  int fd = _real_open("/proc/self/statm", O_RDONLY);
+  if (fd == -1) {
+    return 0;
+  }
+  ssize_t len = Util::readAll(fd, buf, sizeof(buf) - 1);
+  _real_close(fd);
+  if (len <= 0) {
+    return 0;
+  }
+
+  unsigned long long size, resident;
+  if (sscanf(buf, "%llu %llu", &size, &resident) != 2) {
+    return 0;
+  }
+  return (uint64_t)resident * Util::pageSize();
 }
 
 void
@@ -428,12 +466,23 @@ DmtcpWorker::preCheckpoint()
 
   WorkerState::setCurrentState(WorkerState::CHECKPOINTING);
   PluginManager::eventHook(DMTCP_EVENT_PRECHECKPOINT);
+
+  if (throttleCkptWrites) {
+    JTRACE("Waiting for checkpoint write token");
+    CoordinatorAPI::waitForCkptWriteToken(estimateCkptImageSize());
+  }
 }
 
 void
 DmtcpWorker::postCheckpoint()
 {
-  {
+  if (throttleCkptWrites) {
+    CoordinatorAPI::releaseCkptWriteToken();
+  }
+
+  // With forked checkpointing, the maps were read by the child that wrote
+  // the image, and the parent has none to send.
+  if (procSelfMaps != NULL) {
     // Send ckpt maps to coordinator.
     string workerPath("/worker/" + ProcessInfo::instance().upidStr());
     kvdb::set(
@@ -455,7 +504,8 @@ DmtcpWorker::postCheckpoint()
   JASSERT(rename(ProcessInfo::instance().getTempCkptFilename().c_str(),
                  ProcessInfo::instance().getCkptFilename().c_str()) == 0);
 
-  CoordinatorAPI::sendCkptFilename();
+  CoordinatorAPI::sendCkptFilename(CkptSerializer::rawImageSize());
+  CoordinatorAPI::sendWorkerStats();
 
   if (exitAfterCkpt) {
     JTRACE("Asked to exit after checkpoint. Exiting!");
@@ -493,6 +543,8 @@ DmtcpWorker::postRestart(double ckptReadTime)
       procSelfMaps.getData());
   }
 
+  CoordinatorAPI::sendWorkerStats();
+
   // Inform Coordinator of RUNNING state.
   WorkerState::setCurrentState(WorkerState::RUNNING);
   JTRACE("Informing coordinator of RUNNING status") (UniquePid::ThisProcess());
@@ -26,7 +26,8 @@ KVDBResponse request(KVDBRequest request,
     return KVDBResponse::INVALID_REQUEST;
   }
 
-  if (val.empty() && request != kvdb::KVDBRequest::GET) {
+  if (val.empty() && request != kvdb::KVDBRequest::GET &&
+      request != kvdb::KVDBRequest::MGET) {
     return KVDBResponse::INVALID_REQUEST;
   }
 
@@ -85,6 +86,81 @@ set(string const& id, string const& key, string const& val, string *oldVal)
   return request(KVDBRequest::SET, id, key, val, oldVal);
 }
 
+// The keys and values of MSET/MGET requests travel as one string each, with
+// the items separated by NUL characters.
+static string
+pack(vector<string> const& items)
+{
+  string str;
+
+  for (size_t i = 0; i < items.size(); i++) {
+    if (i > 0) {
+      str += '\0';
+    }
+    str += items[i];
+  }
+  return str;
+}
+
+static void
+unpack(string const& str, vector<string> *items)
+{
+  size_t start = 0;
+
+  items->clear();
+  for (;;) {
+    size_t end = str.find('\0', start);
+    if (end == string::npos) {
+      items->push_back(str.substr(start));
+      return;
+    }
+    items->push_back(str.substr(start, end - start));
+    start = end + 1;
+  }
+}
+
+KVDBResponse
+mset(string const& id, map<string, string> const& kvmap)
+{
+  vector<string> keys;
+  vector<string> vals;
+  map<string, string>::const_iterator it;
+
+  if (kvmap.empty()) {
+    return KVDBResponse::SUCCESS;
+  }
+
+  for (it = kvmap.begin(); it != kvmap.end(); ++it) {
+    keys.push_back(it->first);
+    vals.push_back(it->second);
+  }
+
+  return request(KVDBRequest::MSET, id, pack(keys), pack(vals));
+}
+
+KVDBResponse
+mget(string const& id, vector<string> const& keys, vector<string> *vals)
+{
+  string valStr;
+
+  vals->clear();
+  if (keys.empty()) {
+    return KVDBResponse::SUCCESS;
+  }
+
+  KVDBResponse response = request(KVDBRequest::MGET, id, pack(keys),
+                                  string(), &valStr);
+  if (response == KVDBResponse::SUCCESS ||
+      response == KVDBResponse::KEY_NOT_FOUND) {
+    unpack(valStr, vals);
+    if (vals->size() != keys.size()) {
+      return KVDBResponse::INVALID_REQUEST;
+    }
+  }
+
+  return response;
+}
+
 ostream &
 operator<<(ostream &o, const KVDBRequest &id)
 {
@@ -113,6 +189,12 @@ operator<<(ostream &o, const KVDBRequest &id)
     case KVDBRequest::MAX:
       o << "KVDBRequest::MAX";
       break;
+    case KVDBRequest::MSET:
+      o << "KVDBRequest::MSET";
+      break;
+    case KVDBRequest::MGET:
+      o << "KVDBRequest::MGET";
+      break;
   }
 
   return o;
@@ -77,15 +77,20 @@ LookupService::sendResponse(jalib::JSocket &remote,
 
 void
 LookupService::sendResponse(jalib::JSocket &remote,
-                            string const& val)
+                            string const& val,
+                            KVDBResponse response)
 {
   DmtcpMessage reply(DMT_KVDB_RESPONSE);
-  reply.kvdbResponse = kvdb::KVDBResponse::SUCCESS;
+  reply.kvdbResponse = response;
   reply.valLen = val.size() + 1;
   reply.extraBytes = reply.valLen;
 
-  remote << reply;
-  remote.writeAll(val.data(), reply.valLen);
+  // One write, so that the value doesn't wait for the worker's delayed ACK
+  // of the reply header (Nagle's algorithm).
+  vector<char> buf(sizeof(reply) + reply.valLen);
+  memcpy(&buf[0], &reply, sizeof(reply));
+  memcpy(&buf[sizeof(reply)], val.c_str(), reply.valLen);
+  remote.writeAll(&buf[0], buf.size());
 }
 
 void
@@ -103,6 +108,16 @@ LookupService::processRequest(jalib::JSocket &remote,
     return;
   }
 
+  if (msg.kvdbRequest == KVDBRequest::MGET) {
+    processMGet(remote, msg, extraData);
+    return;
+  }
+
+  if (msg.kvdbRequest == KVDBRequest::MSET) {
+    processMSet(remote, msg, extraData);
+    return;
+  }
+
   processSet(remote, msg, extraData);
   return;
 }
@@ -125,6 +140,76 @@ LookupService::processGet(jalib::JSocket &remote,
   return;
 }
 
+void
+LookupService::unpack(const char *data, size_t len, vector<string> *items)
+{
+  const char *end = data + len;
+
+  items->clear();
+  while (data < end) {
+    size_t itemLen = strnlen(data, end - data);
+    items->push_back(string(data, itemLen));
+    data += itemLen + 1;
+  }
+}
+
+void
+LookupService::processMGet(jalib::JSocket &remote,
+                           const DmtcpMessage &msg,
+                           const void *extraData)
+{
+  vector<string> keys;
+  string vals;
+  KVDBResponse response = KVDBResponse::SUCCESS;
+
+  unpack((const char *)extraData, msg.keyLen, &keys);
+
+  map<string, KeyValueMap>::iterator db = _maps.find(msg.kvdbId);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i > 0) {
+      vals += '\0';
+    }
+
+    KeyValueMap::iterator kv;
+    if (db == _maps.end() ||
+        (kv = db->second.find(keys[i])) == db->second.end()) {
+      JTRACE("Lookup Failed, Key not found.") (msg.kvdbId) (keys[i]);
+      response = KVDBResponse::KEY_NOT_FOUND;
+    } else {
+      vals += kv->second;
+    }
+  }
+
+  sendResponse(remote, vals, response);
+}
+
+void
+LookupService::processMSet(jalib::JSocket &remote,
+                           const DmtcpMessage &msg,
+                           const void *extraData)
+{
+  vector<string> keys;
+  vector<string> vals;
+
+  unpack((const char *)extraData, msg.keyLen, &keys);
+  unpack((const char *)extraData + msg.keyLen, msg.valLen, &vals);
+
+  if (keys.size() != vals.size()) {
+    JWARNING(false) (msg.kvdbId) (keys.size()) (vals.size())
+    .Text("Malformed MSET request");
+    sendResponse(remote, KVDBResponse::INVALID_REQUEST);
+    return;
+  }
+
+  KeyValueMap &kvmap = _maps[msg.kvdbId];
+  kvmap.reserve(kvmap.size() + keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    kvmap[keys[i]] = vals[i];
+  }
+
+  sendResponse(remote, KVDBResponse::SUCCESS);
+}
+
 void
 LookupService::processSet(jalib::JSocket &remote,
                           const DmtcpMessage &msg,
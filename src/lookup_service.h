@@ -33,7 +33,9 @@ namespace dmtcp
 class LookupService
 {
   public:
-    typedef map<string, string>KeyValueMap;
+    // Hashed: the socket plugin stores one key per connection of the
+    // computation.
+    typedef unordered_map<string, string>KeyValueMap;
 
     LookupService() {}
 
@@ -52,9 +54,17 @@ class LookupService
     void serialize(ofstream &o, KeyValueMap const &kvmap);
     void serialize(string const& file);
 
+    const map<string, KeyValueMap> &maps() const { return _maps; }
+
+    // Splits the NUL-separated items of an MSET/MGET request.
+    static void unpack(const char *data, size_t len, vector<string> *items);
+
   private:
     void sendResponse(jalib::JSocket &remote, kvdb::KVDBResponse response);
-    void sendResponse(jalib::JSocket &remote, string const &val);
+    void sendResponse(jalib::JSocket &remote,
+                      string const &val,
+                      kvdb::KVDBResponse response =
+                        kvdb::KVDBResponse::SUCCESS);
 
     void processGet(jalib::JSocket &remote,
                     const DmtcpMessage &msg,
@@ -62,6 +72,12 @@ class LookupService
     void processSet(jalib::JSocket &remote,
                     const DmtcpMessage &msg,
                     const void *extraData);
+    void processMSet(jalib::JSocket &remote,
+                     const DmtcpMessage &msg,
+                     const void *extraData);
+    void processMGet(jalib::JSocket &remote,
+                     const DmtcpMessage &msg,
+                     const void *extraData);
 
     map<string, KeyValueMap>_maps;
 };
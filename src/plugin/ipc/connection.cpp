@@ -25,6 +25,7 @@
 #include "../jalib/jserialize.h"
 
 #include "util.h"
+#include "connectionlist.h"
 
 using namespace dmtcp;
 
@@ -72,9 +73,9 @@ Connection::restoreDupFds(int fd)
 void
 Connection::saveOptions()
 {
-  errno = 0;
-  _fcntlFlags = fcntl(_fds[0], F_GETFL);
-  JASSERT(_fcntlFlags >= 0) (_fds[0]) (_fcntlFlags) (_type) (JASSERT_ERRNO);
+  const ConnectionList::FdInfo *info = ConnectionList::fdInfo(_fds[0]);
+  _fcntlFlags = info != NULL ? info->flags : -1;
+  JASSERT(_fcntlFlags >= 0) (_fds[0]) (_fcntlFlags) (_type);
   errno = 0;
   _fcntlOwner = fcntl(_fds[0], F_GETOWN);
   JASSERT(_fcntlOwner != -1) (_fcntlOwner) (JASSERT_ERRNO);
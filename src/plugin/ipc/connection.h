@@ -50,6 +50,7 @@ class Connection
       INVALID  = 0x00000,
       TCP      = 0x10000,
       RAW      = 0x11000,
+      DGRAM    = 0x12000,
       PTY      = 0x20000,
       FILE     = 0x21000,
       STDIO    = 0x22000,
@@ -59,8 +60,8 @@ class Connection
       SIGNALFD = 0x32000,
       INOTIFY  = 0x34000,
       POSIXMQ  = 0x40000,
-      TYPEMASK = TCP | RAW | PTY | FILE | STDIO | FIFO | EPOLL | EVENTFD |
-        SIGNALFD | INOTIFY | POSIXMQ
+      TYPEMASK = TCP | RAW | DGRAM | PTY | FILE | STDIO | FIFO | EPOLL |
+        EVENTFD | SIGNALFD | INOTIFY | POSIXMQ
     };
 
     Connection() {}
@@ -26,6 +26,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "jassert.h"
@@ -84,6 +85,10 @@ using namespace dmtcp;
 // This is the first program after dmtcp_launch
 static bool freshProcess = true;
 
+// See ConnectionList::fdInfo().
+static map<int, ConnectionList::FdInfo> fdInfoCache;
+static bool fdInfoCacheActive = false;
+
 ConnectionList *
 ConnectionList::clone()
 {
@@ -141,18 +146,99 @@ ConnectionList::eventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
     break;
   }
 
+  case DMTCP_EVENT_RESUME:
+  case DMTCP_EVENT_RESTART:
+    fdInfoCacheActive = false;
+    fdInfoCache.clear();
+    break;
+
   default:
     break;
   }
 }
 
+const ConnectionList::FdInfo *
+ConnectionList::fdInfo(int fd, bool needPath)
+{
+  if (!fdInfoCacheActive) {
+    fdInfoCache.clear();
+  }
+
+  map<int, FdInfo>::iterator i = fdInfoCache.find(fd);
+  if (i == fdInfoCache.end()) {
+    FdInfo info;
+    errno = 0;
+    info.flags = _real_fcntl(fd, F_GETFL, 0);
+    if (info.flags == -1 && errno == EBADF) {
+      // Not cached: the checkpoint thread may still open this fd.
+      return NULL;
+    }
+    JASSERT(fstat(fd, &info.stat) == 0) (fd) (JASSERT_ERRNO);
+    info.offset = S_ISSOCK(info.stat.st_mode) ? -1 : lseek(fd, 0, SEEK_CUR);
+    info.hasPath = false;
+    i = fdInfoCache.insert(std::make_pair(fd, info)).first;
+  }
+
+  if (needPath && !i->second.hasPath) {
+    i->second.path = jalib::Filesystem::GetDeviceName(fd);
+    i->second.hasPath = true;
+  }
+  return &i->second;
+}
+
 static bool
 _isBadFd(int fd)
 {
+  if (fdInfoCacheActive) {
+    return ConnectionList::fdInfo(fd) == NULL;
+  }
   errno = 0;
   return _real_fcntl(fd, F_GETFL, 0) == -1 && errno == EBADF;
 }
 
+static double
+monotonicTime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Name of a connection type in the drain statistics.
+static const char *
+conTypeName(uint32_t type)
+{
+  switch (type) {
+  case Connection::TCP:
+    return "tcp";
+  case Connection::RAW:
+    return "raw";
+  case Connection::DGRAM:
+    return "dgram";
+  case Connection::PTY:
+    return "pty";
+  case Connection::FILE:
+    return "file";
+  case Connection::STDIO:
+    return "stdio";
+  case Connection::FIFO:
+    return "fifo";
+  case Connection::EPOLL:
+    return "epoll";
+  case Connection::EVENTFD:
+    return "eventfd";
+  case Connection::SIGNALFD:
+    return "signalfd";
+  case Connection::INOTIFY:
+    return "inotify";
+  case Connection::POSIXMQ:
+    return "posixmq";
+  default:
+    return "other";
+  }
+}
+
 // static ConnectionList *connectionList = NULL;
 // ConnectionList& ConnectionList::instance()
 // {
@@ -252,6 +338,7 @@ ConnectionList::serialize(jalib::JBinarySerializer &o)
 void
 ConnectionList::list()
 {
+#ifdef LOGGING
   ostringstream o;
 
   o << "\n";
@@ -268,6 +355,7 @@ ConnectionList::list()
     o << "\n";
   }
   JTRACE("ConnectionList") (dmtcp_get_uniquepid_str()) (o.str());
+#endif // ifdef LOGGING
 }
 
 Connection *
@@ -406,6 +494,8 @@ ConnectionList::processDup(int oldfd, int newfd)
 void
 ConnectionList::preLockSaveOptions()
 {
+  // The fds can't change under us until resume or restart.
+  fdInfoCacheActive = true;
   deleteStaleConnections();
   list();
 
@@ -432,13 +522,31 @@ ConnectionList::preCkptFdLeaderElection()
 void
 ConnectionList::drain()
 {
+  // Number of connections drained, and the time it took, by type.
+  map<uint32_t, size_t> numDrained;
+  map<uint32_t, double> drainTime;
+
+  // The drains run one at a time on the checkpoint thread: a helper thread
+  // started while the user threads are suspended would be unknown to the
+  // thread list and to pid virtualization.
   for (iterator i = begin(); i != end(); ++i) {
     Connection *con = i->second;
     con->checkLocking();
     if (con->hasLock()) {
+      double startTime = monotonicTime();
       con->drain();
+      numDrained[con->conType()]++;
+      drainTime[con->conType()] += monotonicTime() - startTime;
     }
   }
+
+  map<uint32_t, double>::iterator t;
+  for (t = drainTime.begin(); t != drainTime.end(); ++t) {
+    string prefix = string("drain_") + conTypeName(t->first);
+    dmtcp_report_worker_stat((prefix + "_connections").c_str(),
+                             numDrained[t->first]);
+    dmtcp_report_worker_stat((prefix + "_seconds").c_str(), t->second);
+  }
 }
 
 void
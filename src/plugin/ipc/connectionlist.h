@@ -23,6 +23,7 @@
 #ifndef CONNECTIONLIST_H
 # define CONNECTIONLIST_H
 
+#include <sys/stat.h>
 #include "jalloc.h"
 #include "jserialize.h"
 #include "connection.h"
@@ -47,6 +48,16 @@ class ConnectionList
 
     typedef map<int, Connection *>FdToConMapT;
 
+    // Metadata of an open fd.  During a checkpoint, it is read once per fd
+    // and shared by the connection lists of all ipc sub-plugins.
+    struct FdInfo {
+      int flags;          // F_GETFL
+      off_t offset;       // -1 for sockets
+      struct stat stat;
+      string path;        // Only valid if hasPath is set
+      bool hasPath;
+    };
+
     ConnectionList()
     {
       numIncomingCons = 0;
@@ -72,6 +83,12 @@ class ConnectionList
     void serialize(jalib::JBinarySerializer &o);
 
     void eventHook(DmtcpEvent_t event, DmtcpEventData_t *data);
+
+    // Returns NULL if 'fd' is not open.  The fd path is resolved only if
+    // 'needPath' is set.  The result is cached from the start of a checkpoint
+    // until resume or restart; the checkpoint thread must not close or
+    // replace a connection fd in between.
+    static const FdInfo *fdInfo(int fd, bool needPath = false);
     virtual void scanForPreExisting() {}
 
     virtual void preLockSaveOptions();
@@ -21,10 +21,13 @@
 
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <linux/fs.h>
 #include <linux/limits.h>
 #include <sys/file.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
 #include <termios.h>
 #include <time.h>
@@ -47,8 +50,18 @@
 
 using namespace dmtcp;
 
+// Checkpointed copies of files are compared and updated in blocks of this
+// size.
+#define FILE_BLOCK_SIZE (64 * 1024)
+
 static void writeFileFromFd(int fd, int destFd);
-static bool areFilesEqual(int fd, int destFd, size_t size);
+static off_t updateFileFromFd(int fd,
+                              int destFd,
+                              const vector<uint64_t> &oldHashes,
+                              vector<uint64_t> *hashes);
+static bool fileMatchesHashes(int fd,
+                              off_t size,
+                              const vector<uint64_t> &hashes);
 
 static bool
 _isVimApp()
@@ -117,16 +130,18 @@ FileConnection::calculateRelativePath()
 void
 FileConnection::drain()
 {
-  struct stat statbuf;
-
   JASSERT(_fds.size() > 0);
 
   _ckpted_file = false;
   _allow_overwrite = false;
 
-  // Read the current file descriptor offset
-  _offset = lseek(_fds[0], 0, SEEK_CUR);
-  fstat(_fds[0], &statbuf);
+  const ConnectionList::FdInfo *info =
+    ConnectionList::fdInfo(_fds[0], _type != FILE_PROCFS);
+  JASSERT(info != NULL) (_fds[0]) (_path);
+  const struct stat &statbuf = info->stat;
+
+  // The file descriptor offset, as read at the start of the checkpoint
+  _offset = info->offset;
   _st_dev = statbuf.st_dev;
   _st_ino = statbuf.st_ino;
   _st_size = statbuf.st_size;
@@ -141,7 +156,7 @@ FileConnection::drain()
     // Update _path to reflect the current state. The file path might be a new
     // one after restart and if the current process wasn't the leader, it never
     // had a chance to update the _path. Update it now.
-    _path = jalib::Filesystem::GetDeviceName(_fds[0]);
+    _path = info->path;
     // Files deleted on NFS have the .nfsXXXX format.
     if (Util::strStartsWith(jalib::Filesystem::BaseName(_path).c_str(), ".nfs")
         || !jalib::Filesystem::FileExists(_path)) {
@@ -215,21 +230,42 @@ FileConnection::preCkpt()
         .Text("Unable to create directory in File Path");
 
       int destFd = _real_open(
-          _savedFilePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+          _savedFilePath.c_str(), O_CREAT | O_WRONLY,
           S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
       JASSERT(destFd != -1) (JASSERT_ERRNO) (_path) (_savedFilePath);
 
-      JTRACE("Saving checkpointed copy of the file") (_path) (_savedFilePath);
+      // The copy saved by the previous checkpoint is updated in place, unless
+      // it was modified or replaced since.
+      struct stat st;
+      JASSERT(fstat(destFd, &st) == 0) (_savedFilePath) (JASSERT_ERRNO);
+      if (_hashedFilePath != _savedFilePath ||
+          _hashedFileSize != st.st_size ||
+          _hashedFileMtime != st.st_mtim.tv_sec * 1000000000LL +
+          st.st_mtim.tv_nsec) {
+        _blockHashes.clear();
+      }
+
+      JTRACE("Saving checkpointed copy of the file") (_path) (_savedFilePath)
+        (_blockHashes.size());
+      vector<uint64_t> oldHashes;
+      oldHashes.swap(_blockHashes);
+      off_t size;
       if (_fcntlFlags & O_WRONLY) {
         // If the file is opened() in write-only mode. Open it in readonly mode
         // to create the ckpt copy.
         int tmpfd = _real_open(_path.c_str(), O_RDONLY, 0);
         JASSERT(tmpfd != -1);
-        writeFileFromFd(tmpfd, destFd);
+        size = updateFileFromFd(tmpfd, destFd, oldHashes, &_blockHashes);
         _real_close(tmpfd);
       } else {
-        writeFileFromFd(_fds[0], destFd);
+        size = updateFileFromFd(_fds[0], destFd, oldHashes, &_blockHashes);
       }
+      JASSERT(ftruncate(destFd, size) == 0) (_savedFilePath) (JASSERT_ERRNO);
+
+      JASSERT(fstat(destFd, &st) == 0) (_savedFilePath) (JASSERT_ERRNO);
+      _hashedFilePath = _savedFilePath;
+      _hashedFileSize = st.st_size;
+      _hashedFileMtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
       _real_close(destFd);
     } else {
       JTRACE("Not checkpointing this file") (_path);
@@ -307,7 +343,7 @@ FileConnection::refill(bool isRestart)
         (_savedFilePath) (_path);
       this->overwriteFileWithBackup(savedFd);
     } else {
-      if (!areFilesEqual(_fds[0], savedFd, _st_size)) {
+      if (!fileMatchesHashes(_fds[0], _hashedFileSize, _blockHashes)) {
         if (_type == FILE_SHM) {
           JWARNING(false) (_path) (_savedFilePath)
           .Text("\n"
@@ -548,40 +584,188 @@ FileConnection::openFile()
   return fd;
 }
 
+static uint64_t
+hashBlock(const char *buf, size_t len)
+{
+  const uint64_t prime1 = 0x9E3779B97F4A7C15ULL;
+  const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+  uint64_t h[4] = { len, len ^ prime1, len ^ prime2, ~len };
+  size_t i = 0;
+
+  // Four independent lanes, to keep up with reading the file.
+  for (; i + 4 * sizeof(uint64_t) <= len; i += 4 * sizeof(uint64_t)) {
+    for (int k = 0; k < 4; k++) {
+      uint64_t word;
+      memcpy(&word, buf + i + k * sizeof(word), sizeof(word));
+      h[k] = (h[k] ^ word * prime2) * prime1;
+      h[k] = h[k] << 31 | h[k] >> 33;
+    }
+  }
+  for (; i < len; i++) {
+    h[0] = (h[0] ^ (unsigned char)buf[i]) * prime1;
+  }
+
+  uint64_t hash = h[0] ^ (h[1] << 17 | h[1] >> 47) ^
+    (h[2] << 29 | h[2] >> 35) ^ (h[3] << 43 | h[3] >> 21);
+  hash = (hash ^ hash >> 33) * prime2;
+  return hash ^ hash >> 29;
+}
+
+/* Compares the first 'size' bytes of the file with the blocks of its
+ * checkpointed copy, given by their hashes.
+ */
 static bool
-areFilesEqual(int fd, int savedFd, size_t size)
+fileMatchesHashes(int fd, off_t size, const vector<uint64_t> &hashes)
 {
   long page_size = sysconf(_SC_PAGESIZE);
   const size_t bufSize = 1024 * page_size;
-  char *buf1 = (char *)JALLOC_HELPER_MALLOC(bufSize);
-  char *buf2 = (char *)JALLOC_HELPER_MALLOC(bufSize);
+  struct stat st;
 
-  off_t offset1 = lseek(fd, 0, SEEK_CUR);
-  off_t offset2 = lseek(savedFd, 0, SEEK_CUR);
+  JASSERT(fstat(fd, &st) == 0) (fd) (JASSERT_ERRNO);
+  if (st.st_size < size) {
+    return false;
+  }
 
+  char *buf = (char *)JALLOC_HELPER_MALLOC(bufSize);
+  off_t offset = lseek(fd, 0, SEEK_CUR);
   JASSERT(lseek(fd, 0, SEEK_SET) == 0) (fd) (JASSERT_ERRNO);
-  JASSERT(lseek(savedFd, 0, SEEK_SET) == 0) (savedFd) (JASSERT_ERRNO);
 
-  int readBytes;
-  while (size > 0) {
-    readBytes = Util::readAll(savedFd, buf1, MIN(bufSize, size));
+  bool equal = true;
+  size_t n = 0;
+  while (equal && size > 0) {
+    ssize_t readBytes = Util::readAll(fd, buf, MIN((off_t)bufSize, size));
     JASSERT(readBytes != -1) (JASSERT_ERRNO).Text("Read Failed");
     if (readBytes == 0) {
+      equal = false;
       break;
     }
-    if (Util::readAll(fd, buf2, readBytes) != readBytes) {
+    for (ssize_t pos = 0; equal && pos < readBytes; pos += FILE_BLOCK_SIZE) {
+      size_t len = MIN(FILE_BLOCK_SIZE, readBytes - pos);
+      equal = n < hashes.size() && hashBlock(buf + pos, len) == hashes[n];
+      n++;
+    }
+    size -= readBytes;
+  }
+  JALLOC_HELPER_FREE(buf);
+  JASSERT(lseek(fd, offset, SEEK_SET) != -1);
+  return equal && n == hashes.size();
+}
+
+/* Brings the copy of the file in 'destFd' up to date with 'fd', and returns
+ * the size of the file.  The copy only gets the blocks whose hash differs
+ * from the one in 'oldHashes'; the hashes of all blocks go to 'hashes'.
+ */
+static off_t
+updateFileFromFd(int fd,
+                 int destFd,
+                 const vector<uint64_t> &oldHashes,
+                 vector<uint64_t> *hashes)
+{
+  long page_size = sysconf(_SC_PAGESIZE);
+  const size_t bufSize = 1024 * page_size;
+  char *buf = (char *)JALLOC_HELPER_MALLOC(bufSize);
+  size_t numChanged = 0;
+
+  // Synchronize memory buffer with data in filesystem
+  // On some Linux kernels, the shared-memory test will fail without this.
+  fsync(fd);
+
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  JASSERT(lseek(fd, 0, SEEK_SET) == 0)
+    (fd) (JASSERT_ERRNO) (jalib::Filesystem::GetDeviceName(fd));
+
+  // Only the last read can be short, so the blocks stay aligned.
+  off_t size = 0;
+  hashes->clear();
+  while (1) {
+    ssize_t readBytes = Util::readAll(fd, buf, bufSize);
+    JASSERT(readBytes != -1) (JASSERT_ERRNO).Text("Read Failed");
+    if (readBytes == 0) {
       break;
     }
-    if (memcmp(buf1, buf2, readBytes) != 0) {
+
+    // Write each run of changed blocks at once.
+    ssize_t runStart = -1;
+    for (ssize_t pos = 0; pos < readBytes; pos += FILE_BLOCK_SIZE) {
+      size_t len = MIN(FILE_BLOCK_SIZE, readBytes - pos);
+      uint64_t hash = hashBlock(buf + pos, len);
+      size_t n = hashes->size();
+      bool changed = n >= oldHashes.size() || oldHashes[n] != hash;
+      hashes->push_back(hash);
+
+      if (changed && runStart == -1) {
+        runStart = pos;
+      }
+      if (runStart != -1 && (!changed || pos + len == (size_t)readBytes)) {
+        ssize_t runEnd = changed ? pos + len : pos;
+        JASSERT(lseek(destFd, size + runStart, SEEK_SET) != -1)
+          (destFd) (JASSERT_ERRNO);
+        JASSERT(Util::writeAll(destFd, buf + runStart, runEnd - runStart) !=
+                -1) (JASSERT_ERRNO).Text("Write failed.");
+        numChanged += runEnd - runStart;
+        runStart = -1;
+      }
+    }
+    size += readBytes;
+  }
+  JALLOC_HELPER_FREE(buf);
+  JASSERT(lseek(fd, offset, SEEK_SET) != -1);
+
+  JTRACE("Updated checkpointed copy of file") (size) (numChanged);
+  return size;
+}
+
+/* Copies 'fd' to the empty file 'destFd' without going through user space:
+ * as a reflink if the filesystem shares extents between files, else with
+ * copy_file_range() or sendfile().  Returns the number of bytes copied; the
+ * caller copies the rest, if any, itself.
+ */
+static off_t
+copyFileInKernel(int fd, int destFd)
+{
+  const size_t chunkSize = 1024 * 1024 * 1024;
+  struct stat st;
+  loff_t inOffset = 0;
+  loff_t outOffset = 0;
+
+  JASSERT(fstat(fd, &st) == 0) (fd) (JASSERT_ERRNO);
+
+#ifdef FICLONE
+  if (ioctl(destFd, FICLONE, fd) == 0) {
+    JTRACE("Cloned file") (st.st_size);
+    return st.st_size;
+  }
+#endif // ifdef FICLONE
+
+#ifdef SYS_copy_file_range
+  while (inOffset < st.st_size) {
+    ssize_t rc = syscall(SYS_copy_file_range, fd, &inOffset, destFd,
+                         &outOffset, chunkSize, 0);
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
       break;
     }
-    size -= readBytes;
   }
-  JALLOC_HELPER_FREE(buf1);
-  JALLOC_HELPER_FREE(buf2);
-  JASSERT(lseek(fd, offset1, SEEK_SET) != -1);
-  JASSERT(lseek(savedFd, offset2, SEEK_SET) != -1);
-  return size == 0;
+#endif // ifdef SYS_copy_file_range
+
+  // sendfile() writes at the file offset of 'destFd'.
+  if (inOffset < st.st_size &&
+      lseek(destFd, outOffset, SEEK_SET) == outOffset) {
+    while (inOffset < st.st_size) {
+      ssize_t rc = sendfile(destFd, fd, &inOffset, chunkSize);
+      if (rc == -1 && errno == EINTR) {
+        continue;
+      }
+      if (rc <= 0) {
+        break;
+      }
+    }
+  }
+
+  JTRACE("Copied file in kernel") (inOffset) (st.st_size);
+  return inOffset;
 }
 
 static void
@@ -589,17 +773,24 @@ writeFileFromFd(int fd, int destFd)
 {
   long page_size = sysconf(_SC_PAGESIZE);
   const size_t bufSize = 1024 * page_size;
-  char *buf = (char *)JALLOC_HELPER_MALLOC(bufSize);
 
   // Synchronize memory buffer with data in filesystem
   // On some Linux kernels, the shared-memory test will fail without this.
   fsync(fd);
 
   off_t offset = lseek(fd, 0, SEEK_CUR);
-  JASSERT(lseek(fd, 0, SEEK_SET) == 0)
+  JASSERT(offset != -1)
     (fd) (JASSERT_ERRNO) (jalib::Filesystem::GetDeviceName(fd));
-  JASSERT(lseek(destFd, 0, SEEK_SET) == 0) (destFd) (JASSERT_ERRNO);
+  struct stat st;
+  JASSERT(fstat(destFd, &st) == 0) (destFd) (JASSERT_ERRNO);
+  off_t copied = st.st_size == 0 ? copyFileInKernel(fd, destFd) : 0;
+
+  // Copy whatever the kernel couldn't.
+  JASSERT(lseek(fd, copied, SEEK_SET) == copied)
+    (fd) (JASSERT_ERRNO) (jalib::Filesystem::GetDeviceName(fd));
+  JASSERT(lseek(destFd, copied, SEEK_SET) == copied) (destFd) (JASSERT_ERRNO);
 
+  char *buf = (char *)JALLOC_HELPER_MALLOC(bufSize);
   int readBytes, writtenBytes;
   while (1) {
     readBytes = Util::readAll(fd, buf, bufSize);
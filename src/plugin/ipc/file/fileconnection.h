@@ -147,6 +147,14 @@ class FileConnection : public Connection
     uint64_t _st_dev;
     uint64_t _st_ino;
     int64_t _st_size;
+
+    // Hashes of the blocks of the checkpointed copy at _hashedFilePath.  The
+    // next checkpoint only rewrites the blocks that changed, provided that
+    // the copy still has the size and mtime recorded here.
+    vector<uint64_t> _blockHashes;
+    string _hashedFilePath;
+    int64_t _hashedFileSize;
+    int64_t _hashedFileMtime;
 };
 
 class FifoConnection : public Connection
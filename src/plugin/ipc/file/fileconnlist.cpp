@@ -384,6 +384,9 @@ FileConnList::resume(bool isRestart)
 void
 FileConnList::prepareShmList()
 {
+  // This takes its own snapshot rather than sharing the one the checkpoint
+  // writer uses: the loop below remaps the shared areas it finds (and
+  // allocates), so the writer has to see the layout as it is afterwards.
   ProcSelfMaps procSelfMaps;
   ProcMapsArea area;
 
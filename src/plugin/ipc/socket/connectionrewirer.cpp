@@ -22,12 +22,15 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "jsocket.h"
 #include "dmtcp.h"
 #include "protectedfds.h"
+#include "shareddata.h"
 #include "util.h"
 #include "base64.h"
 #include "kvdb.h"
@@ -39,6 +42,18 @@
 using namespace dmtcp;
 constexpr char const *PeerDiscoveryDbRestart = "/plugin/socket/rst";
 
+// Limits the number of outgoing connects in flight at restart.  Without a
+// limit, a large job floods the listen queues of its peers and the dropped
+// SYNs are only retransmitted after a second or more.
+#define ENV_VAR_RESTORE_MAX_CONNECTS "DMTCP_RESTORE_MAX_CONNECTS"
+#define DEFAULT_MAX_CONNECTS         256
+
+#define REWIRER_MAX_EVENTS           64
+
+// Delay before retrying a connect to a UNIX domain socket with a full
+// listen queue.
+#define RETRY_CONNECT_DELAY_MS       10
+
 // FIXME: IP6 Support disabled for now. However, we do go through the exercise
 // of creating the restore socket and all.
 // #define ENABLE_IP6_SUPPORT
@@ -53,17 +68,6 @@ markSocketNonBlocking(int sockfd)
                       (void *)(long)(flags | O_NONBLOCK)) != -1);
 }
 
-static void
-markSocketBlocking(int sockfd)
-{
-  // Remove O_NONBLOCK flag from listener socket
-  int flags = _real_fcntl(sockfd, F_GETFL, NULL);
-
-  JASSERT(flags != -1);
-  JASSERT(_real_fcntl(sockfd, F_SETFL,
-                      (void *)(long)(flags & ~O_NONBLOCK)) != -1);
-}
-
 static ConnectionRewirer *theRewirer = NULL;
 ConnectionRewirer&
 ConnectionRewirer::instance()
@@ -86,6 +90,64 @@ ConnectionRewirer::destroy()
   theRewirer = NULL;
 }
 
+static double
+monotonicTime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Number of outgoing connects kept in flight by doReconnect().
+static size_t maxPendingConnects = DEFAULT_MAX_CONNECTS;
+
+// DMTCP_RESTORE_MAX_CONNECTS is taken from the environment of dmtcp_restart.
+// dmtcp_get_restart_env() dup()s a file descriptor, so this must run before
+// any fds are restored.
+void
+ConnectionRewirer::readRestartEnv()
+{
+  char value[32];
+
+  maxPendingConnects = DEFAULT_MAX_CONNECTS;
+  if (dmtcp_get_restart_env(ENV_VAR_RESTORE_MAX_CONNECTS, value,
+                            sizeof(value)) == RESTART_ENV_SUCCESS &&
+      atoi(value) > 0) {
+    maxPendingConnects = atoi(value);
+  }
+}
+
+// Incoming connections are restored by dup2()ing the accepted socket onto
+// their fds, which are still free.  Keep the fds opened by the rewirer above
+// all of them so that they cannot be clobbered.
+int
+ConnectionRewirer::moveAboveRestoredFds(int fd)
+{
+  int newFd = _real_fcntl(fd, F_DUPFD_CLOEXEC, (void *)(long)_minFreeFd);
+
+  JASSERT(newFd != -1) (fd) (_minFreeFd) (JASSERT_ERRNO);
+  _real_close(fd);
+  return newFd;
+}
+
+void
+ConnectionRewirer::watchFd(int fd, uint32_t events)
+{
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  if (_real_epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+    JASSERT(errno == ENOENT) (fd) (JASSERT_ERRNO);
+    JASSERT(_real_epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) == 0)
+      (fd) (JASSERT_ERRNO);
+  }
+}
+
+// Accepts all queued connections; each is restored once its peer has sent
+// the id of the connection.
 void
 ConnectionRewirer::checkForPendingIncoming(int restoreSockFd,
                                            ConnectionListT *conList)
@@ -95,70 +157,225 @@ ConnectionRewirer::checkForPendingIncoming(int restoreSockFd,
     if (fd == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
       return;
     }
+    if (fd == -1 && (errno == EINTR || errno == ECONNABORTED)) {
+      continue;
+    }
     JASSERT(fd != -1) (JASSERT_ERRNO).Text("Accept failed.");
-    ConnectionIdentifier id;
-    JASSERT(Util::readAll(fd, &id, sizeof id) == sizeof id);
+    fd = moveAboveRestoredFds(fd);
+
+    PendingAccept &pending = _accepting[fd];
+    pending.numRead = 0;
+    pending.conList = conList;
+    readIncomingId(fd);
+  }
+}
 
-    iterator i = conList->find(id);
-    JASSERT(i != conList->end()) (id)
-    .Text("got unexpected incoming restore request");
+// Returns true once the id has been read and the connection restored.
+bool
+ConnectionRewirer::readIncomingId(int fd)
+{
+  PendingAccept &pending = _accepting[fd];
+
+  while (pending.numRead < sizeof(pending.id)) {
+    ssize_t cnt = recv(fd, (char *)&pending.id + pending.numRead,
+                       sizeof(pending.id) - pending.numRead, MSG_DONTWAIT);
+    if (cnt > 0) {
+      pending.numRead += cnt;
+    } else if (cnt == -1 && errno == EINTR) {
+      continue;
+    } else {
+      JASSERT(cnt == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        (fd) (cnt) (JASSERT_ERRNO)
+      .Text("Peer closed restore connection before sending its id");
+      watchFd(fd, EPOLLIN);
+      return false;
+    }
+  }
 
-    (i->second)->restoreDupFds(fd);
+  _real_epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
 
-    JTRACE("restoring incoming connection") (id);
-    conList->erase(i);
+  iterator i = pending.conList->find(pending.id);
+  JASSERT(i != pending.conList->end()) (pending.id)
+  .Text("got unexpected incoming restore request");
+
+  (i->second)->restoreDupFds(fd);
+
+  JTRACE("restoring incoming connection") (pending.id);
+  pending.conList->erase(i);
+  _accepting.erase(fd);
+  return true;
+}
+
+// Issues a non-blocking connect.  Returns true if the connection could be
+// restored right away.
+bool
+ConnectionRewirer::startConnect(int fd)
+{
+  PendingConnect &pending = _connecting[fd];
+  struct RemoteAddr &remoteAddr = _remoteInfo[pending.id];
+
+  if (_real_connect(fd, (sockaddr *)&remoteAddr.addr, remoteAddr.len) == 0) {
+    return finishConnect(fd);
   }
+
+  if (errno == EAGAIN) {
+    // The listen queue of a UNIX domain socket is full.
+    _retryConnects.push_back(fd);
+    return false;
+  }
+
+  JASSERT(errno == EINPROGRESS || errno == EINTR)
+    (pending.id) (JASSERT_ERRNO).Text("failed to restore connection");
+  watchFd(fd, EPOLLOUT);
+  return false;
 }
 
+// Sends our id once the connect has completed.  Returns true once the
+// connection is restored.
+bool
+ConnectionRewirer::finishConnect(int fd)
+{
+  PendingConnect &pending = _connecting[fd];
+
+  if (pending.numSent == 0) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    JASSERT(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0)
+      (fd) (JASSERT_ERRNO);
+    errno = err;
+    JASSERT(err == 0) (pending.id) (JASSERT_ERRNO)
+    .Text("failed to restore connection");
+  }
+
+  while (pending.numSent < sizeof(pending.id)) {
+    ssize_t cnt = send(fd, (char *)&pending.id + pending.numSent,
+                       sizeof(pending.id) - pending.numSent,
+                       MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (cnt > 0) {
+      pending.numSent += cnt;
+    } else if (cnt == -1 && errno == EINTR) {
+      continue;
+    } else {
+      JASSERT(cnt == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        (pending.id) (JASSERT_ERRNO).Text("failed to restore connection");
+      watchFd(fd, EPOLLOUT);
+      return false;
+    }
+  }
+
+  _real_epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+  JASSERT(_real_fcntl(fd, F_SETFL, (void *)(long)pending.flags) != -1)
+    (fd) (JASSERT_ERRNO);
+
+  JTRACE("restored outgoing connection") (pending.id);
+  _connecting.erase(fd);
+  return true;
+}
+
+// All outgoing connects are issued without waiting for each other, paced by
+// DMTCP_RESTORE_MAX_CONNECTS, while the incoming connections are accepted
+// from the same epoll loop.  Wiring up the computation thus takes about one
+// round trip rather than one per connection.
 void
 ConnectionRewirer::doReconnect()
 {
-  iterator i;
-
-  for (i = _pendingOutgoing.begin(); i != _pendingOutgoing.end(); i++) {
-    const ConnectionIdentifier &id = i->first;
-    Connection *con = i->second;
-    struct RemoteAddr &remoteAddr = _remoteInfo[id];
-    int fd = con->getFds()[0];
-    errno = 0;
-    JASSERT(_real_connect(fd, (sockaddr *)&remoteAddr.addr, remoteAddr.len)
-            == 0)
-      (id) (JASSERT_ERRNO).Text("failed to restore connection");
-
-    Util::writeAll(fd, &id, sizeof id);
-
-    checkForPendingIncoming(PROTECTED_RESTORE_IP4_SOCK_FD,
-                            &_pendingIP4Incoming);
-    checkForPendingIncoming(PROTECTED_RESTORE_IP6_SOCK_FD,
-                            &_pendingIP6Incoming);
-    checkForPendingIncoming(PROTECTED_RESTORE_UDS_SOCK_FD,
-                            &_pendingUDSIncoming);
+  double startTime = monotonicTime();
+  size_t maxConnects = maxPendingConnects;
+  size_t numOutgoing = _pendingOutgoing.size();
+  size_t numIncoming = _pendingIP4Incoming.size() +
+    _pendingIP6Incoming.size() + _pendingUDSIncoming.size();
+
+  ConnectionListT *incoming[] = {
+    &_pendingIP4Incoming, &_pendingIP6Incoming, &_pendingUDSIncoming
+  };
+  _minFreeFd = 0;
+  for (size_t n = 0; n < sizeof(incoming) / sizeof(incoming[0]); n++) {
+    for (iterator i = incoming[n]->begin(); i != incoming[n]->end(); ++i) {
+      const vector<int> &fds = i->second->getFds();
+      for (size_t k = 0; k < fds.size(); k++) {
+        _minFreeFd = std::max(_minFreeFd, fds[k] + 1);
+      }
+    }
   }
-  _pendingOutgoing.clear();
-  _remoteInfo.clear();
+
+  _epollFd = _real_epoll_create1(EPOLL_CLOEXEC);
+  JASSERT(_epollFd != -1) (JASSERT_ERRNO);
+  _epollFd = moveAboveRestoredFds(_epollFd);
 
   if (_pendingIP4Incoming.size() > 0) {
-    // Add O_NONBLOCK flag to the listener sockets.
-    markSocketBlocking(PROTECTED_RESTORE_IP4_SOCK_FD);
-    checkForPendingIncoming(PROTECTED_RESTORE_IP4_SOCK_FD,
-                            &_pendingIP4Incoming);
-    _real_close(PROTECTED_RESTORE_IP4_SOCK_FD);
+    watchFd(PROTECTED_RESTORE_IP4_SOCK_FD, EPOLLIN);
   }
   if (_pendingIP6Incoming.size() > 0) {
-    // Add O_NONBLOCK flag to the listener sockets.
-    markSocketBlocking(PROTECTED_RESTORE_IP6_SOCK_FD);
-    checkForPendingIncoming(PROTECTED_RESTORE_IP6_SOCK_FD,
-                            &_pendingIP6Incoming);
-    _real_close(PROTECTED_RESTORE_IP6_SOCK_FD);
+    watchFd(PROTECTED_RESTORE_IP6_SOCK_FD, EPOLLIN);
   }
   if (_pendingUDSIncoming.size() > 0) {
-    // Add O_NONBLOCK flag to the listener sockets.
-    markSocketBlocking(PROTECTED_RESTORE_UDS_SOCK_FD);
-    checkForPendingIncoming(PROTECTED_RESTORE_UDS_SOCK_FD,
-                            &_pendingUDSIncoming);
-    _real_close(PROTECTED_RESTORE_UDS_SOCK_FD);
+    watchFd(PROTECTED_RESTORE_UDS_SOCK_FD, EPOLLIN);
   }
-  JTRACE("Closed restore sockets");
+
+  iterator next = _pendingOutgoing.begin();
+  struct epoll_event events[REWIRER_MAX_EVENTS];
+  for (;;) {
+    while (next != _pendingOutgoing.end() &&
+           _connecting.size() < maxConnects) {
+      int fd = next->second->getFds()[0];
+      PendingConnect &pending = _connecting[fd];
+      pending.id = next->first;
+      pending.numSent = 0;
+      pending.flags = _real_fcntl(fd, F_GETFL, NULL);
+      JASSERT(pending.flags != -1) (fd) (JASSERT_ERRNO);
+      JASSERT(_real_fcntl(fd, F_SETFL,
+                          (void *)(long)(pending.flags | O_NONBLOCK)) != -1)
+        (fd) (JASSERT_ERRNO);
+      ++next;
+      startConnect(fd);
+    }
+
+    if (next == _pendingOutgoing.end() && _connecting.empty() &&
+        _pendingIP4Incoming.empty() && _pendingIP6Incoming.empty() &&
+        _pendingUDSIncoming.empty()) {
+      break;
+    }
+
+    int timeout = _retryConnects.empty() ? -1 : RETRY_CONNECT_DELAY_MS;
+    int numEvents = _real_epoll_wait(_epollFd, events, REWIRER_MAX_EVENTS,
+                                     timeout);
+    if (numEvents == -1) {
+      JASSERT(errno == EINTR) (JASSERT_ERRNO);
+      continue;
+    }
+
+    for (int k = 0; k < numEvents; k++) {
+      int fd = events[k].data.fd;
+      if (fd == PROTECTED_RESTORE_IP4_SOCK_FD) {
+        checkForPendingIncoming(fd, &_pendingIP4Incoming);
+      } else if (fd == PROTECTED_RESTORE_IP6_SOCK_FD) {
+        checkForPendingIncoming(fd, &_pendingIP6Incoming);
+      } else if (fd == PROTECTED_RESTORE_UDS_SOCK_FD) {
+        checkForPendingIncoming(fd, &_pendingUDSIncoming);
+      } else if (_connecting.find(fd) != _connecting.end()) {
+        finishConnect(fd);
+      } else if (_accepting.find(fd) != _accepting.end()) {
+        readIncomingId(fd);
+      }
+    }
+
+    vector<int> retry;
+    retry.swap(_retryConnects);
+    for (size_t k = 0; k < retry.size(); k++) {
+      startConnect(retry[k]);
+    }
+  }
+
+  _real_close(_epollFd);
+  _epollFd = -1;
+  _pendingOutgoing.clear();
+  _remoteInfo.clear();
+
+  double elapsed = monotonicTime() - startTime;
+  JTRACE("restored connections") (numOutgoing) (numIncoming) (maxConnects)
+    (elapsed);
+  dmtcp_report_worker_stat("restore_connections", numOutgoing + numIncoming);
+  dmtcp_report_worker_stat("restore_reconnect_seconds", elapsed);
 }
 
 void
@@ -181,7 +398,7 @@ ConnectionRewirer::openRestoreSocket(bool hasIPv4Sock,
     // sockAddr is introducted to create the JServerSock and also to initialize
     // _ip4RestoreAddr later.
     jalib::JSockAddr sockAddr(jalib::JSockAddr::ANY);
-    jalib::JServerSocket restoreSocket(sockAddr, 0);
+    jalib::JServerSocket restoreSocket(sockAddr, 0, SOMAXCONN);
     JASSERT(restoreSocket.isValid());
     restoreSocket.changeFd(PROTECTED_RESTORE_IP4_SOCK_FD);
 
@@ -213,7 +430,7 @@ ConnectionRewirer::openRestoreSocket(bool hasIPv4Sock,
     JASSERT(getsockname(ip6fd, (struct sockaddr *)&_ip6RestoreAddr,
                         &_ip6RestoreAddrlen) == 0)
       (JASSERT_ERRNO);
-    JASSERT(_real_listen(ip6fd, 32) == 0) (JASSERT_ERRNO);
+    JASSERT(_real_listen(ip6fd, SOMAXCONN) == 0) (JASSERT_ERRNO);
     Util::changeFd(ip6fd, PROTECTED_RESTORE_IP6_SOCK_FD);
 
     JTRACE("opened ip6 listen socket") (PROTECTED_RESTORE_IP6_SOCK_FD);
@@ -234,7 +451,7 @@ ConnectionRewirer::openRestoreSocket(bool hasIPv4Sock,
     JASSERT(_real_bind(udsfd, (struct sockaddr *)&_udsRestoreAddr,
                        _udsRestoreAddrlen) == 0)
       (JASSERT_ERRNO);
-    JASSERT(_real_listen(udsfd, 32) == 0) (JASSERT_ERRNO);
+    JASSERT(_real_listen(udsfd, SOMAXCONN) == 0) (JASSERT_ERRNO);
     Util::changeFd(udsfd, PROTECTED_RESTORE_UDS_SOCK_FD);
 
     JTRACE("opened UDS listen socket")
@@ -276,36 +493,104 @@ ConnectionRewirer::registerOutgoing(const ConnectionIdentifier &remote,
   JTRACE("announcing pending outgoing") (remote);
 }
 
+// Returns true for an outgoing AF_UNIX connection.
+static bool
+isUDSConnection(Connection *con)
+{
+  return ((TcpConnection *)con)->sockDomain() == AF_UNIX;
+}
+
+// Announces the AF_UNIX connections of this process in the shared area, the
+// accepting ends with the address of our UDS restore socket.  A connection
+// whose two ends are announced on this node skips the coordinator: the
+// connecting end finds the restore socket in the shared area.  It still
+// connects through it, so that the addresses and peer credentials seen by
+// the application are the same as for any other restored connection.
+// Called before the local barrier that precedes registerNSData().
+void
+ConnectionRewirer::registerLocalSockets()
+{
+  SharedData::LocalSockMap map;
+  vector<SharedData::LocalSockMap> maps;
+
+  memset(&map, 0, sizeof(map));
+  if (!_pendingUDSIncoming.empty()) {
+    map.isAcceptEnd = 1;
+    memcpy(&map.addr, &_udsRestoreAddr, _udsRestoreAddrlen);
+    map.len = _udsRestoreAddrlen;
+    for (iterator i = _pendingUDSIncoming.begin();
+         i != _pendingUDSIncoming.end(); ++i) {
+      memcpy(map.id, &i->first, CON_ID_LEN);
+      maps.push_back(map);
+    }
+  }
+
+  memset(&map, 0, sizeof(map));
+  for (iterator i = _pendingOutgoing.begin(); i != _pendingOutgoing.end();
+       ++i) {
+    if (isUDSConnection(i->second)) {
+      memcpy(map.id, &i->first, CON_ID_LEN);
+      maps.push_back(map);
+    }
+  }
+
+  if (!maps.empty()) {
+    SharedData::registerLocalSockets(maps);
+  }
+}
+
+// The addresses of all restore sockets are published with one request, and
+// looked up with another, to spare the coordinator a message per connection.
 void
 ConnectionRewirer::registerNSData()
 {
+  double startTime = monotonicTime();
+  map<string, string> kvmap;
+
+  // The peers on this node look up our UDS restore socket in the shared
+  // area; see registerLocalSockets().
+  ConnectionListT remoteUDSIncoming;
+  for (iterator i = _pendingUDSIncoming.begin();
+       i != _pendingUDSIncoming.end(); ++i) {
+    if (!SharedData::getLocalSocket(&i->first, false, NULL)) {
+      remoteUDSIncoming[i->first] = i->second;
+    }
+  }
+
   registerNSData((void *)&_ip4RestoreAddr, _ip4RestoreAddrlen,
-                 &_pendingIP4Incoming);
+                 &_pendingIP4Incoming, &kvmap);
   registerNSData((void *)&_ip6RestoreAddr, _ip6RestoreAddrlen,
-                 &_pendingIP6Incoming);
+                 &_pendingIP6Incoming, &kvmap);
   registerNSData((void *)&_udsRestoreAddr, _udsRestoreAddrlen,
-                 &_pendingUDSIncoming);
+                 &remoteUDSIncoming, &kvmap);
+
+  if (!kvmap.empty()) {
+    JASSERT(kvdb::mset(PeerDiscoveryDbRestart, kvmap) ==
+            kvdb::KVDBResponse::SUCCESS) (kvmap.size());
+  }
+
+  double elapsed = monotonicTime() - startTime;
+  JTRACE("registered restore addresses") (kvmap.size())
+    (_pendingUDSIncoming.size() - remoteUDSIncoming.size()) (elapsed);
+  dmtcp_report_worker_stat("restore_register_seconds", elapsed);
 }
 
 void
 ConnectionRewirer::registerNSData(void *addr,
                                   socklen_t addrLen,
-                                  ConnectionListT *conList)
+                                  ConnectionListT *conList,
+                                  map<string, string> *kvmap)
 {
   iterator i;
 
   JASSERT(theRewirer != NULL);
+  if (conList->empty()) {
+    return;
+  }
+
+  string addrStr = dmtcp::base64::encode((const char*) addr, addrLen);
   for (i = conList->begin(); i != conList->end(); ++i) {
-    const ConnectionIdentifier &id = i->first;
-    string addrStr = dmtcp::base64::encode((const char*) addr, addrLen);
-    dmtcp::kvdb::set(PeerDiscoveryDbRestart, id.toString(), addrStr);
-
-    /*
-    sockaddr_in *sn = (sockaddr_in*) &_restoreAddr;
-    unsigned short port = htons(sn->sin_port);
-    char *ip = inet_ntoa(sn->sin_addr);
-    JTRACE("Send NS information:")(id)(sn->sin_family)(port)(ip);
-    */
+    (*kvmap)[i->first.toString()] = addrStr;
   }
 
   // debugPrint();
@@ -314,26 +599,46 @@ ConnectionRewirer::registerNSData(void *addr,
 void
 ConnectionRewirer::sendQueries()
 {
+  double startTime = monotonicTime();
   iterator i;
+  vector<iterator> queried;
+  vector<string> keys;
+  vector<string> vals;
+  SharedData::LocalSockMap map;
 
   for (i = _pendingOutgoing.begin(); i != _pendingOutgoing.end(); ++i) {
+    if (isUDSConnection(i->second) &&
+        SharedData::getLocalSocket(&i->first, true, &map)) {
+      struct RemoteAddr remote;
+      memcpy(&remote.addr, &map.addr, map.len);
+      remote.len = map.len;
+      remote.con = i->second;
+      _remoteInfo[i->first] = remote;
+    } else {
+      queried.push_back(i);
+      keys.push_back(i->first.toString());
+    }
+  }
+  if (!keys.empty()) {
+    JASSERT(kvdb::mget(PeerDiscoveryDbRestart, keys, &vals) ==
+            kvdb::KVDBResponse::SUCCESS) (keys.size());
+  }
+
+  for (size_t n = 0; n < queried.size(); n++) {
+    i = queried[n];
     const ConnectionIdentifier &id = i->first;
     struct RemoteAddr remote;
-    string val;
-    JASSERT(kvdb::get(PeerDiscoveryDbRestart, id.toString(), &val) ==
-            kvdb::KVDBResponse::SUCCESS);
-    string valBinary = dmtcp::base64::decode(val);
+    string valBinary = dmtcp::base64::decode(vals[n]);
+    JASSERT(valBinary.size() <= sizeof(remote.addr)) (id) (valBinary.size());
     memcpy(&remote.addr, valBinary.data(), valBinary.size());
     remote.len = valBinary.size();
-
-    /*
-    sockaddr_in *sn = (sockaddr_in*) &remote.addr;
-    unsigned short port = htons(sn->sin_port);
-    char *ip = inet_ntoa(sn->sin_addr);
-    JTRACE("Send Queries. Get remote from coordinator:")(id)(sn->sin_family)(port)(ip);
-    */
+    remote.con = i->second;
     _remoteInfo[id] = remote;
   }
+
+  double elapsed = monotonicTime() - startTime;
+  JTRACE("looked up restore addresses") (keys.size()) (elapsed);
+  dmtcp_report_worker_stat("restore_query_seconds", elapsed);
 }
 
 #if 0
@@ -43,14 +43,18 @@ class ConnectionRewirer
       Connection *con;
     };
 
+    ConnectionRewirer() : _epollFd(-1), _minFreeFd(0) {}
+
     static ConnectionRewirer &instance();
     static void destroy();
+    static void readRestartEnv();
 
     void openRestoreSocket(bool hasIPv4, bool hasIPv6, bool hasUNIX);
     void registerIncoming(const ConnectionIdentifier &local,
                           Connection *con,
                           int domain);
     void registerOutgoing(const ConnectionIdentifier &remote, Connection *con);
+    void registerLocalSockets();
     void registerNSData();
     void sendQueries();
     void doReconnect();
@@ -59,7 +63,29 @@ class ConnectionRewirer
     void debugPrint() const;
 
   private:
-    void registerNSData(void *addr, socklen_t len, ConnectionListT *conList);
+    // An outgoing connection whose non-blocking connect() is in progress.
+    struct PendingConnect {
+      ConnectionIdentifier id;
+      int flags;        // File status flags to restore once connected.
+      size_t numSent;   // Bytes of the id sent to the peer so far.
+    };
+
+    // An accepted connection whose peer has not yet sent its full id.
+    struct PendingAccept {
+      ConnectionIdentifier id;
+      size_t numRead;
+      ConnectionListT *conList;
+    };
+
+    void registerNSData(void *addr,
+                        socklen_t len,
+                        ConnectionListT *conList,
+                        map<string, string> *kvmap);
+    bool startConnect(int fd);
+    bool finishConnect(int fd);
+    bool readIncomingId(int fd);
+    int moveAboveRestoredFds(int fd);
+    void watchFd(int fd, uint32_t events);
 
     struct sockaddr_in _ip4RestoreAddr;
     socklen_t _ip4RestoreAddrlen;
@@ -79,6 +105,12 @@ class ConnectionRewirer
 
     ConnectionListT _pendingOutgoing;
     RemoteInfoT _remoteInfo;
+
+    map<int, PendingConnect>_connecting;
+    map<int, PendingAccept>_accepting;
+    vector<int>_retryConnects;
+    int _epollFd;
+    int _minFreeFd;
 };
 }
 #endif // ifndef CONNECTIONREWIRER_H
@@ -19,16 +19,25 @@
  *  <http://www.gnu.org/licenses/>.                                         *
  ****************************************************************************/
 
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include "kernelbufferdrainer.h"
 #include "../jalib/jassert.h"
-#include "../jalib/jbuffer.h"
 #include "connectionlist.h"
 #include "connectionmessage.h"
+#include "socketconnection.h"
+#include "socketconnlist.h"
 #include "socketwrappers.h"
 #include "util.h"
 
 #define SOCKET_DRAIN_MAGIC_COOKIE_STR "[dmtcp{v0<DRAIN!"
 
+// Smallest read issued while draining, and the number of epoll events
+// handled per wakeup.
+#define DRAINER_MIN_READ   (64 * 1024)
+#define DRAINER_MAX_EVENTS 64
+
 using namespace dmtcp;
 
 const char theMagicDrainCookie[] = SOCKET_DRAIN_MAGIC_COOKIE_STR;
@@ -52,6 +61,15 @@ scaleSendBuffers(int fd, double factor)
                            len) == 0);
 }
 
+static double
+monotonicTime()
+{
+  struct timespec ts;
+
+  JASSERT(clock_gettime(CLOCK_MONOTONIC, &ts) == 0) (JASSERT_ERRNO);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 static KernelBufferDrainer *theDrainer = NULL;
 KernelBufferDrainer&
 KernelBufferDrainer::instance()
@@ -63,180 +81,495 @@ KernelBufferDrainer::instance()
 }
 
 void
-KernelBufferDrainer::onConnect(const jalib::JSocket &sock,
-                               const struct sockaddr *remoteAddr,
-                               socklen_t remoteLen)
+KernelBufferDrainer::beginDrainOf(int fd, const ConnectionIdentifier &id)
 {
-  JWARNING(false) (sock.sockfd())
-  .Text("we don't yet support checkpointing non-accepted connections..."
-        " restore will likely fail.. closing connection");
-  jalib::JSocket(sock).close();
+  DrainState &state = _drainStates[fd];
+  state.id = id;
+  state.startTime = monotonicTime();
+
+  // Size the buffer for what is already queued; the cookie follows it.
+  vector<char> &buffer = _drainedData[fd];
+  int queued = 0;
+  if (ioctl(fd, FIONREAD, &queued) == 0 && queued > 0) {
+    buffer.reserve(queued + sizeof(theMagicDrainCookie));
+  }
 }
 
 void
-KernelBufferDrainer::onData(jalib::JReaderInterface *sock)
+KernelBufferDrainer::addListenSocket(int fd)
 {
-  vector<char> &buffer = _drainedData[sock->socket().sockfd()];
-  buffer.resize(buffer.size() + sock->bytesRead());
-  int startIdx = buffer.size() - sock->bytesRead();
-  memcpy(&buffer[startIdx], sock->buffer(), sock->bytesRead());
+  _listenSockets.push_back(fd);
+}
 
-  // JTRACE("got buffer chunk") (sock->bytesRead());
-  sock->reset();
+// Sends as much of the cookie as the socket buffer accepts.  Returns true
+// once the whole cookie has been sent (or the socket has failed; the error
+// then shows up on the read side).
+bool
+KernelBufferDrainer::sendCookie(int fd, DrainState *state)
+{
+  while (state->cookieSent < sizeof(theMagicDrainCookie)) {
+    ssize_t cnt = send(fd,
+                       theMagicDrainCookie + state->cookieSent,
+                       sizeof(theMagicDrainCookie) - state->cookieSent,
+                       MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (cnt > 0) {
+      state->cookieSent += cnt;
+    } else if (cnt == -1 && errno == EINTR) {
+      continue;
+    } else if (cnt == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return false;
+    } else {
+      JTRACE("failed to send drain cookie") (fd) (JASSERT_ERRNO);
+      state->cookieSent = sizeof(theMagicDrainCookie);
+    }
+  }
+  return true;
 }
 
-void
-KernelBufferDrainer::onDisconnect(jalib::JReaderInterface *sock)
+// Appends everything queued on the socket to 'buffer'.  Returns false if the
+// peer has disconnected.
+bool
+KernelBufferDrainer::readAvailable(int fd, vector<char> *buffer)
 {
-  int fd;
+  for (;;) {
+    int queued = 0;
+    if (ioctl(fd, FIONREAD, &queued) == -1 || queued < DRAINER_MIN_READ) {
+      queued = DRAINER_MIN_READ;
+    }
+
+    size_t oldSize = buffer->size();
+    if (buffer->capacity() < oldSize + queued) {
+      buffer->reserve(std::max(2 * buffer->capacity(), oldSize + queued));
+    }
+    buffer->resize(oldSize + queued);
 
-  errno = 0;
-  fd = sock->socket().sockfd();
+    ssize_t cnt = recv(fd, &(*buffer)[oldSize], queued, MSG_DONTWAIT);
+    buffer->resize(oldSize + (cnt > 0 ? cnt : 0));
 
-  // check if this was on purpose
-  if (fd < 0) {
-    return;
+    if (cnt == 0) {
+      return false;
+    } else if (cnt == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    } else if (cnt < queued) {
+      return true;
+    }
   }
+}
+
+void
+KernelBufferDrainer::onCookieReceived(int fd, DrainState *state)
+{
+  vector<char> &buffer = _drainedData[fd];
+  buffer.resize(buffer.size() - sizeof(theMagicDrainCookie));
+
+  double elapsed = monotonicTime() - state->startTime;
+  JTRACE("buffer drain complete") (fd) (state->id) (buffer.size()) (elapsed)
+    (elapsed > 0 ? buffer.size() / elapsed / (1024 * 1024) : 0);
+  _numDrainedBytes += buffer.size();
+  if (elapsed > _slowestDrainTime) {
+    _slowestDrainTime = elapsed;
+    _slowestDrainBytes = buffer.size();
+  }
+  state->isDrained = true;
+}
+
+// Registers the socket for the events it still waits for: EPOLLIN until the
+// peer's cookie arrives and EPOLLOUT until our cookie has been sent.  A
+// socket waiting for neither is done.
+void
+KernelBufferDrainer::updateEvents(int fd, DrainState *state)
+{
+  bool cookieSent = state->cookieSent == sizeof(theMagicDrainCookie);
+  uint32_t events = (state->isDrained ? 0 : (uint32_t)EPOLLIN) |
+    (cookieSent ? 0 : (uint32_t)EPOLLOUT);
+
+  if (events == 0) {
+    state->isDone = true;
+    _real_epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+    _numPending--;
+  } else if (events != state->events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    JASSERT(_real_epoll_ctl(_epollFd,
+                            state->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+                            fd, &ev) == 0) (fd) (JASSERT_ERRNO);
+    state->events = events;
+  }
+}
+
+void
+KernelBufferDrainer::onDisconnect(int fd, DrainState *state)
+{
   JTRACE("found disconnected socket... marking it dead")
-    (fd) (_reverseLookup[fd]) (JASSERT_ERRNO);
-  _disconnectedSockets[_reverseLookup[fd]] = _drainedData[fd];
+    (fd) (state->id) (JASSERT_ERRNO);
+  _disconnectedSockets[state->id] = _drainedData[fd];
 
   // _drainedData is used to refill socket buffers. Remove the disconnected
   // socket from this list. Disconnected sockets are refilled when they are
   // recreated by _makeDeadSocket().
   _drainedData.erase(fd);
+
+  state->isDone = true;
+  _real_epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+  _real_close(fd);
+  _numPending--;
 }
 
 void
-KernelBufferDrainer::onTimeoutInterval()
-{
-  int count = 0;
-
-  for (size_t i = 0; i < _dataSockets.size(); ++i) {
-    if (_dataSockets[i]->bytesRead() > 0) {
-      onData(_dataSockets[i]);
-    }
-    vector<char> &buffer = _drainedData[_dataSockets[i]->socket().sockfd()];
-    if (buffer.size() >= sizeof(theMagicDrainCookie)
-        && memcmp(&buffer[buffer.size() - sizeof(theMagicDrainCookie)],
-                  theMagicDrainCookie,
-                  sizeof(theMagicDrainCookie)) == 0) {
-      buffer.resize(buffer.size() - sizeof(theMagicDrainCookie));
-      JTRACE("buffer drain complete") (_dataSockets[i]->socket().sockfd())
-        (buffer.size()) ((_dataSockets.size()));
-      _dataSockets[i]->socket() = -1; // poison socket
-    } else {
-      ++count;
-    }
-  }
-
-  if (count == 0) {
-    _listenSockets.clear();
-  } else {
-    const static int WARN_INTERVAL_TICKS =
-      (int)(DRAINER_WARNING_FREQ / DRAINER_CHECK_FREQ + 0.5);
-    const static float WARN_INTERVAL_SEC =
-      WARN_INTERVAL_TICKS * DRAINER_CHECK_FREQ;
-    if (_timeoutCount++ > WARN_INTERVAL_TICKS) {
-      _timeoutCount = 0;
-      for (size_t i = 0; i < _dataSockets.size(); ++i) {
-        vector<char> &buffer = _drainedData[_dataSockets[i]->socket().sockfd()];
-        JWARNING(false) (_dataSockets[i]->socket().sockfd())
-          (buffer.size()) (WARN_INTERVAL_SEC)
-        .Text("Still draining socket... "
-              "perhaps remote host is not running under DMTCP?");
+KernelBufferDrainer::warnPendingSockets(double elapsed)
+{
+  map<int, DrainState>::iterator i;
+  for (i = _drainStates.begin(); i != _drainStates.end(); ++i) {
+    if (i->second.isDone) {
+      continue;
+    }
+    JWARNING(false) (i->first) (_drainedData[i->first].size()) (elapsed)
+    .Text("Still draining socket... "
+          "perhaps remote host is not running under DMTCP?");
 #ifdef CERN_CMS
-        JNOTE("\n*** Closing this socket (to database?).  Please use dmtcp \n"
-              "***  plugins to gracefully handle such sockets, and re-run.\n"
-              "***  Trying a workaround for now, and hoping it doesn't fail.\n"
-             );
-        _real_close(_dataSockets[i]->socket().sockfd());
-
-        // it does it by creating a socket pair and closing one side
-        int sp[2] = { -1, -1 };
-        JASSERT(_real_socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0)
-          (JASSERT_ERRNO).Text("socketpair() failed");
-        JASSERT(sp[0] >= 0 && sp[1] >= 0) (sp[0]) (sp[1])
-        .Text("socketpair() failed");
-        _real_close(sp[1]);
-        JTRACE("created dead socket") (sp[0]);
-        _real_dup2(sp[0], _dataSockets[i]->socket().sockfd());
+    JNOTE("\n*** Closing this socket (to database?).  Please use dmtcp \n"
+          "***  plugins to gracefully handle such sockets, and re-run.\n"
+          "***  Trying a workaround for now, and hoping it doesn't fail.\n"
+         );
+    _real_epoll_ctl(_epollFd, EPOLL_CTL_DEL, i->first, NULL);
+    _real_close(i->first);
+
+    // it does it by creating a socket pair and closing one side
+    int sp[2] = { -1, -1 };
+    JASSERT(_real_socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0)
+      (JASSERT_ERRNO).Text("socketpair() failed");
+    JASSERT(sp[0] >= 0 && sp[1] >= 0) (sp[0]) (sp[1])
+    .Text("socketpair() failed");
+    _real_close(sp[1]);
+    JTRACE("created dead socket") (sp[0]);
+    _real_dup2(sp[0], i->first);
+    i->second.cookieSent = sizeof(theMagicDrainCookie);
+    i->second.events = 0;
+    updateEvents(i->first, &i->second);
 #endif // ifdef CERN_CMS
+  }
+}
+
+void
+KernelBufferDrainer::drainAllSockets()
+{
+  double startTime = monotonicTime();
+  double lastWarning = startTime;
+  struct epoll_event ev;
+
+  _epollFd = _real_epoll_create1(EPOLL_CLOEXEC);
+  JASSERT(_epollFd != -1) (JASSERT_ERRNO);
+
+  _numPending = 0;
+  map<int, DrainState>::iterator i;
+  for (i = _drainStates.begin(); i != _drainStates.end(); ++i) {
+    sendCookie(i->first, &i->second);
+    _numPending++;
+    updateEvents(i->first, &i->second);
+  }
+
+  // Listen sockets are only watched so that connections arriving during the
+  // drain can be refused; they don't keep the drain going.
+  for (size_t j = 0; j < _listenSockets.size(); j++) {
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = _listenSockets[j];
+    _real_epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenSockets[j], &ev);
+  }
+
+  const int timeoutMs = (int)(DRAINER_CHECK_FREQ * 1000);
+  struct epoll_event events[DRAINER_MAX_EVENTS];
+  while (_numPending > 0) {
+    int numEvents = _real_epoll_wait(_epollFd, events, DRAINER_MAX_EVENTS,
+                                     timeoutMs);
+    if (numEvents == -1) {
+      if (errno == EINTR) {
+        continue;
       }
+      JWARNING(false) (_numPending) (JASSERT_ERRNO).Text("epoll_wait failed");
+      break;
+    }
+
+    for (int k = 0; k < numEvents; k++) {
+      int fd = events[k].data.fd;
+      i = _drainStates.find(fd);
+      if (i == _drainStates.end()) {
+        int sk = _real_accept(fd, NULL, NULL);
+        if (sk != -1) {
+          JWARNING(false) (sk)
+          .Text("we don't yet support checkpointing non-accepted"
+                " connections... restore will likely fail.. closing"
+                " connection");
+          _real_close(sk);
+        }
+        continue;
+      }
+
+      DrainState &state = i->second;
+      if (state.isDone) {
+        continue;
+      }
+
+      if (events[k].events & EPOLLOUT) {
+        sendCookie(fd, &state);
+      }
+
+      // The peer sends nothing after the cookie, so it can only ever be at
+      // the end of what has been read so far; check it once per read.
+      if (!state.isDrained &&
+          (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0) {
+        vector<char> &buffer = _drainedData[fd];
+        if (!readAvailable(fd, &buffer)) {
+          onDisconnect(fd, &state);
+          continue;
+        }
+        if (buffer.size() >= sizeof(theMagicDrainCookie) &&
+            memcmp(&buffer[buffer.size() - sizeof(theMagicDrainCookie)],
+                   theMagicDrainCookie,
+                   sizeof(theMagicDrainCookie)) == 0) {
+          onCookieReceived(fd, &state);
+        }
+      }
+      updateEvents(fd, &state);
+    }
+
+    double now = monotonicTime();
+    if (_numPending > 0 && now - lastWarning > DRAINER_WARNING_FREQ) {
+      lastWarning = now;
+      warnPendingSockets(now - startTime);
     }
   }
+
+  _real_close(_epollFd);
+  _epollFd = -1;
+
+  double elapsed = monotonicTime() - startTime;
+  JTRACE("sockets drained") (_drainStates.size()) (_disconnectedSockets.size())
+    (_numDrainedBytes) (elapsed);
+
+  // The slowest socket is the one that limits the drain throughput.
+  dmtcp_report_worker_stat("socket_drain_bytes", _numDrainedBytes);
+  dmtcp_report_worker_stat("socket_drain_seconds", elapsed);
+  dmtcp_report_worker_stat("socket_drain_slowest_bytes", _slowestDrainBytes);
+  dmtcp_report_worker_stat("socket_drain_slowest_seconds", _slowestDrainTime);
 }
 
-void
-KernelBufferDrainer::beginDrainOf(int fd, const ConnectionIdentifier &id)
+// Sends as much of the header, our data and the peer's echo as the socket
+// accepts; the echo only follows once all of our data has gone out.  Returns
+// false if the peer has gone away.
+bool
+KernelBufferDrainer::sendRefill(int fd, RefillState *state)
 {
-  // JTRACE("will drain socket") (fd);
-  _drainedData[fd]; // create buffer
-  // this is the simple way:  jalib::JSocket(fd) << theMagicDrainCookie;
-  // instead used delayed write in case kernel buffer is full:
-  addWrite(new jalib::JChunkWriter(fd, theMagicDrainCookie,
-                                   sizeof theMagicDrainCookie));
+  size_t headerSize = state->isLocal ? 0 : sizeof(state->header);
+  size_t total = headerSize + state->data->size();
+
+  for (;;) {
+    const char *buf;
+    size_t len;
+    bool isEcho = false;
+    if (state->numSent < headerSize) {
+      buf = (const char *)&state->header + state->numSent;
+      len = headerSize - state->numSent;
+    } else if (state->numSent < total) {
+      buf = &(*state->data)[state->numSent - headerSize];
+      len = total - state->numSent;
+    } else if (state->numEchoSent < state->numEchoRead) {
+      buf = &state->echo[state->numEchoSent];
+      len = state->numEchoRead - state->numEchoSent;
+      isEcho = true;
+    } else {
+      return true;
+    }
+
+    ssize_t cnt = send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (cnt > 0) {
+      if (isEcho) {
+        state->numEchoSent += cnt;
+      } else {
+        state->numSent += cnt;
+      }
+    } else if (cnt == -1 && errno == EINTR) {
+      continue;
+    } else {
+      return cnt == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+  }
+}
+
+// Reads the peer's header and then exactly the number of bytes it announced;
+// anything after that is the echo of our own data and must stay queued.
+// Returns false if the peer has gone away.
+bool
+KernelBufferDrainer::recvRefill(int fd, RefillState *state)
+{
+  if (state->isLocal) {
+    return true;
+  }
+
+  for (;;) {
+    char *buf;
+    size_t len;
+    if (state->headerRead < sizeof(state->peerHeader)) {
+      buf = (char *)&state->peerHeader + state->headerRead;
+      len = sizeof(state->peerHeader) - state->headerRead;
+    } else if (state->numEchoRead < state->echo.size()) {
+      buf = &state->echo[state->numEchoRead];
+      len = state->echo.size() - state->numEchoRead;
+    } else {
+      return true;
+    }
+
+    ssize_t cnt = recv(fd, buf, len, MSG_DONTWAIT);
+    if (cnt > 0) {
+      if (state->headerRead < sizeof(state->peerHeader)) {
+        state->headerRead += cnt;
+        if (state->headerRead == sizeof(state->peerHeader)) {
+          state->peerHeader.assertValid(ConnMsg::REFILL);
+          JTRACE("repeating buffer back to peer")
+            (fd) (state->peerHeader.extraBytes);
+          state->echo.resize(state->peerHeader.extraBytes);
+        }
+      } else {
+        state->numEchoRead += cnt;
+      }
+    } else if (cnt == -1 && errno == EINTR) {
+      continue;
+    } else {
+      return cnt == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+  }
+}
 
-  // now setup a reader:
-  addDataSocket(new jalib::JChunkReader(fd, 512));
+// Registers the socket for the events its refill still waits for.  Returns
+// true once the refill of this socket is complete.
+bool
+KernelBufferDrainer::updateRefillEvents(int fd, RefillState *state)
+{
+  size_t total = (state->isLocal ? 0 : sizeof(state->header)) +
+    state->data->size();
+  bool inputDone = state->isLocal ||
+    (state->headerRead == sizeof(state->peerHeader) &&
+     state->numEchoRead == state->echo.size());
+  bool outputPending = state->numSent < total ||
+    state->numEchoSent < state->numEchoRead;
+  uint32_t events = (inputDone ? 0 : (uint32_t)EPOLLIN) |
+    (outputPending ? (uint32_t)EPOLLOUT : 0);
+
+  if (events == 0) {
+    if (state->events != 0) {
+      _real_epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    return true;
+  }
 
-  // insert it in reverse lookup
-  _reverseLookup[fd] = id;
+  if (events != state->events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    JASSERT(_real_epoll_ctl(_epollFd,
+                            state->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+                            fd, &ev) == 0) (fd) (JASSERT_ERRNO);
+    state->events = events;
+  }
+  return false;
 }
 
 void
 KernelBufferDrainer::refillAllSockets()
 {
+  double startTime = monotonicTime();
+  size_t numBytes = 0;
+  size_t numLocal = 0;
+
   JTRACE("refilling socket buffers") (_drainedData.size());
 
-  // write all buffers out
+  map<ConnectionIdentifier, int>idToFd;
   map<int, vector<char> >::iterator i;
   for (i = _drainedData.begin(); i != _drainedData.end(); ++i) {
-    int size = i->second.size();
-    JWARNING(size >= 0) (size).Text("a failed drain is in our table???");
-    if (size < 0) {
-      size = 0;
-    }
+    idToFd[_drainStates[i->first].id] = i->first;
+  }
 
-    // Double the send buffer
-    scaleSendBuffers(i->first, 2);
-    ConnMsg msg(ConnMsg::REFILL);
-    msg.extraBytes = size;
-    jalib::JSocket sock(i->first);
-    if (size > 0) {
-      JTRACE("requesting repeat buffer...") (sock.sockfd()) (size);
+  // If both ends of a connection were drained here (a socketpair, or a
+  // connection to ourselves), no echo is needed: each end's data is written
+  // into the other end.  All other sockets refill through their peer, with
+  // a larger send buffer to leave room for the echo.
+  map<int, RefillState>refills;
+  for (i = _drainedData.begin(); i != _drainedData.end(); ++i) {
+    TcpConnection *con = (TcpConnection *)
+      SocketConnList::instance().getConnection(_drainStates[i->first].id);
+    map<ConnectionIdentifier, int>::iterator peer = idToFd.end();
+    if (con != NULL) {
+      peer = idToFd.find(con->remotePeerId());
     }
-    sock << msg;
-    if (size > 0) {
-      sock.writeAll(&i->second[0], size);
+
+    numBytes += i->second.size();
+    if (peer != idToFd.end() && peer->second != i->first) {
+      RefillState &state = refills[peer->second];
+      state.isLocal = true;
+      state.data = &i->second;
+      numLocal++;
+    } else {
+      RefillState &state = refills[i->first];
+      state.header = ConnMsg(ConnMsg::REFILL);
+      state.header.extraBytes = i->second.size();
+      state.data = &i->second;
+      scaleSendBuffers(i->first, 2);
+      if (i->second.size() > 0) {
+        JTRACE("requesting repeat buffer...") (i->first) (i->second.size());
+      }
     }
-    i->second.clear();
   }
 
-  // JTRACE("repeating our friends buffers...");
+  _epollFd = _real_epoll_create1(EPOLL_CLOEXEC);
+  JASSERT(_epollFd != -1) (JASSERT_ERRNO);
 
-  // read all buffers in
-  for (i = _drainedData.begin(); i != _drainedData.end(); ++i) {
-    ConnMsg msg;
-    msg.poison();
-    jalib::JSocket sock(i->first);
-    sock >> msg;
+  size_t numPending = 0;
+  map<int, RefillState>::iterator r;
+  for (r = refills.begin(); r != refills.end(); ++r) {
+    JASSERT(sendRefill(r->first, &r->second)) (r->first) (JASSERT_ERRNO)
+    .Text("Peer disconnected during refill");
+    if (!updateRefillEvents(r->first, &r->second)) {
+      numPending++;
+    }
+  }
 
-    msg.assertValid(ConnMsg::REFILL);
-    int size = msg.extraBytes;
-    JTRACE("repeating buffer back to peer") (size);
-    if (size > 0) {
-      // echo it back...
-      jalib::JBuffer tmp(size);
-      sock.readAll(tmp, size);
-      sock.writeAll(tmp, size);
+  struct epoll_event events[DRAINER_MAX_EVENTS];
+  while (numPending > 0) {
+    int numEvents = _real_epoll_wait(_epollFd, events, DRAINER_MAX_EVENTS, -1);
+    if (numEvents == -1) {
+      JASSERT(errno == EINTR) (numPending) (JASSERT_ERRNO);
+      continue;
     }
 
-    // Reset the send buffer
-    scaleSendBuffers(i->first, 0.5);
+    for (int k = 0; k < numEvents; k++) {
+      int fd = events[k].data.fd;
+      RefillState &state = refills[fd];
+      JASSERT(recvRefill(fd, &state) && sendRefill(fd, &state))
+        (fd) (JASSERT_ERRNO).Text("Peer disconnected during refill");
+      if (updateRefillEvents(fd, &state)) {
+        numPending--;
+      }
+    }
+  }
+
+  _real_close(_epollFd);
+  _epollFd = -1;
+
+  // Reset the send buffers
+  for (r = refills.begin(); r != refills.end(); ++r) {
+    if (!r->second.isLocal) {
+      scaleSendBuffers(r->first, 0.5);
+    }
   }
 
-  JTRACE("buffers refilled");
+  JTRACE("buffers refilled") (refills.size()) (numLocal) (numBytes)
+    (monotonicTime() - startTime);
 
   // Free up the object
   delete theDrainer;
@@ -26,28 +26,42 @@
 # include <map>
 # include <vector>
 
-# include "../jalib/jsocket.h"
 # include "connectionidentifier.h"
+# include "connectionmessage.h"
 # include "dmtcpalloc.h"
 
 namespace dmtcp
 {
-class KernelBufferDrainer : public jalib::JMultiSocketProgram
+/*
+ * Drains the kernel buffers of all TCP/UNIX stream sockets before a
+ * checkpoint.  Each peer sends a magic cookie after its last byte of data;
+ * the drainer reads every socket until the cookie arrives (or the peer
+ * disconnects).  The sockets are waited on with a single epoll set, and
+ * each wakeup reads everything the kernel has queued (sized with FIONREAD)
+ * directly into the per-socket buffer.
+ */
+class KernelBufferDrainer
 {
   public:
-    KernelBufferDrainer() : _timeoutCount(0) {}
+# ifdef JALIB_ALLOCATOR
+    static void *operator new(size_t nbytes, void *p) { return p; }
+
+    static void *operator new(size_t nbytes) { JALLOC_HELPER_NEW(nbytes); }
+
+    static void operator delete(void *p) { JALLOC_HELPER_DELETE(p); }
+# endif // ifdef JALIB_ALLOCATOR
+    KernelBufferDrainer()
+      : _epollFd(-1), _numPending(0), _numDrainedBytes(0),
+      _slowestDrainBytes(0), _slowestDrainTime(0) {}
 
     static KernelBufferDrainer &instance();
 
-    // void drainAllSockets();
     void beginDrainOf(int fd, const ConnectionIdentifier &id);
+    void addListenSocket(int fd);
+
+    // Blocks until every socket passed to beginDrainOf() has been drained.
+    void drainAllSockets();
     void refillAllSockets();
-    virtual void onData(jalib::JReaderInterface *sock);
-    virtual void onConnect(const jalib::JSocket &sock,
-                           const struct sockaddr *remoteAddr,
-                           socklen_t remoteLen);
-    virtual void onTimeoutInterval();
-    virtual void onDisconnect(jalib::JReaderInterface *sock);
 
     const map<ConnectionIdentifier,
               vector<char> > &getDisconnectedSockets() const
@@ -58,10 +72,63 @@ class KernelBufferDrainer : public jalib::JMultiSocketProgram
     const vector<char> &getDrainedData(ConnectionIdentifier id);
 
   private:
+    struct DrainState {
+      DrainState()
+        : cookieSent(0), events(0), isDrained(false), isDone(false),
+        startTime(0) {}
+
+      ConnectionIdentifier id;
+      size_t cookieSent;
+      uint32_t events;  // Events the socket is registered for in _epollFd.
+      bool isDrained;   // The peer's cookie has arrived.
+      bool isDone;      // ... and our own cookie has been sent.
+      double startTime;
+    };
+
+    // Refill state of one socket.  The data drained from a socket has to go
+    // back through its peer: a socket whose peer was drained by this process
+    // too ("local") gets it written into the peer directly; otherwise the
+    // data is sent to the peer after a ConnMsg::REFILL header, and the peer
+    // echoes it back.
+    struct RefillState {
+      RefillState()
+        : data(NULL), numSent(0), isLocal(false), headerRead(0),
+        numEchoRead(0), numEchoSent(0), events(0) {}
+
+      ConnMsg header;             // Our header; not sent if isLocal.
+      const vector<char> *data;   // Data to write to this socket.
+      size_t numSent;             // Bytes of header and data sent so far.
+      bool isLocal;
+
+      ConnMsg peerHeader;
+      size_t headerRead;
+      vector<char> echo;          // The peer's data, to be echoed back.
+      size_t numEchoRead;
+      size_t numEchoSent;
+      uint32_t events;
+    };
+
+    bool sendCookie(int fd, DrainState *state);
+    bool readAvailable(int fd, vector<char> *buffer);
+    void onCookieReceived(int fd, DrainState *state);
+    void updateEvents(int fd, DrainState *state);
+    void onDisconnect(int fd, DrainState *state);
+    void warnPendingSockets(double elapsed);
+    bool sendRefill(int fd, RefillState *state);
+    bool recvRefill(int fd, RefillState *state);
+    bool updateRefillEvents(int fd, RefillState *state);
+
     map<int, vector<char> >_drainedData;
-    map<int, ConnectionIdentifier>_reverseLookup;
+    map<int, DrainState>_drainStates;
+    vector<int>_listenSockets;
     map<ConnectionIdentifier, vector<char> >_disconnectedSockets;
-    int _timeoutCount;
+    int _epollFd;
+    size_t _numPending;
+
+    // Drain statistics, reported to the coordinator.
+    size_t _numDrainedBytes;
+    size_t _slowestDrainBytes;
+    double _slowestDrainTime;
 };
 }
 #endif // ifndef KERNELBUFFERDRAINER_H
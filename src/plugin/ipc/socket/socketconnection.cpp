@@ -990,3 +990,454 @@ RawSocketConnection::onConnect(const struct sockaddr *serv_addr,
   JWARNING(false).Text("Connect on raw socket type not supported...\n"
                        "Socket won't be restored");
 }
+
+/*****************************************************************************
+ * Datagram Connection
+ *****************************************************************************/
+
+// The queued datagrams are peeked in batches of DgramBatchSize messages.  A
+// slot holds any UDP datagram; larger Unix domain datagrams are read in
+// several pieces.  (UDP flags every piece but the first as truncated, so it
+// can't be read that way.)
+constexpr unsigned int DgramBatchSize = 16;
+constexpr size_t DgramSlotSize = 64 * 1024;
+
+// Multicast membership options, with the option that undoes each of them.
+// A leave drops the join with the same value or, failing that, all joins of
+// the group stored in the first groupLen bytes of the value.
+static const struct {
+  int level;
+  int join;
+  int leave;
+  size_t groupLen;
+} membershipOptions[] = {
+  { IPPROTO_IP, IP_ADD_MEMBERSHIP, IP_DROP_MEMBERSHIP,
+    sizeof(struct in_addr) },
+  { IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP, IP_DROP_SOURCE_MEMBERSHIP, 0 },
+  { IPPROTO_IP, MCAST_JOIN_GROUP, MCAST_LEAVE_GROUP, 0 },
+  { IPPROTO_IP, MCAST_JOIN_SOURCE_GROUP, MCAST_LEAVE_SOURCE_GROUP, 0 },
+  { IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, IPV6_DROP_MEMBERSHIP,
+    sizeof(struct in6_addr) },
+  { IPPROTO_IPV6, MCAST_JOIN_GROUP, MCAST_LEAVE_GROUP, 0 },
+  { IPPROTO_IPV6, MCAST_JOIN_SOURCE_GROUP, MCAST_LEAVE_SOURCE_GROUP, 0 },
+};
+
+/*onSocket*/
+DatagramConnection::DatagramConnection(int domain, int type, int protocol)
+  : Connection(DGRAM_CREATED)
+  , SocketConnection(domain, type, protocol)
+  , _peerAddrlen(0)
+{
+  JTRACE("Creating DatagramConnection.") (id()) (domain) (type) (protocol);
+  memset(&_bindAddr, 0, sizeof _bindAddr);
+  memset(&_peerAddr, 0, sizeof _peerAddr);
+}
+
+void
+DatagramConnection::addSetsockopt(int level,
+                                  int option,
+                                  const void *value,
+                                  int len)
+{
+  for (size_t i = 0; i < sizeof(membershipOptions) /
+       sizeof(membershipOptions[0]); i++) {
+    if (membershipOptions[i].level != level) {
+      continue;
+    }
+
+    if (membershipOptions[i].join == option) {
+      Membership m = { level, option, jalib::JBuffer(value, len) };
+      _memberships.push_back(m);
+      return;
+    }
+
+    if (membershipOptions[i].leave == option) {
+      int join = membershipOptions[i].join;
+      size_t groupLen = membershipOptions[i].groupLen;
+      vector<Membership>::iterator m;
+      for (m = _memberships.begin(); m != _memberships.end(); ++m) {
+        if (m->level == level && m->option == join && m->value.size() == len &&
+            memcmp(m->value.buffer(), value, len) == 0) {
+          _memberships.erase(m);
+          return;
+        }
+      }
+      for (m = _memberships.begin(); m != _memberships.end();) {
+        if (m->level == level && m->option == join && groupLen > 0 &&
+            (size_t)m->value.size() >= groupLen && (size_t)len >= groupLen &&
+            memcmp(m->value.buffer(), value, groupLen) == 0) {
+          m = _memberships.erase(m);
+        } else {
+          ++m;
+        }
+      }
+      return;
+    }
+  }
+
+  SocketConnection::addSetsockopt(level, option, value, len);
+}
+
+void
+DatagramConnection::onBind(const struct sockaddr *addr, socklen_t len)
+{
+  if (really_verbose) {
+    JTRACE("Binding.") (id()) (len);
+  }
+
+  // The address is looked up again at checkpoint time; the port may be 0
+  // here.
+  _bindAddrlen = sizeof(_bindAddr);
+  JASSERT(getsockname(_fds[0], (struct sockaddr *)&_bindAddr,
+                      &_bindAddrlen) == 0) (JASSERT_ERRNO);
+  if (_type == DGRAM_CREATED) {
+    _type = DGRAM_BIND;
+  }
+}
+
+void
+DatagramConnection::onConnect(const struct sockaddr *addr,
+                              socklen_t len,
+                              bool connectInProgress)
+{
+  if (really_verbose) {
+    JTRACE("Connecting.") (id());
+  }
+
+  if (addr == NULL || addr->sa_family == AF_UNSPEC) {
+    // Dissolves the association.
+    _peerAddrlen = 0;
+    _type = DGRAM_BIND;
+  } else {
+    JASSERT(len <= sizeof _peerAddr) (len) (sizeof _peerAddr)
+    .Text("That is one huge sockaddr buddy.");
+    _peerAddrlen = len;
+    memcpy(&_peerAddr, addr, len);
+    _type = DGRAM_CONNECT;
+  }
+}
+
+bool
+DatagramConnection::isBound() const
+{
+  switch (_bindAddr.ss_family) {
+  case AF_INET:
+    return ((struct sockaddr_in *)&_bindAddr)->sin_port != 0;
+
+  case AF_INET6:
+    return ((struct sockaddr_in6 *)&_bindAddr)->sin6_port != 0;
+
+  case AF_UNIX:
+    return _bindAddrlen > sizeof(_bindAddr.ss_family);
+  }
+  return false;
+}
+
+void
+DatagramConnection::drain()
+{
+  JASSERT(_fds.size() > 0) (id());
+
+  if ((_fcntlFlags & O_ASYNC) != 0) {
+    if (really_verbose) {
+      JTRACE("Removing O_ASYNC flag during checkpoint.") (_fds[0]) (id());
+    }
+    errno = 0;
+    JASSERT(fcntl(_fds[0], F_SETFL, _fcntlFlags & ~O_ASYNC) == 0)
+      (JASSERT_ERRNO) (_fds[0]) (id());
+  }
+
+  _queuedData.clear();
+  _queuedLens.clear();
+
+  // The kernel binds the socket implicitly on connect() or the first send,
+  // and connect() may have been undone; look both addresses up again.
+  _bindAddrlen = sizeof(_bindAddr);
+  JASSERT(getsockname(_fds[0], (struct sockaddr *)&_bindAddr,
+                      &_bindAddrlen) == 0) (_fds[0]) (JASSERT_ERRNO);
+  _peerAddrlen = sizeof(_peerAddr);
+  if (getpeername(_fds[0], (struct sockaddr *)&_peerAddr,
+                  &_peerAddrlen) != 0) {
+    _peerAddrlen = 0;
+  }
+  if (_peerAddrlen > 0) {
+    _type = DGRAM_CONNECT;
+  } else {
+    _type = isBound() ? DGRAM_BIND : DGRAM_CREATED;
+  }
+
+  if (!isBound()) {
+    // Nothing can be sent to this socket.
+    return;
+  }
+
+  errno = 0;
+  if (recv(_fds[0], NULL, 0, MSG_PEEK | MSG_DONTWAIT) == -1 &&
+      (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return;
+  }
+
+  // With SO_PEEK_OFF set, each MSG_PEEK read continues where the last one
+  // stopped, so the whole queue can be read and left in place for resume.
+  int peekOff = -1;
+  socklen_t optlen = sizeof(peekOff);
+  _real_getsockopt(_fds[0], SOL_SOCKET, SO_PEEK_OFF, &peekOff, &optlen);
+  int zero = 0;
+  if (_real_setsockopt(_fds[0], SOL_SOCKET, SO_PEEK_OFF,
+                       &zero, sizeof(zero)) != 0) {
+    JWARNING(false) (_fds[0]) (id()) (JASSERT_ERRNO)
+    .Text("Unable to peek at the queued datagrams;"
+          " they won't be checkpointed.");
+    return;
+  }
+
+  // Datagrams can keep arriving from outside the computation; stop after a
+  // receive buffer's worth.  Unix domain senders are bounded by the queue
+  // length instead.
+  size_t maxBytes = (size_t)-1;
+  if (_sockDomain != AF_UNIX) {
+    int rcvbuf = 0;
+    optlen = sizeof(rcvbuf);
+    JASSERT(_real_getsockopt(_fds[0], SOL_SOCKET, SO_RCVBUF,
+                             &rcvbuf, &optlen) == 0) (JASSERT_ERRNO);
+    maxBytes = rcvbuf;
+  }
+
+  vector<char> buf;
+  struct mmsghdr msgs[DgramBatchSize];
+  struct iovec iov[DgramBatchSize];
+  bool inDatagram = false;
+  int numErrors = 0;
+
+  while (inDatagram || _queuedData.size() < maxBytes) {
+    if (buf.empty()) {
+      buf.resize(DgramBatchSize * DgramSlotSize);
+      for (size_t i = 0; i < DgramBatchSize; i++) {
+        iov[i].iov_base = &buf[i * DgramSlotSize];
+        iov[i].iov_len = DgramSlotSize;
+      }
+    }
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < DgramBatchSize; i++) {
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(_fds[0], msgs, DgramBatchSize,
+                     MSG_PEEK | MSG_DONTWAIT, NULL);
+    if (n == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+
+      // A pending error (e.g. ICMP port unreachable) is reported once.
+      JTRACE("recvmmsg() failed") (_fds[0]) (JASSERT_ERRNO);
+      if (++numErrors > 10) {
+        break;
+      }
+      continue;
+    }
+
+    for (int i = 0; i < n; i++) {
+      // A datagram larger than a slot is returned in several pieces, all but
+      // the last with MSG_TRUNC set.
+      if (!inDatagram) {
+        _queuedLens.push_back(0);
+      }
+      _queuedData.insert(_queuedData.end(),
+                         (char *)iov[i].iov_base,
+                         (char *)iov[i].iov_base + msgs[i].msg_len);
+      _queuedLens.back() += msgs[i].msg_len;
+      inDatagram = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    }
+
+    if ((unsigned int)n < DgramBatchSize && !inDatagram) {
+      break;
+    }
+  }
+
+  JWARNING(_real_setsockopt(_fds[0], SOL_SOCKET, SO_PEEK_OFF,
+                            &peekOff, sizeof(peekOff)) == 0)
+    (_fds[0]) (peekOff) (JASSERT_ERRNO);
+
+  JTRACE("Saved queued datagrams") (_fds[0]) (id())
+    (_queuedLens.size()) (_queuedData.size());
+}
+
+void
+DatagramConnection::requeueDatagrams()
+{
+  if (_queuedLens.empty()) {
+    return;
+  }
+
+  // Send to the address the socket ended up with; a wildcard address is
+  // reached through the loopback interface.
+  struct sockaddr_storage addr;
+  socklen_t addrlen = sizeof(addr);
+  JASSERT(getsockname(_fds[0], (struct sockaddr *)&addr, &addrlen) == 0)
+    (_fds[0]) (JASSERT_ERRNO);
+
+  bool multicast = false;
+  if (addr.ss_family == AF_INET) {
+    struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+    if (in->sin_addr.s_addr == htonl(INADDR_ANY)) {
+      in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    multicast = IN_MULTICAST(ntohl(in->sin_addr.s_addr));
+  } else if (addr.ss_family == AF_INET6) {
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+    if (IN6_IS_ADDR_UNSPECIFIED(&in6->sin6_addr)) {
+      in6->sin6_addr = in6addr_loopback;
+    }
+    multicast = IN6_IS_ADDR_MULTICAST(&in6->sin6_addr);
+  }
+
+  // Sending to a group would reach its other members on this host too.
+  if (multicast) {
+    JWARNING(false) (_fds[0]) (id()) (_queuedLens.size())
+    .Text("Socket is bound to a multicast address;"
+          " its checkpointed datagrams are dropped.");
+    return;
+  }
+
+  struct mmsghdr msgs[DgramBatchSize];
+  struct iovec iov[DgramBatchSize];
+  size_t next = 0;
+  size_t offset = 0;
+  int sock = -1;
+  bool progress = false;
+
+  while (next < _queuedLens.size()) {
+    if (sock == -1) {
+      sock = _real_socket(_sockDomain, SOCK_DGRAM, 0);
+      JASSERT(sock != -1) (JASSERT_ERRNO);
+      progress = false;
+    }
+
+    unsigned int count = 0;
+    size_t batchOffset = offset;
+    memset(msgs, 0, sizeof(msgs));
+    while (count < DgramBatchSize && next + count < _queuedLens.size()) {
+      iov[count].iov_base = _queuedData.data() + batchOffset;
+      iov[count].iov_len = _queuedLens[next + count];
+      msgs[count].msg_hdr.msg_name = &addr;
+      msgs[count].msg_hdr.msg_namelen = addrlen;
+      msgs[count].msg_hdr.msg_iov = &iov[count];
+      msgs[count].msg_hdr.msg_iovlen = 1;
+      batchOffset += _queuedLens[next + count];
+      count++;
+    }
+
+    int n = sendmmsg(sock, msgs, count, MSG_DONTWAIT);
+    if (n > 0) {
+      for (int i = 0; i < n; i++) {
+        offset += _queuedLens[next++];
+      }
+      progress = true;
+      continue;
+    }
+
+    // Unix domain datagrams are charged to the sending socket until they are
+    // received; go on with a fresh socket once its send buffer is full.
+    if ((errno == EAGAIN || errno == EWOULDBLOCK) && progress) {
+      _real_close(sock);
+      sock = -1;
+      continue;
+    }
+
+    JWARNING(false) (_fds[0]) (id()) (_queuedLens.size() - next)
+      (JASSERT_ERRNO).Text("Unable to queue the checkpointed datagrams.");
+    break;
+  }
+
+  if (sock != -1) {
+    _real_close(sock);
+  }
+  JTRACE("Queued datagrams again") (_fds[0]) (id()) (next);
+}
+
+void
+DatagramConnection::postRestart()
+{
+  JASSERT(_fds.size() > 0);
+
+  if (really_verbose) {
+    JTRACE("Restoring socket.") (id()) (_fds[0]);
+  }
+
+  int fd = _real_socket(_sockDomain, _sockType, _sockProtocol);
+  JASSERT(fd != -1) (JASSERT_ERRNO);
+  restoreDupFds(fd);
+
+  // Options such as SO_REUSEADDR and SO_RCVBUF must be in place before the
+  // socket is bound and the datagrams are queued again.
+  restoreSocketOptions(_fds);
+
+  if (isBound()) {
+    if (_sockDomain == AF_UNIX) {
+      struct sockaddr_un *uaddr = (sockaddr_un *)&_bindAddr;
+      if (uaddr->sun_path[0] != '\0') {
+        JTRACE("Unlinking stale unix domain socket.") (uaddr->sun_path);
+        JWARNING(unlink(uaddr->sun_path) == 0) (uaddr->sun_path);
+      }
+    }
+
+    errno = 0;
+    JWARNING(_real_bind(_fds[0], (sockaddr *)&_bindAddr, _bindAddrlen) == 0)
+      (JASSERT_ERRNO) (id()).Text("Bind failed.");
+  }
+
+  for (size_t i = 0; i < _memberships.size(); i++) {
+    Membership &m = _memberships[i];
+    JWARNING(_real_setsockopt(_fds[0], m.level, m.option,
+                              m.value.buffer(), m.value.size()) == 0)
+      (JASSERT_ERRNO) (id()) (m.level) (m.option)
+    .Text("Unable to join multicast group.");
+  }
+
+  // A connected socket only accepts datagrams from its peer, so this must
+  // come before connect(), in refill().
+  requeueDatagrams();
+}
+
+void
+DatagramConnection::refill(bool isRestart)
+{
+  // The peer may be a Unix domain socket of a process that restores it in
+  // its own postRestart(); connect only once all of them are bound.
+  if (isRestart && _peerAddrlen > 0) {
+    errno = 0;
+    JWARNING(_real_connect(_fds[0], (sockaddr *)&_peerAddr,
+                           _peerAddrlen) == 0)
+      (JASSERT_ERRNO) (id()).Text("Connect failed.");
+  }
+
+  // The datagrams were left queued on the socket, or queued again by
+  // postRestart().
+  vector<char>().swap(_queuedData);
+  vector<uint32_t>().swap(_queuedLens);
+}
+
+void
+DatagramConnection::serializeSubClass(jalib::JBinarySerializer &o)
+{
+  JSERIALIZE_ASSERT_POINT("DatagramConnection");
+  o&_bindAddrlen&_bindAddr&_peerAddrlen &_peerAddr;
+  SocketConnection::serialize(o);
+
+  JSERIALIZE_ASSERT_POINT("Memberships:");
+  uint64_t numMemberships = _memberships.size();
+  o &numMemberships;
+  _memberships.resize(numMemberships);
+  for (size_t i = 0; i < numMemberships; i++) {
+    Membership &m = _memberships[i];
+    int64_t len = m.value.size();
+    o&m.level&m.option &len;
+    if (o.isReader()) {
+      m.value = jalib::JBuffer(len);
+    }
+    o.readOrWrite(m.value.buffer(), len);
+  }
+  JSERIALIZE_ASSERT_POINT("EndMemberships");
+}
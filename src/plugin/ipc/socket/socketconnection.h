@@ -57,11 +57,16 @@ class SocketConnection
                      int type,
                      int protocol,
                      ConnectionIdentifier remote);
-    void addSetsockopt(int level, int option, const void *value, int len);
+    virtual void addSetsockopt(int level,
+                               int option,
+                               const void *value,
+                               int len);
     void restoreSocketOptions(vector<int32_t> &fds);
     void serialize(jalib::JBinarySerializer &o);
     int sockDomain() const { return _sockDomain; }
 
+    const ConnectionIdentifier &remotePeerId() const { return _remotePeerId; }
+
     virtual void onBind(const struct sockaddr *addr, socklen_t len);
     virtual void onListen(int backlog);
     virtual void onConnect(const struct sockaddr *serv_addr = NULL,
@@ -197,5 +202,69 @@ class RawSocketConnection : public Connection, public SocketConnection
       return new RawSocketConnection(*this);
     }
 };
+
+/*
+ * UDP and Unix domain datagram sockets created with socket().  The datagrams
+ * queued on the socket are read at checkpoint time without dequeuing them,
+ * and are sent to the socket again from a temporary socket at restart,
+ * before it is reconnected.  The messages keep their boundaries, but their
+ * sender becomes that temporary socket.
+ */
+class DatagramConnection : public Connection, public SocketConnection
+{
+  public:
+    enum DgramType {
+      DGRAM_INVALID = DGRAM,
+      DGRAM_CREATED,
+      DGRAM_BIND,
+      DGRAM_CONNECT
+    };
+
+    DatagramConnection() {}
+
+    /*onSocket*/
+    DatagramConnection(int domain, int type, int protocol);
+
+    virtual void addSetsockopt(int level,
+                               int option,
+                               const void *value,
+                               int len) override;
+    virtual void onBind(const struct sockaddr *addr, socklen_t len) override;
+    virtual void onConnect(const struct sockaddr *serv_addr = NULL,
+                           socklen_t addrlen = 0,
+                           bool connectInProgress = false) override;
+
+    // basic checkpointing commands
+    virtual void drain() override;
+    virtual void refill(bool isRestart) override;
+    virtual void postRestart() override;
+
+    virtual void serializeSubClass(jalib::JBinarySerializer &o) override;
+    virtual string str() override { return "<Datagram Socket>"; }
+
+    virtual DatagramConnection* clone() override {
+      return new DatagramConnection(*this);
+    }
+
+  private:
+    bool isBound() const;
+    void requeueDatagrams();
+
+    // Multicast memberships add up, so they can't be restored from
+    // _sockOptions, which only keeps the last value of each option.
+    struct Membership {
+      int64_t level;
+      int64_t option;
+      jalib::JBuffer value;
+    };
+    vector<Membership>_memberships;
+
+    socklen_t _peerAddrlen;
+    struct sockaddr_storage _peerAddr;
+
+    // The datagrams queued at checkpoint time, stored back to back.
+    vector<char>_queuedData;
+    vector<uint32_t>_queuedLens;
+};
 }
 #endif // ifndef SOCKETCONNECTION_H
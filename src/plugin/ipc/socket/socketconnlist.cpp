@@ -67,6 +67,7 @@ dmtcp_SocketConnList_EventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
     break;
 
   case DMTCP_EVENT_RESTART:
+    ConnectionRewirer::readRestartEnv();
     SocketConnList::restart();
     dmtcp_local_barrier("Socket::Restart_Post_Restart");
 
@@ -143,7 +144,7 @@ SocketConnList::drain()
   ConnectionList::drain();
 
   // this will block until draining is complete
-  KernelBufferDrainer::instance().monitorSockets(DRAINER_CHECK_FREQ);
+  KernelBufferDrainer::instance().drainAllSockets();
 
   // handle disconnected sockets
   const map<ConnectionIdentifier, vector<char> > &discn =
@@ -211,6 +212,7 @@ SocketConnList::postRestart()
   ConnectionRewirer::instance().openRestoreSocket(_hasIPv4Sock, _hasIPv6Sock,
                                                   _hasUNIXSock);
   ConnectionList::postRestart();
+  ConnectionRewirer::instance().registerLocalSockets();
 }
 
 void
@@ -296,6 +298,8 @@ SocketConnList::createDummyConnection(int type)
     return new TcpConnection();
   } else if (type == Connection::RAW) {
     return new RawSocketConnection();
+  } else if (type == Connection::DGRAM) {
+    return new DatagramConnection();
   }
   return NULL;
 }
@@ -62,6 +62,10 @@ socket(int domain, int type, int protocol)
       JASSERT(domain == AF_NETLINK) (domain) (type)
       .Text("Only Netlink Raw sockets supported");
       con = new RawSocketConnection(domain, type, protocol);
+    } else if ((type & 077) == SOCK_DGRAM &&
+               (domain == AF_INET || domain == AF_INET6 ||
+                domain == AF_UNIX)) {
+      con = new DatagramConnection(domain, type, protocol);
     } else {
       con = new TcpConnection(domain, type, protocol);
     }
@@ -62,7 +62,7 @@ VirtualPidTable::postRestart()
 {
   VirtualIdTable<pid_t>::postRestart();
   _do_lock_tbl();
-  _idMapTable[getpid()] = _real_getpid();
+  _setMapping(getpid(), _real_getpid());
   _do_unlock_tbl();
 }
 
@@ -70,17 +70,17 @@ void
 VirtualPidTable::refresh()
 {
   id_iterator i;
-  id_iterator next;
   pid_t _real_pid = _real_getpid();
 
   JASSERT(getpid() != -1);
 
   _do_lock_tbl();
-  for (i = _idMapTable.begin(), next = i; i != _idMapTable.end(); i = next) {
-    next++;
+  for (i = _idMapTable.begin(); i != _idMapTable.end();) {
     if (isIdCreatedByCurrentProcess(i->second)
         && _real_tgkill(_real_pid, i->second, 0) == -1) {
-      _idMapTable.erase(i);
+      i = _eraseMapping(i);
+    } else {
+      ++i;
     }
   }
   _do_unlock_tbl();
@@ -107,7 +107,9 @@ VirtualPidTable::resetOnFork()
 {
   VirtualIdTable<pid_t>::resetOnFork(getpid());
   _numTids = 1;
-  _idMapTable[getpid()] = _real_getpid();
+  _do_lock_tbl();
+  _setMapping(getpid(), _real_getpid());
+  _do_unlock_tbl();
   refresh();
   printMaps();
 }
@@ -117,7 +119,7 @@ VirtualPidTable::updateMapping(pid_t virtualId, pid_t realId)
 {
   if (virtualId > 0 && realId > 0) {
     _do_lock_tbl();
-    _idMapTable[virtualId] = realId;
+    _setMapping(virtualId, realId);
     _do_unlock_tbl();
   }
 }
@@ -21,6 +21,7 @@
 
 #include "procselfmaps.h"
 #include <fcntl.h>
+#include <string.h>
 #include "jassert.h"
 #include "syscallwrappers.h"
 #include "util.h"
@@ -28,6 +29,10 @@
 using namespace dmtcp;
 
 
+// Size of the previous snapshot.  /proc/self/maps rarely changes much between
+// two snapshots, so this saves reading the file once just to size the buffer.
+static size_t lastNumBytes = 0;
+
 ProcSelfMaps::ProcSelfMaps()
   : dataIdx(0),
   numAreas(0),
@@ -56,38 +61,48 @@ ProcSelfMaps::ProcSelfMaps()
 
   fd = _real_open("/proc/self/maps", O_RDONLY);
   JASSERT(fd != -1) (JASSERT_ERRNO);
-  ssize_t numRead = 0;
 
-  // Get an approximation of the required buffer size.
-  do {
-    numRead = Util::readAll(fd, buf, sizeof(buf));
-    if (numRead > 0) {
-      numBytes += numRead;
-    }
-  } while (numRead > 0);
+  size_t estimate = lastNumBytes;
+  if (estimate == 0) {
+    // Get an approximation of the required buffer size.
+    ssize_t numRead = 0;
+    do {
+      numRead = Util::readAll(fd, buf, sizeof(buf));
+      if (numRead > 0) {
+        estimate += numRead;
+      }
+    } while (numRead > 0);
+  }
 
   // Now allocate a buffer. Note that this will most likely change the layout
-  // of /proc/self/maps, so we need to recalculate numBytes.
-  size_t size = numBytes + 4096; // Add a one page buffer.
-  data = (char *)JALLOC_HELPER_MALLOC(size);
-  JASSERT(lseek(fd, 0, SEEK_SET) == 0);
-
-  numBytes = Util::readAll(fd, data, size);
-  JASSERT(numBytes > 0 && numBytes < size) (numBytes);
-
-  // TODO(kapil): Replace this assert with more robust code that would
-  // reallocate the buffer with an extended size.
-  JASSERT(numBytes < size) (numBytes) (size);
+  // of /proc/self/maps, so we need to recalculate numBytes.  If the buffer
+  // turns out to be too small, try again with a larger one.
+  size_t size = estimate + estimate / 8 + 4096; // Add a one page buffer.
+  while (true) {
+    data = (char *)JALLOC_HELPER_MALLOC(size);
+    JASSERT(lseek(fd, 0, SEEK_SET) == 0);
+
+    ssize_t numRead = Util::readAll(fd, data, size);
+    JASSERT(numRead > 0) (numRead) (JASSERT_ERRNO);
+    numBytes = numRead;
+    if (numBytes < size) {
+      break;
+    }
+    JALLOC_HELPER_FREE(data);
+    size *= 2;
+  }
+  lastNumBytes = numBytes;
 
   // TODO(kapil): Validate the read data.
   JASSERT(isValidData());
 
   _real_close(fd);
 
-  for (size_t i = 0; i < numBytes; i++) {
-    if (data[i] == '\n') {
-      numAreas++;
-    }
+  const char *p = data;
+  const char *end = data + numBytes;
+  while ((p = (const char *)memchr(p, '\n', end - p)) != NULL) {
+    numAreas++;
+    p++;
   }
 }
 
@@ -121,13 +136,11 @@ ProcSelfMaps::readDec()
   unsigned long int v = 0;
 
   while (1) {
-    char c = data[dataIdx];
-    if ((c >= '0') && (c <= '9')) {
-      c -= '0';
-    } else {
+    unsigned int d = (unsigned char)data[dataIdx] - '0';
+    if (d > 9) {
       break;
     }
-    v = v * 10 + c;
+    v = v * 10 + d;
     dataIdx++;
   }
   return v;
@@ -139,17 +152,17 @@ ProcSelfMaps::readHex()
   unsigned long int v = 0;
 
   while (1) {
-    char c = data[dataIdx];
-    if ((c >= '0') && (c <= '9')) {
-      c -= '0';
-    } else if ((c >= 'a') && (c <= 'f')) {
-      c -= 'a' - 10;
-    } else if ((c >= 'A') && (c <= 'F')) {
-      c -= 'A' - 10;
-    } else {
-      break;
+    unsigned char c = data[dataIdx];
+    unsigned int d = c - '0';
+    if (d > 9) {
+      // Folds 'A'-'F' onto 'a'-'f'.
+      d = (c | 0x20) - 'a';
+      if (d > 5) {
+        break;
+      }
+      d += 10;
     }
-    v = v * 16 + c;
+    v = v * 16 + d;
     dataIdx++;
   }
   return v;
@@ -211,12 +224,14 @@ ProcSelfMaps::getNextArea(ProcMapsArea *area)
     // absolute pathname, or [stack], [vdso], etc.
     // On some machines, deleted files have a " (deleted)" prefix to the
     // filename.
-    size_t i = 0;
-    while (data[dataIdx] != '\n') {
-      area->name[i++] = data[dataIdx++];
-      JASSERT(i < sizeof(area->name));
-    }
-    area->name[i] = '\0';
+    const char *eol =
+      (const char *)memchr(&data[dataIdx], '\n', numBytes - dataIdx);
+    JASSERT(eol != NULL);
+    size_t len = eol - &data[dataIdx];
+    JASSERT(len < sizeof(area->name)) (len);
+    memcpy(area->name, &data[dataIdx], len);
+    area->name[len] = '\0';
+    dataIdx += len;
   }
 
   JASSERT(data[dataIdx++] == '\n');
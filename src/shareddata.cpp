@@ -40,10 +40,29 @@
 #include "uniquepid.h"
 #include "util.h"
 
-#define SHM_MAX_SIZE (sizeof(SharedData::Header))
+#define SHM_HEADER_SIZE (CEIL(sizeof(SharedData::Header), Util::pageSize()))
+
+// Address space reserved for the shared file in every process.  Only the part
+// of the file that is in use is accessible; see mapSharedData().  A 32-bit
+// process can't spare 256 MB of its address space, and the maps hold far
+// fewer entries than would fill 32 MB.
+#if __SIZEOF_POINTER__ == 4
+# define SHM_MAX_SIZE   (32 * 1024 * 1024)
+#else // if __SIZEOF_POINTER__ == 4
+# define SHM_MAX_SIZE   (256 * 1024 * 1024)
+#endif // if __SIZEOF_POINTER__ == 4
+
+// Initial capacities of the maps; they double whenever they fill up.
+#define PID_MAPS_INITIAL_CAPACITY           1024
+#define IPC_ID_MAPS_INITIAL_CAPACITY        64
+#define PTY_NAME_MAPS_INITIAL_CAPACITY      64
+#define INCOMING_CON_MAPS_INITIAL_CAPACITY  256
+#define INODE_CONN_ID_MAPS_INITIAL_CAPACITY 256
+#define LOCAL_SOCK_MAPS_INITIAL_CAPACITY    256
 
 using namespace dmtcp;
 static struct SharedData::Header *sharedDataHeader = NULL;
+static uint64_t sharedDataMappedSize = 0;
 static uint32_t nextVirtualPtyId = (uint32_t)-1;
 
 #if defined(__x86_64__) || defined(__aarch64__)
@@ -60,11 +79,10 @@ SharedData::initializeHeader(const char *tmpDir,
 {
   JASSERT(tmpDir && compId && coordInfo && localIPAddr);
 
-  off_t size = CEIL(SHM_MAX_SIZE, Util::pageSize());
-  JASSERT(lseek(PROTECTED_SHM_FD, size, SEEK_SET) == size)
-    (JASSERT_ERRNO);
-  Util::writeAll(PROTECTED_SHM_FD, "", 1);
+  off_t size = SHM_HEADER_SIZE;
   memset(sharedDataHeader, 0, size);
+  sharedDataHeader->size = size;
+  sharedDataHeader->maxSize = SHM_MAX_SIZE;
 
   strcpy(sharedDataHeader->versionStr, SHM_VERSION_STR);
 #if 0
@@ -126,6 +144,283 @@ SharedData::initializeHeader(const char *tmpDir,
   strcpy(sharedDataHeader->installDir, installDir.c_str());
 }
 
+/* The whole of SHM_MAX_SIZE is mapped from the shared file up front, but
+ * with PROT_NONE: the file may be much smaller, and touching a page beyond
+ * its end would raise SIGBUS.  mapExtent() then makes the pages accessible as
+ * the file grows.  Being part of a single file mapping, the reserved range
+ * cannot merge with a neighbouring anonymous mapping.
+ */
+static void
+mapSharedData()
+{
+  void *addr = mmap((void *)sharedDataHeader, SHM_MAX_SIZE,
+                    PROT_NONE, MAP_SHARED,
+                    PROTECTED_SHM_FD, 0);
+  JASSERT(addr != MAP_FAILED) (JASSERT_ERRNO)
+  .Text("Unable to find shared area.");
+
+  JASSERT(mprotect(addr, SHM_HEADER_SIZE, PROT_READ | PROT_WRITE) == 0)
+    (JASSERT_ERRNO);
+  sharedDataHeader = (struct SharedData::Header *)addr;
+  sharedDataMappedSize = SHM_HEADER_SIZE;
+}
+
+/* Returns the address of 'len' bytes at file offset 'offset', making the
+ * pages accessible first if some peer has grown the file since we last
+ * looked.
+ */
+static void *
+mapExtent(uint64_t offset, uint64_t len)
+{
+  uint64_t mapped = __atomic_load_n(&sharedDataMappedSize, __ATOMIC_ACQUIRE);
+
+  if (offset + len > mapped) {
+    uint64_t size = __atomic_load_n(&sharedDataHeader->size, __ATOMIC_ACQUIRE);
+    JASSERT(offset + len <= size) (offset) (len) (size);
+    JASSERT(mprotect((char *)sharedDataHeader + mapped, size - mapped,
+                     PROT_READ | PROT_WRITE) == 0)
+      (mapped) (size) (JASSERT_ERRNO);
+
+    // Another thread may have done the same in the meantime.
+    while (mapped < size &&
+           !__atomic_compare_exchange_n(&sharedDataMappedSize, &mapped, size,
+                                        false, __ATOMIC_RELEASE,
+                                        __ATOMIC_ACQUIRE)) {
+    }
+  }
+  return (char *)sharedDataHeader + offset;
+}
+
+/* Tables
+ *
+ * A table is an array of fixed-size entries in an extent of the shared file,
+ * optionally followed by a hash index with linear probing.  A slot of the
+ * index holds the index of an entry plus one, or zero if it is empty.  New
+ * extents are only ever appended to the file; the old ones are abandoned, so
+ * that a reader still looking at one sees consistent (if slightly stale)
+ * data.
+ *
+ * Writers hold the file lock.  They fill in an entry before publishing its
+ * index slot, and a grown extent before publishing its offset, with release
+ * stores.  Entries are never removed (the inode maps are only reset before a
+ * checkpoint, before any process adds to them), so a slot, once set, can only
+ * change to refer to a newer entry with the same key.  Readers of the indexed
+ * tables therefore take no lock; they follow the probe sequence with acquire
+ * loads.
+ */
+static inline uint32_t
+hashIndex(uint64_t key, uint64_t indexSize)
+{
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (indexSize - 1);
+}
+
+static inline uint32_t
+hashEntry(const SharedData::PidMap &map, uint64_t indexSize)
+{
+  return hashIndex((uint32_t)map.virt, indexSize);
+}
+
+static inline bool
+sameKey(const SharedData::PidMap &a, const SharedData::PidMap &b)
+{
+  return a.virt == b.virt;
+}
+
+static inline uint32_t
+hashEntry(const SharedData::IPCIdMap &map, uint64_t indexSize)
+{
+  return hashIndex((uint32_t)map.virt, indexSize);
+}
+
+static inline bool
+sameKey(const SharedData::IPCIdMap &a, const SharedData::IPCIdMap &b)
+{
+  return a.virt == b.virt;
+}
+
+static inline uint32_t
+hashEntry(const SharedData::InodeConnIdMap &map, uint64_t indexSize)
+{
+  return hashIndex(map.inode ^ (map.devnum << 32 | map.devnum >> 32),
+                   indexSize);
+}
+
+static inline bool
+sameKey(const SharedData::InodeConnIdMap &a,
+        const SharedData::InodeConnIdMap &b)
+{
+  return a.devnum == b.devnum && a.inode == b.inode;
+}
+
+static inline uint32_t
+hashEntry(const SharedData::LocalSockMap &map, uint64_t indexSize)
+{
+  uint64_t key = map.isAcceptEnd;
+
+  for (size_t i = 0; i + sizeof(uint64_t) <= CON_ID_LEN; i += sizeof(key)) {
+    uint64_t word;
+    memcpy(&word, map.id + i, sizeof(word));
+    key = (key << 7 | key >> 57) ^ word;
+  }
+  return hashIndex(key, indexSize);
+}
+
+static inline bool
+sameKey(const SharedData::LocalSockMap &a, const SharedData::LocalSockMap &b)
+{
+  return a.isAcceptEnd == b.isAcceptEnd &&
+         memcmp(a.id, b.id, CON_ID_LEN) == 0;
+}
+
+static SharedData::Extent *
+getExtent(const SharedData::Table &table)
+{
+  uint64_t offset = __atomic_load_n(&table.offset, __ATOMIC_ACQUIRE);
+
+  if (offset == 0) {
+    return NULL;
+  }
+  SharedData::Extent *extent =
+    (SharedData::Extent *)mapExtent(offset, sizeof(SharedData::Extent));
+  return (SharedData::Extent *)mapExtent(offset, extent->size);
+}
+
+template<typename T>
+static inline T *
+entries(SharedData::Extent *extent)
+{
+  return (T *)(extent + 1);
+}
+
+static inline uint32_t *
+indexOf(SharedData::Extent *extent)
+{
+  return (uint32_t *)((char *)(extent + 1) +
+                      extent->capacity * extent->entrySize);
+}
+
+/* Makes 'extent' find entry 'n' by its key.  If an older entry has the same
+ * key, the newer one replaces it in the index.  Called with the lock held.
+ */
+template<typename T>
+static void
+indexEntry(SharedData::Extent *extent, uint64_t n)
+{
+  T *map = entries<T>(extent);
+  uint32_t *index = indexOf(extent);
+  uint32_t i = hashEntry(map[n], extent->indexSize);
+
+  while (index[i] != 0 && !sameKey(map[index[i] - 1], map[n])) {
+    i = (i + 1) & (extent->indexSize - 1);
+  }
+  __atomic_store_n(&index[i], n + 1, __ATOMIC_RELEASE);
+}
+
+/* Returns the newest entry of 'table' with the same key as 'key', or NULL. */
+template<typename T>
+static T *
+findEntry(const SharedData::Table &table, const T &key)
+{
+  SharedData::Extent *extent = getExtent(table);
+
+  if (extent == NULL) {
+    return NULL;
+  }
+
+  T *map = entries<T>(extent);
+  uint32_t *index = indexOf(extent);
+  uint32_t i = hashEntry(key, extent->indexSize);
+  while (true) {
+    uint32_t n = __atomic_load_n(&index[i], __ATOMIC_ACQUIRE);
+    if (n == 0) {
+      return NULL;
+    }
+    if (sameKey(map[n - 1], key)) {
+      return &map[n - 1];
+    }
+    i = (i + 1) & (extent->indexSize - 1);
+  }
+}
+
+/* Returns the extent of 'table', replaced by a larger one if it can't take
+ * 'count' entries.  Called with the lock held; 'numEntries' entries are in
+ * use.  'indexFn' is NULL for a table without an index.
+ */
+template<typename T>
+static SharedData::Extent *
+reserveEntries(SharedData::Table *table,
+               uint64_t numEntries,
+               uint64_t count,
+               uint64_t initialCapacity,
+               void (*indexFn)(SharedData::Extent *, uint64_t))
+{
+  SharedData::Extent *extent = getExtent(*table);
+
+  if (extent != NULL && count <= extent->capacity) {
+    return extent;
+  }
+
+  uint64_t capacity = extent != NULL ? extent->capacity : initialCapacity;
+  while (capacity < count) {
+    capacity *= 2;
+  }
+  uint64_t indexSize = indexFn != NULL ? 2 * capacity : 0;
+  uint64_t size = CEIL(sizeof(SharedData::Extent) + capacity * sizeof(T) +
+                       indexSize * sizeof(uint32_t), Util::pageSize());
+
+  // Carve the new extent from the end of the file.
+  uint64_t offset = sharedDataHeader->size;
+  JASSERT(offset + size <= sharedDataHeader->maxSize)
+    (offset) (size) (capacity) (sharedDataHeader->maxSize)
+  .Text("Shared area exhausted");
+  JASSERT(ftruncate(PROTECTED_SHM_FD, offset + size) == 0) (JASSERT_ERRNO);
+  __atomic_store_n(&sharedDataHeader->size, offset + size, __ATOMIC_RELEASE);
+
+  SharedData::Extent *newExtent =
+    (SharedData::Extent *)mapExtent(offset, size);
+  newExtent->size = size;
+  newExtent->capacity = capacity;
+  newExtent->entrySize = sizeof(T);
+  newExtent->indexSize = indexSize;
+  if (extent != NULL) {
+    memcpy(entries<T>(newExtent), entries<T>(extent), numEntries * sizeof(T));
+  }
+  if (indexFn != NULL) {
+    for (uint64_t n = 0; n < numEntries; n++) {
+      indexFn(newExtent, n);
+    }
+  }
+
+  JTRACE("Grew shared table") (offset) (capacity) (numEntries);
+  __atomic_store_n(&table->offset, offset, __ATOMIC_RELEASE);
+  return newExtent;
+}
+
+/* Adds 'entry' to 'table', or updates the real id of the entry with the same
+ * virtual id.
+ */
+template<typename T>
+static void
+setVirtIdMap(SharedData::Table *table,
+             uint64_t *numEntries,
+             uint64_t initialCapacity,
+             const T &entry)
+{
+  Util::lockFile(PROTECTED_SHM_FD);
+  T *existing = findEntry(*table, entry);
+  if (existing != NULL) {
+    __atomic_store_n(&existing->real, entry.real, __ATOMIC_RELAXED);
+  } else {
+    uint64_t n = *numEntries;
+    SharedData::Extent *extent =
+      reserveEntries<T>(table, n, n + 1, initialCapacity, indexEntry<T>);
+    entries<T>(extent)[n] = entry;
+    *numEntries = n + 1;
+    indexEntry<T>(extent, n);
+  }
+  Util::unlockFile(PROTECTED_SHM_FD);
+}
+
 bool
 SharedData::initialized()
 {
@@ -153,9 +448,7 @@ SharedData::initialize(const char *tmpDir,
     ostringstream o;
     o << tmpDir << "/dmtcpSharedArea."
       << *compId << "." << std::hex << coordInfo->timeStamp;
-    // THIS IS A DUP OF initializeHeader AND OF size, below; Pass this in as an
-    // argument to it.
-    off_t size = CEIL(SHM_MAX_SIZE, Util::pageSize());
+    off_t size = SHM_HEADER_SIZE;
 
     int fd = _real_open(o.str().c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
     if (fd == -1 && errno == EEXIST) {
@@ -174,23 +467,21 @@ SharedData::initialize(const char *tmpDir,
     // If the file pointed to by fd already exists, and its size is less
     // than 'size', then mmap can succeed even though the backing file is
     // too small. This can cause a SIGBUS later when we try to read beyond
-    // the end of the file. So we must truncate the file to the correct size
-    // in both the if and else branch, above.
-    JASSERT(truncate(o.str().c_str(), size) == 0);
+    // the end of the file. So we must extend the file in both the if and
+    // else branch, above.  Never shrink it, though: it may already hold
+    // the extents of a peer.
     JASSERT(fd != -1) (JASSERT_ERRNO);
+    struct stat statbuf;
+    JASSERT(fstat(fd, &statbuf) == 0) (JASSERT_ERRNO);
+    if (statbuf.st_size < size) {
+      JASSERT(ftruncate(fd, size) == 0) (JASSERT_ERRNO);
+    }
     JASSERT(_real_dup2(fd, PROTECTED_SHM_FD) == PROTECTED_SHM_FD)
       (JASSERT_ERRNO);
     _real_close(fd);
   }
 
-  size_t size = CEIL(SHM_MAX_SIZE, Util::pageSize());
-  void *addr = mmap((void *)sharedDataHeader, size,
-                    PROT_READ | PROT_WRITE, MAP_SHARED,
-                    PROTECTED_SHM_FD, 0);
-  JASSERT(addr != MAP_FAILED) (JASSERT_ERRNO)
-  .Text("Unable to find shared area.");
-
-  sharedDataHeader = (struct Header *)addr;
+  mapSharedData();
 
   if (needToInitialize) {
     Util::lockFile(PROTECTED_SHM_FD);
@@ -235,6 +526,14 @@ SharedData::initialize(const char *tmpDir,
       sharedDataHeader->archMode = DMTCP_ARCH_MIXED;
     }
 
+    // The file must fit in the reserved range of every process using it.
+    if (sharedDataHeader->maxSize > SHM_MAX_SIZE) {
+      JASSERT(sharedDataHeader->size <= SHM_MAX_SIZE)
+        (sharedDataHeader->size) (SHM_MAX_SIZE)
+      .Text("Shared area too large for this process");
+      sharedDataHeader->maxSize = SHM_MAX_SIZE;
+    }
+
     Util::unlockFile(PROTECTED_SHM_FD);
   }
   JTRACE("Shared area mapped") (sharedDataHeader);
@@ -243,7 +542,9 @@ SharedData::initialize(const char *tmpDir,
 bool
 SharedData::isSharedDataRegion(void *addr)
 {
-  return addr == (void *)sharedDataHeader;
+  return sharedDataHeader != NULL &&
+         addr >= (void *)sharedDataHeader &&
+         addr < (void *)((char *)sharedDataHeader + SHM_MAX_SIZE);
 }
 
 void
@@ -260,9 +561,23 @@ void
 SharedData::prepareForCkpt()
 {
   nextVirtualPtyId = sharedDataHeader->nextVirtualPtyId;
-  sharedDataHeader->numInodeConnIdMaps = 0;
   sharedDataHeader->numIncomingConMaps = 0;
 
+  // Every process on this node gets here before any of them adds to the inode
+  // maps again; whoever comes first clears the index.
+  Util::lockFile(PROTECTED_SHM_FD);
+  if (sharedDataHeader->numInodeConnIdMaps > 0) {
+    Extent *extent = getExtent(sharedDataHeader->inodeConnIdMaps);
+    sharedDataHeader->numInodeConnIdMaps = 0;
+    memset(indexOf(extent), 0, extent->indexSize * sizeof(uint32_t));
+  }
+  if (sharedDataHeader->numLocalSockMaps > 0) {
+    Extent *extent = getExtent(sharedDataHeader->localSockMaps);
+    sharedDataHeader->numLocalSockMaps = 0;
+    memset(indexOf(extent), 0, extent->indexSize * sizeof(uint32_t));
+  }
+  Util::unlockFile(PROTECTED_SHM_FD);
+
   initializeBarrier();
 }
 
@@ -505,139 +820,90 @@ SharedData::getDlsymOffset_m32(void)
 pid_t
 SharedData::getRealPid(pid_t virt)
 {
-  pid_t res = -1;
+  PidMap key;
 
   if (sharedDataHeader == NULL) {
     initialize();
   }
-  Util::lockFile(PROTECTED_SHM_FD);
-  for (size_t i = 0; i < sharedDataHeader->numPidMaps; i++) {
-    if (sharedDataHeader->pidMap[i].virt == virt) {
-      res = sharedDataHeader->pidMap[i].real;
-    }
-  }
-  Util::unlockFile(PROTECTED_SHM_FD);
-  return res;
+  key.virt = virt;
+  PidMap *map = findEntry(sharedDataHeader->pidMaps, key);
+  return map == NULL ? -1 : __atomic_load_n(&map->real, __ATOMIC_RELAXED);
 }
 
 void
 SharedData::setPidMap(pid_t virt, pid_t real)
 {
-  size_t i;
+  PidMap map;
 
   if (sharedDataHeader == NULL) {
     initialize();
   }
-  Util::lockFile(PROTECTED_SHM_FD);
-  for (i = 0; i < sharedDataHeader->numPidMaps; i++) {
-    if (sharedDataHeader->pidMap[i].virt == virt) {
-      sharedDataHeader->pidMap[i].real = real;
-      break;
-    }
-  }
-  if (i == sharedDataHeader->numPidMaps) {
-    JASSERT(sharedDataHeader->numPidMaps < MAX_PID_MAPS);
-    sharedDataHeader->pidMap[i].virt = virt;
-    sharedDataHeader->pidMap[i].real = real;
-    sharedDataHeader->numPidMaps++;
-  }
-  Util::unlockFile(PROTECTED_SHM_FD);
+  map.virt = virt;
+  map.real = real;
+  setVirtIdMap(&sharedDataHeader->pidMaps, &sharedDataHeader->numPidMaps,
+               PID_MAPS_INITIAL_CAPACITY, map);
 }
 
-int32_t
-SharedData::getRealIPCId(int type, int32_t virt)
+static void
+getIPCIdTable(int type, SharedData::Table **table, uint64_t **nmaps)
 {
-  int32_t res = -1;
-  uint32_t nmaps = 0;
-  IPCIdMap *map = NULL;
-
-  if (sharedDataHeader == NULL) {
-    initialize();
-  }
-  Util::lockFile(PROTECTED_SHM_FD);
   switch (type) {
   case SYSV_SHM_ID:
-    nmaps = sharedDataHeader->numSysVShmIdMaps;
-    map = sharedDataHeader->sysvShmIdMap;
+    *nmaps = &sharedDataHeader->numSysVShmIdMaps;
+    *table = &sharedDataHeader->sysvShmIdMaps;
     break;
 
   case SYSV_SEM_ID:
-    nmaps = sharedDataHeader->numSysVSemIdMaps;
-    map = sharedDataHeader->sysvSemIdMap;
+    *nmaps = &sharedDataHeader->numSysVSemIdMaps;
+    *table = &sharedDataHeader->sysvSemIdMaps;
     break;
 
   case SYSV_MSQ_ID:
-    nmaps = sharedDataHeader->numSysVMsqIdMaps;
-    map = sharedDataHeader->sysvMsqIdMap;
+    *nmaps = &sharedDataHeader->numSysVMsqIdMaps;
+    *table = &sharedDataHeader->sysvMsqIdMaps;
     break;
 
   case SYSV_SHM_KEY:
-    nmaps = sharedDataHeader->numSysVShmKeyMaps;
-    map = sharedDataHeader->sysvShmKeyMap;
+    *nmaps = &sharedDataHeader->numSysVShmKeyMaps;
+    *table = &sharedDataHeader->sysvShmKeyMaps;
     break;
 
   default:
     JASSERT(false) (type).Text("Unknown IPC-Id type.");
     break;
   }
-  for (size_t i = 0; i < nmaps; i++) {
-    if (map[i].virt == virt) {
-      res = map[i].real;
-    }
-  }
-  Util::unlockFile(PROTECTED_SHM_FD);
-  return res;
 }
 
-void
-SharedData::setIPCIdMap(int type, int32_t virt, int32_t real)
+int32_t
+SharedData::getRealIPCId(int type, int32_t virt)
 {
-  size_t i;
+  Table *table = NULL;
   uint64_t *nmaps = NULL;
-  IPCIdMap *map = NULL;
+  IPCIdMap key;
 
   if (sharedDataHeader == NULL) {
     initialize();
   }
-  Util::lockFile(PROTECTED_SHM_FD);
-  switch (type) {
-  case SYSV_SHM_ID:
-    nmaps = &sharedDataHeader->numSysVShmIdMaps;
-    map = sharedDataHeader->sysvShmIdMap;
-    break;
-
-  case SYSV_SEM_ID:
-    nmaps = &sharedDataHeader->numSysVSemIdMaps;
-    map = sharedDataHeader->sysvSemIdMap;
-    break;
-
-  case SYSV_MSQ_ID:
-    nmaps = &sharedDataHeader->numSysVMsqIdMaps;
-    map = sharedDataHeader->sysvMsqIdMap;
-    break;
+  getIPCIdTable(type, &table, &nmaps);
+  key.virt = virt;
+  IPCIdMap *map = findEntry(*table, key);
+  return map == NULL ? -1 : __atomic_load_n(&map->real, __ATOMIC_RELAXED);
+}
 
-  case SYSV_SHM_KEY:
-    nmaps = &sharedDataHeader->numSysVShmKeyMaps;
-    map = sharedDataHeader->sysvShmKeyMap;
-    break;
+void
+SharedData::setIPCIdMap(int type, int32_t virt, int32_t real)
+{
+  Table *table = NULL;
+  uint64_t *nmaps = NULL;
+  IPCIdMap map;
 
-  default:
-    JASSERT(false) (type).Text("Unknown IPC-Id type.");
-    break;
-  }
-  for (i = 0; i < *nmaps; i++) {
-    if (map[i].virt == virt) {
-      map[i].real = real;
-      break;
-    }
-  }
-  if (i == *nmaps) {
-    JASSERT(*nmaps < MAX_IPC_ID_MAPS);
-    map[i].virt = virt;
-    map[i].real = real;
-    *nmaps += 1;
+  if (sharedDataHeader == NULL) {
+    initialize();
   }
-  Util::unlockFile(PROTECTED_SHM_FD);
+  getIPCIdTable(type, &table, &nmaps);
+  map.virt = virt;
+  map.real = real;
+  setVirtIdMap(table, nmaps, IPC_ID_MAPS_INITIAL_CAPACITY, map);
 }
 
 void
@@ -653,12 +919,15 @@ SharedData::createVirtualPtyName(const char *real, char *out, uint32_t len)
     jalib::XToString(sharedDataHeader->nextVirtualPtyId++);
 
   // FIXME: We should be removing ptys once they are gone.
-  JASSERT(sharedDataHeader->numPtyNameMaps < MAX_PTY_NAME_MAPS);
-  size_t n = sharedDataHeader->numPtyNameMaps++;
+  size_t n = sharedDataHeader->numPtyNameMaps;
+  PtyNameMap *map = entries<PtyNameMap>(
+    reserveEntries<PtyNameMap>(&sharedDataHeader->ptyNameMaps, n, n + 1,
+                               PTY_NAME_MAPS_INITIAL_CAPACITY, NULL));
   JASSERT(strlen(real) < PTS_PATH_MAX);
   JASSERT(virt.length() < PTS_PATH_MAX);
-  strcpy(sharedDataHeader->ptyNameMap[n].real, real);
-  strcpy(sharedDataHeader->ptyNameMap[n].virt, virt.c_str());
+  strcpy(map[n].real, real);
+  strcpy(map[n].virt, virt.c_str());
+  sharedDataHeader->numPtyNameMaps++;
   JASSERT(len > virt.length());
   strcpy(out, virt.c_str());
   Util::unlockFile(PROTECTED_SHM_FD);
@@ -688,11 +957,15 @@ SharedData::getRealPtyName(const char *virt, char *out, uint32_t len)
   }
   *out = '\0';
   Util::lockFile(PROTECTED_SHM_FD);
-  for (size_t i = 0; i < sharedDataHeader->numPtyNameMaps; i++) {
-    if (strcmp(virt, sharedDataHeader->ptyNameMap[i].virt) == 0) {
-      JASSERT(strlen(sharedDataHeader->ptyNameMap[i].real) < len);
-      strcpy(out, sharedDataHeader->ptyNameMap[i].real);
-      break;
+  if (sharedDataHeader->numPtyNameMaps > 0) {
+    PtyNameMap *map =
+      entries<PtyNameMap>(getExtent(sharedDataHeader->ptyNameMaps));
+    for (size_t i = 0; i < sharedDataHeader->numPtyNameMaps; i++) {
+      if (strcmp(virt, map[i].virt) == 0) {
+        JASSERT(strlen(map[i].real) < len);
+        strcpy(out, map[i].real);
+        break;
+      }
     }
   }
   Util::unlockFile(PROTECTED_SHM_FD);
@@ -706,11 +979,15 @@ SharedData::getVirtPtyName(const char *real, char *out, uint32_t len)
   }
   *out = '\0';
   Util::lockFile(PROTECTED_SHM_FD);
-  for (size_t i = 0; i < sharedDataHeader->numPtyNameMaps; i++) {
-    if (strcmp(real, sharedDataHeader->ptyNameMap[i].real) == 0) {
-      JASSERT(strlen(sharedDataHeader->ptyNameMap[i].virt) < len);
-      strcpy(out, sharedDataHeader->ptyNameMap[i].virt);
-      break;
+  if (sharedDataHeader->numPtyNameMaps > 0) {
+    PtyNameMap *map =
+      entries<PtyNameMap>(getExtent(sharedDataHeader->ptyNameMaps));
+    for (size_t i = 0; i < sharedDataHeader->numPtyNameMaps; i++) {
+      if (strcmp(real, map[i].real) == 0) {
+        JASSERT(strlen(map[i].virt) < len);
+        strcpy(out, map[i].virt);
+        break;
+      }
     }
   }
   Util::unlockFile(PROTECTED_SHM_FD);
@@ -723,11 +1000,15 @@ SharedData::insertPtyNameMap(const char *virt, const char *real)
     initialize();
   }
   Util::lockFile(PROTECTED_SHM_FD);
-  size_t n = sharedDataHeader->numPtyNameMaps++;
+  size_t n = sharedDataHeader->numPtyNameMaps;
+  PtyNameMap *map = entries<PtyNameMap>(
+    reserveEntries<PtyNameMap>(&sharedDataHeader->ptyNameMaps, n, n + 1,
+                               PTY_NAME_MAPS_INITIAL_CAPACITY, NULL));
   JASSERT(strlen(virt) < PTS_PATH_MAX);
   JASSERT(strlen(real) < PTS_PATH_MAX);
-  strcpy(sharedDataHeader->ptyNameMap[n].real, real);
-  strcpy(sharedDataHeader->ptyNameMap[n].virt, virt);
+  strcpy(map[n].real, real);
+  strcpy(map[n].virt, virt);
+  sharedDataHeader->numPtyNameMaps++;
   Util::unlockFile(PROTECTED_SHM_FD);
 }
 
@@ -740,12 +1021,17 @@ SharedData::registerIncomingCons(vector<const char *> &ids,
     initialize();
   }
   Util::lockFile(PROTECTED_SHM_FD);
-  for (size_t i = 0; i < ids.size(); i++) {
-    size_t n = sharedDataHeader->numIncomingConMaps++;
-    memcpy(sharedDataHeader->incomingConMap[n].id, ids[i], CON_ID_LEN);
-    memcpy(&sharedDataHeader->incomingConMap[n].addr, &receiverAddr, len);
-    sharedDataHeader->incomingConMap[n].len = len;
+  size_t n = sharedDataHeader->numIncomingConMaps;
+  IncomingConMap *map = entries<IncomingConMap>(
+    reserveEntries<IncomingConMap>(&sharedDataHeader->incomingConMaps,
+                                   n, n + ids.size(),
+                                   INCOMING_CON_MAPS_INITIAL_CAPACITY, NULL));
+  for (size_t i = 0; i < ids.size(); i++, n++) {
+    memcpy(map[n].id, ids[i], CON_ID_LEN);
+    memcpy(&map[n].addr, &receiverAddr, len);
+    map[n].len = len;
   }
+  sharedDataHeader->numIncomingConMaps = n;
   Util::unlockFile(PROTECTED_SHM_FD);
 }
 
@@ -755,8 +1041,10 @@ SharedData::getMissingConMaps(IncomingConMap **map, uint32_t *nmaps)
   if (sharedDataHeader == NULL) {
     initialize();
   }
-  *map = sharedDataHeader->incomingConMap;
   *nmaps = sharedDataHeader->numIncomingConMaps;
+  *map = *nmaps > 0
+    ? entries<IncomingConMap>(getExtent(sharedDataHeader->incomingConMaps))
+    : NULL;
 }
 
 void
@@ -766,30 +1054,80 @@ SharedData::insertInodeConnIdMaps(vector<InodeConnIdMap> &maps)
     initialize();
   }
   Util::lockFile(PROTECTED_SHM_FD);
-  size_t startIdx = sharedDataHeader->numInodeConnIdMaps;
-  sharedDataHeader->numInodeConnIdMaps += maps.size();
-  Util::unlockFile(PROTECTED_SHM_FD);
-
-  for (size_t i = 0; i < maps.size(); i++) {
-    sharedDataHeader->inodeConnIdMap[startIdx + i] = maps[i];
+  size_t n = sharedDataHeader->numInodeConnIdMaps;
+  Extent *extent =
+    reserveEntries<InodeConnIdMap>(&sharedDataHeader->inodeConnIdMaps,
+                                   n, n + maps.size(),
+                                   INODE_CONN_ID_MAPS_INITIAL_CAPACITY,
+                                   indexEntry<InodeConnIdMap>);
+  for (size_t i = 0; i < maps.size(); i++, n++) {
+    entries<InodeConnIdMap>(extent)[n] = maps[i];
+    indexEntry<InodeConnIdMap>(extent, n);
   }
+  sharedDataHeader->numInodeConnIdMaps = n;
+  Util::unlockFile(PROTECTED_SHM_FD);
 }
 
 bool
 SharedData::getCkptLeaderForFile(dev_t devnum, ino_t inode, void *id)
 {
+  InodeConnIdMap key;
+
   if (sharedDataHeader == NULL) {
     initialize();
   }
   JASSERT(id != NULL);
-  if (sharedDataHeader->numInodeConnIdMaps > 0) {
-    for (int i = sharedDataHeader->numInodeConnIdMaps - 1; i >= 0; i--) {
-      InodeConnIdMap &map = sharedDataHeader->inodeConnIdMap[i];
-      if (map.devnum == devnum && map.inode == inode) {
-        memcpy(id, map.id, sizeof(map.id));
-        return true;
-      }
-    }
+
+  // If several processes have the file open, the one that added its entry
+  // last is the leader.
+  key.devnum = devnum;
+  key.inode = inode;
+  InodeConnIdMap *map = findEntry(sharedDataHeader->inodeConnIdMaps, key);
+  if (map == NULL) {
+    return false;
+  }
+  memcpy(id, map->id, sizeof(map->id));
+  return true;
+}
+
+void
+SharedData::registerLocalSockets(vector<LocalSockMap> &maps)
+{
+  if (sharedDataHeader == NULL) {
+    initialize();
+  }
+  Util::lockFile(PROTECTED_SHM_FD);
+  size_t n = sharedDataHeader->numLocalSockMaps;
+  Extent *extent =
+    reserveEntries<LocalSockMap>(&sharedDataHeader->localSockMaps,
+                                 n, n + maps.size(),
+                                 LOCAL_SOCK_MAPS_INITIAL_CAPACITY,
+                                 indexEntry<LocalSockMap>);
+  for (size_t i = 0; i < maps.size(); i++, n++) {
+    entries<LocalSockMap>(extent)[n] = maps[i];
+    indexEntry<LocalSockMap>(extent, n);
+  }
+  sharedDataHeader->numLocalSockMaps = n;
+  Util::unlockFile(PROTECTED_SHM_FD);
+}
+
+bool
+SharedData::getLocalSocket(const void *id, bool isAcceptEnd, LocalSockMap *out)
+{
+  LocalSockMap key;
+
+  if (sharedDataHeader == NULL) {
+    initialize();
+  }
+
+  memcpy(key.id, id, CON_ID_LEN);
+  key.isAcceptEnd = isAcceptEnd;
+  LocalSockMap *map = findEntry(sharedDataHeader->localSockMaps, key);
+  if (map == NULL) {
+    return false;
+  }
+  if (out != NULL) {
+    *out = *map;
   }
-  return false;
+  return true;
 }
@@ -77,6 +77,9 @@ struct Thread {
   void *saved_sp; // at restart, we use a temporary stack just
                   // beyond original stack (red zone)
 
+  void *stackAddr;  // lowest address of the pthread stack, or NULL for the
+  size_t stackSize; // main thread; see ThreadList::getUnusedStackRanges()
+
   void *pthreadSelf;
   ThreadTLSInfo tlsInfo;
 
@@ -94,9 +97,9 @@ struct Thread {
   double ckptReadTime;
 
   uint32_t wrapperLockCount;
+  uint32_t inWrapper;     // see ThreadSync::wrapperExecutionLockLock()
 
   Thread *next;
-  Thread *prev;
 };
 
 extern __thread Thread *curThread;
@@ -1,9 +1,11 @@
+#include <limits.h>
 #include <linux/version.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
 #include <sys/resource.h>
 #include <sys/syscall.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include "config.h"
@@ -17,6 +19,7 @@
 #include "ckptserializer.h"
 #include "dmtcpalloc.h"
 #include "dmtcpworker.h"
+#include "futex.h"
 #include "mtcp/mtcp_header.h"
 #include "pluginmanager.h"
 #include "shareddata.h"
@@ -54,11 +57,45 @@ void *saved_sysinfo;
 
 static const char *DMTCP_PRGNAME_PREFIX = "DMTCP:";
 
+/* Descriptors of dead threads, recycled by allocNewThread().  It is a
+ * lock-free stack: threads push single descriptors or chains, but the only
+ * way to pop is to take the whole list at once.
+ */
 static Thread *threads_freelist = NULL;
+static __thread Thread *threads_cache ATTR_TLS_INITIAL_EXEC = NULL;
+
+/* Serializes the removal of descriptors from activeThreads.  New threads
+ * add themselves without it.
+ */
 static DmtcpMutex threadlistLock = DMTCP_MUTEX_INITIALIZER;
-static DmtcpMutex threadStateLock = DMTCP_MUTEX_INITIALIZER;
 
-static DmtcpRWLock threadResumeLock;
+/* Number of exiting threads still on activeThreads.  Once it reaches
+ * REAP_EXITING_THREADS, the next new thread removes the dead ones.
+ */
+static uint32_t numExitingThreads = 0;
+#define REAP_EXITING_THREADS 64
+
+/* Countdown latch for suspendThreads().  The ckpt-thread adds one for every
+ * thread that it signals; each thread subtracts one once it is ST_SUSPENDED,
+ * and the last one wakes up the ckpt-thread.
+ */
+static uint32_t numThreadsToSuspend = 0;
+
+/* Suspended threads futex-wait on this word; resumeThreads() bumps it and
+ * wakes them all with a single FUTEX_WAKE.
+ */
+static uint32_t threadResumeGeneration = 0;
+
+/* How long the ckpt-thread sleeps on the latch before checking whether a
+ * signaled thread has exited without ever running the signal handler.
+ */
+#define QUIESCE_POLL_NSEC (10 * 1000 * 1000)
+
+/* Bytes below a thread's saved stack pointer that may still hold live data
+ * (the x86-64 ABI red zone).  On restart, the thread's temporary stack starts
+ * just beyond it.
+ */
+#define STACK_RED_ZONE 128
 
 __thread Thread *curThread ATTR_TLS_INITIAL_EXEC = NULL;
 Thread *ckptThread = NULL;
@@ -78,6 +115,8 @@ static void stopthisthread(int sig);
 static int restarthread(void *threadv);
 static void Thread_SaveSigState(Thread *th);
 static void Thread_RestoreSigState(Thread *th);
+static void pushFreeList(Thread *first, Thread *last);
+static void removeDeadThreads();
 
 /*****************************************************************************
  *
@@ -138,6 +177,7 @@ ThreadList::resetOnFork()
     ThreadList::threadIsDead(activeThreads); // takes care of updating
                                              // "activeThreads" ptr.
   }
+  numExitingThreads = 0;
   unlk_threads();
   init();
   createCkptThread();
@@ -218,6 +258,7 @@ ThreadList::getNewThread(void *(*fn)(void *), void *arg)
   th->state = ST_RUNNING;
   th->exiting = 0;
   th->wrapperLockCount = 0;
+  th->inWrapper = 0;
   th->procname[0] = '\0';
   return th;
 }
@@ -231,6 +272,17 @@ void
 ThreadList::threadExit()
 {
   curThread->exiting = 1;
+  __atomic_add_fetch(&numExitingThreads, 1, __ATOMIC_SEQ_CST);
+
+  // Hand our cached descriptors back to the other threads.
+  if (threads_cache != NULL) {
+    Thread *last = threads_cache;
+    while (last->next != NULL) {
+      last = last->next;
+    }
+    pushFreeList(threads_cache, last);
+    threads_cache = NULL;
+  }
 }
 
 /*****************************************************************************
@@ -254,6 +306,19 @@ ThreadList::initThread(Thread *th)
   th->ptid = (pid_t*)((char*) pthread_self() + TLSInfo_GetTidOffset());
   th->ctid = th->ptid;
 
+  // For the main thread, pthread_getattr_np() would have to parse
+  // /proc/self/maps; its stack grows on demand anyway, so we leave it alone.
+  th->stackAddr = NULL;
+  th->stackSize = 0;
+  if (th != motherofall) {
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      JASSERT(pthread_attr_getstack(&attr, &th->stackAddr,
+                                    &th->stackSize) == 0);
+      pthread_attr_destroy(&attr);
+    }
+  }
+
   JTRACE("starting thread") (th->tid) (th->virtual_tid);
 
   // Check and remove any thread descriptor which has the same tid as ours.
@@ -418,85 +483,138 @@ checkpointhread(void *dummy)
   return NULL;
 }
 
-void
-ThreadList::suspendThreads()
+/*****************************************************************************
+ *
+ *  A signaled thread can exit before it runs stopthisthread().  Such threads
+ *  will never count down the latch; remove them from the list and count them
+ *  down here instead.
+ *
+ *****************************************************************************/
+static void
+reapUnsuspendedThreads()
 {
-  int needrescan;
   Thread *thread;
   Thread *next;
 
-  DmtcpRWLockInit(&threadResumeLock);
-  JASSERT(DmtcpRWLockWrLock(&threadResumeLock) == 0);
-
-  /* Halt all other threads - force them to call stopthisthread
-   * If any have blocked checkpointing, wait for them to unblock before
-   * signalling
-   */
   lock_threads();
-  do {
-    needrescan = 0;
-    numUserThreads = 0;
-    for (thread = activeThreads; thread != NULL; thread = next) {
-      next = thread->next;
-
-      if (thread == curThread) {
-        continue;
+  for (thread = activeThreads; thread != NULL; thread = next) {
+    next = thread->next;
+    if (thread->state == ST_SIGNALED &&
+        THREAD_TGKILL(motherpid, thread->tid, 0) == -1 && errno == ESRCH) {
+      ThreadList::threadIsDead(thread);
+      numUserThreads--;
+      if (__atomic_sub_fetch(&numThreadsToSuspend, 1, __ATOMIC_SEQ_CST) == 0) {
+        break;
       }
+    }
+  }
+  unlk_threads();
+}
 
-      /* Do various things based on thread's state */
-      switch (thread->state) {
-      case ST_RUNNING:
-
-        /* Thread is running. Send it a signal so it will call stopthisthread.
-         * We will need to rescan (hopefully it will be suspended by then)
-         */
-        if (Thread_UpdateState(thread, ST_SIGNALED, ST_RUNNING)) {
-          if (THREAD_TGKILL(motherpid, thread->tid,
-                            SigInfo::ckptSignal()) < 0) {
-            JASSERT(errno == ESRCH) (JASSERT_ERRNO) (thread->tid)
-            .Text("error signalling thread");
-            ThreadList::threadIsDead(thread);
-          } else {
-            needrescan = 1;
-          }
-        }
-        break;
+void
+ThreadList::suspendThreads()
+{
+  Thread *thread;
+  Thread *next;
+  struct timeval start, end;
 
-      case ST_SIGNALED:
-        if (THREAD_TGKILL(motherpid, thread->tid, 0) == -1 && errno == ESRCH) {
-          ThreadList::threadIsDead(thread);
-        } else {
-          needrescan = 1;
-        }
-        break;
+  // Not clock_gettime(); the timer plugin wraps it and would block on the
+  // wrapper-execution lock that we are holding.
+  JASSERT(gettimeofday(&start, NULL) == 0);
 
-      case ST_SUSPINPROG:
-        numUserThreads++;
-        break;
+  lock_threads();
+  removeDeadThreads();
 
-      case ST_SUSPENDED:
-        numUserThreads++;
-        break;
+  /* A thread that has not yet woken up from the previous resumeThreads() is
+   * still ST_SUSPENDED and can't be signaled until it is running again.
+   */
+  for (thread = activeThreads; thread != NULL; thread = next) {
+    next = thread->next;
+    if (thread != curThread && thread->state != ST_RUNNING &&
+        thread->state != ST_CKPNTHREAD) {
+      unlk_threads();
+      usleep(10);
+      lock_threads();
+      next = activeThreads;
+    }
+  }
 
-      case ST_CKPNTHREAD:
-        break;
+  /* Halt all other threads - force them to call stopthisthread.
+   * All threads are signaled in a single pass; each one is counted on the
+   * latch before it is signaled, so that it cannot count down first.
+   */
+  numUserThreads = 0;
+  numThreadsToSuspend = 0;
+  for (thread = activeThreads; thread != NULL; thread = next) {
+    next = thread->next;
 
-      default:
-        JASSERT(false);
-      }
+    if (thread == curThread || thread->state == ST_CKPNTHREAD) {
+      continue;
     }
-    if (needrescan) {
-      usleep(10);
+
+    JASSERT(thread->state == ST_RUNNING) (thread->tid) (thread->state);
+    JASSERT(Thread_UpdateState(thread, ST_SIGNALED, ST_RUNNING));
+    __atomic_add_fetch(&numThreadsToSuspend, 1, __ATOMIC_SEQ_CST);
+    if (THREAD_TGKILL(motherpid, thread->tid, SigInfo::ckptSignal()) < 0) {
+      JASSERT(errno == ESRCH) (JASSERT_ERRNO) (thread->tid)
+      .Text("error signalling thread");
+      __atomic_sub_fetch(&numThreadsToSuspend, 1, __ATOMIC_SEQ_CST);
+      ThreadList::threadIsDead(thread);
+    } else {
+      numUserThreads++;
     }
-  } while (needrescan);
+  }
   unlk_threads();
 
-  for (int i = 0; i < numUserThreads; i++) {
-    sem_wait(&semNotifyCkptThread);
+  /* Wait for the latch to drop to zero. */
+  while (true) {
+    uint32_t remaining = __atomic_load_n(&numThreadsToSuspend,
+                                         __ATOMIC_SEQ_CST);
+    if (remaining == 0) {
+      break;
+    }
+
+    struct timespec timeout = { 0, QUIESCE_POLL_NSEC };
+    if (futex(&numThreadsToSuspend, FUTEX_WAIT, remaining,
+              &timeout, NULL, 0) == -1 && errno == ETIMEDOUT) {
+      reapUnsuspendedThreads();
+    }
   }
 
+  JASSERT(gettimeofday(&end, NULL) == 0);
+  double latency = (end.tv_sec - start.tv_sec) +
+                   (end.tv_usec - start.tv_usec) / 1000000.0;
+
+  dmtcp_report_worker_stat("quiesce_seconds", latency);
+
   JASSERT(activeThreads != NULL);
-  JTRACE("everything suspended") (numUserThreads);
+  JTRACE("everything suspended") (numUserThreads) (latency);
+}
+
+/*****************************************************************************
+ *
+ *  Wait until no other thread is executing DMTCP wrapper code.  The caller
+ *  has published itself as the wrapper-execution writer, so threads can only
+ *  leave wrappers meanwhile.
+ *
+ *****************************************************************************/
+void
+ThreadList::waitForWrapperExit()
+{
+  Thread *thread;
+  uint32_t inWrapper;
+
+  lock_threads();
+  for (thread = activeThreads; thread != NULL; thread = thread->next) {
+    if (thread == curThread) {
+      continue;
+    }
+    while ((inWrapper = __atomic_load_n(&thread->inWrapper,
+                                        __ATOMIC_SEQ_CST)) != 0) {
+      futex_wait(&thread->inWrapper, inWrapper);
+    }
+  }
+  unlk_threads();
 }
 
 void ThreadList::vforkSuspendThreads()
@@ -513,8 +631,9 @@ void ThreadList::vforkResumeThreads()
 void
 ThreadList::resumeThreads()
 {
-  JTRACE("resuming user threads");
-  JASSERT(DmtcpRWLockUnlock(&threadResumeLock) == 0) (JASSERT_ERRNO);
+  JTRACE("resuming user threads") (numUserThreads);
+  __atomic_add_fetch(&threadResumeGeneration, 1, __ATOMIC_SEQ_CST);
+  futex_wake(&threadResumeGeneration, INT_MAX);
 }
 
 /*************************************************************************
@@ -570,9 +689,17 @@ stopthisthread(int signum)
        * Wait for ckpt thread to write ckpt, and resume.
        */
 
+      /* Read the resume generation before we count down the latch;
+       * resumeThreads() cannot bump it until the latch reaches zero.
+       */
+      uint32_t generation = __atomic_load_n(&threadResumeGeneration,
+                                            __ATOMIC_SEQ_CST);
+
       /* Tell the checkpoint thread that we're all saved away */
       JASSERT(Thread_UpdateState(curThread, ST_SUSPENDED, ST_SUSPINPROG));
-      sem_post(&semNotifyCkptThread);
+      if (__atomic_sub_fetch(&numThreadsToSuspend, 1, __ATOMIC_SEQ_CST) == 0) {
+        futex_wake(&numThreadsToSuspend, 1);
+      }
 
       /* Then wait for the ckpt thread to write the ckpt file then wake us up */
       JTRACE("User thread suspended") (curThread->tid);
@@ -586,11 +713,12 @@ stopthisthread(int signum)
       // However, the sem_wait cleanup handler is now invalid and thus we get a
       // segfault.
       // The change in sem_wait behavior was first introduce in glibc 2.21.
-      JASSERT(DmtcpRWLockRdLock(&threadResumeLock) == 0);
+      while (__atomic_load_n(&threadResumeGeneration,
+                             __ATOMIC_SEQ_CST) == generation) {
+        futex_wait(&threadResumeGeneration, generation);
+      }
 
       JASSERT(Thread_UpdateState(curThread, ST_RUNNING, ST_SUSPENDED));
-
-      JASSERT(DmtcpRWLockUnlock(&threadResumeLock) == 0);
     } else {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 11)
       if (!Util::strStartsWith(curThread->procname, DMTCP_PRGNAME_PREFIX)) {
@@ -619,6 +747,45 @@ stopthisthread(int signum)
   }
 }
 
+/*****************************************************************************
+ *
+ *  Collect the part of each thread stack below the saved stack pointer (and
+ *  the red zone).  Nothing there is live while the thread is suspended, and on
+ *  restart the thread resumes at saved_sp, so writeckpt.cpp saves these ranges
+ *  as zero pages.  Only threads that saved their sp during this checkpoint
+ *  and whose sp is inside their own pthread stack are considered; a thread
+ *  running on a sigaltstack, for example, is left alone.  Must be called with
+ *  all the user threads suspended.
+ *
+ *****************************************************************************/
+void
+ThreadList::getUnusedStackRanges(vector<std::pair<VA, VA> > *ranges)
+{
+  Thread *thread;
+
+  ranges->clear();
+  for (thread = activeThreads; thread != NULL; thread = thread->next) {
+    if (thread->stackSize == 0 ||
+        (thread->state != ST_SUSPENDED && thread->state != ST_CKPNTHREAD)) {
+      continue;
+    }
+
+    VA stackStart = (VA)thread->stackAddr;
+    VA stackEnd = stackStart + thread->stackSize;
+    VA sp = (VA)thread->saved_sp;
+    if (sp <= stackStart || sp > stackEnd) {
+      continue;
+    }
+
+    VA start = (VA)(((uintptr_t)stackStart + Util::pageSize() - 1) &
+                    Util::pageMask());
+    VA end = (VA)((uintptr_t)(sp - STACK_RED_ZONE) & Util::pageMask());
+    if (start < end) {
+      ranges->push_back(std::make_pair(start, end));
+    }
+  }
+}
+
 /*****************************************************************************
  *
  *  Wait for all threads to finish restoring their context, then release them
@@ -733,8 +900,8 @@ ThreadList::postRestartWork(double readTime)
     /* Create the thread so it can finish restoring itself. */
     pid_t tid = _real_clone(restarthread,
 
-                            // -128 for red zone
-                            (void *)((char *)thread->saved_sp - 128),
+                            (void *)((char *)thread->saved_sp -
+                                     STACK_RED_ZONE),
 
                             /* Don't do CLONE_SETTLS (it'll puke).  We do it
                              * later via restoreTLSState. */
@@ -790,15 +957,7 @@ restarthread(void *threadv)
 int
 Thread_UpdateState(Thread *th, ThreadState newval, ThreadState oldval)
 {
-  int res = 0;
-
-  JASSERT(DmtcpMutexLock(&threadStateLock) == 0);
-  if (oldval == th->state) {
-    th->state = newval;
-    res = 1;
-  }
-  JASSERT(DmtcpMutexUnlock(&threadStateLock) == 0);
-  return res;
+  return __sync_bool_compare_and_swap(&th->state, oldval, newval);
 }
 
 /*****************************************************************************
@@ -848,19 +1007,117 @@ Thread_RestoreSigState(Thread *th)
 
 /*****************************************************************************
  *
- * If there is a thread descriptor with the same tid, it must be from a dead
- * thread. Remove it now.
+ *  Unlink 'thread' from the activeThreads list; 'pred' is its predecessor,
+ *  or NULL if 'thread' was at the head when the caller looked.  New threads
+ *  are pushed at the head without taking threadlistLock, so the head may
+ *  have moved on since.  Removal is serialized by threadlistLock.
  *
  *****************************************************************************/
-void
-ThreadList::addToActiveList(Thread *th)
+static bool
+unlinkThread(Thread *pred, Thread *thread)
+{
+  if (pred == NULL) {
+    Thread *head = thread;
+    if (__atomic_compare_exchange_n(&activeThreads, &head, thread->next,
+                                    false, __ATOMIC_SEQ_CST,
+                                    __ATOMIC_SEQ_CST)) {
+      return true;
+    }
+
+    // Threads were pushed in front of us; find our predecessor.
+    for (pred = head; pred != NULL && pred->next != thread;
+         pred = pred->next) {
+    }
+    if (pred == NULL) {
+      return false;
+    }
+  }
+
+  pred->next = thread->next;
+  return true;
+}
+
+/*****************************************************************************
+ *
+ *  Put a thread descriptor on the lock-free threads_freelist.
+ *
+ *****************************************************************************/
+static void
+pushFreeList(Thread *first, Thread *last)
+{
+  Thread *head = __atomic_load_n(&threads_freelist, __ATOMIC_SEQ_CST);
+
+  do {
+    last->next = head;
+  } while (!__atomic_compare_exchange_n(&threads_freelist, &head, first,
+                                        true, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST));
+}
+
+static void
+releaseThread(Thread *thread)
+{
+  JTRACE("Putting thread on freelist") (thread->tid);
+
+  if (thread->exiting) {
+    __atomic_sub_fetch(&numExitingThreads, 1, __ATOMIC_SEQ_CST);
+  }
+  pushFreeList(thread, thread);
+}
+
+/*****************************************************************************
+ *
+ *  Remove the descriptors of dead threads from activeThreads.  Walking from
+ *  the head visits the newest descriptors first, so a descriptor whose tid
+ *  has already been seen belongs to a dead thread whose tid was recycled.
+ *  An exiting thread is dead once its tid is gone.
+ *
+ *  The caller must hold threadlistLock.
+ *
+ *****************************************************************************/
+static void
+removeDeadThreads()
 {
-  int tid;
+  unordered_set<pid_t> tids;
+  Thread *pred = NULL;
   Thread *thread;
-  Thread *next_thread;
+  Thread *next;
 
-  lock_threads();
+  for (thread = activeThreads; thread != NULL; thread = next) {
+    next = thread->next;
+
+    bool dead = false;
+    if (!tids.insert(thread->tid).second) {
+      JTRACE("Removing duplicate thread descriptor")
+        (thread->tid) (thread->virtual_tid);
+      dead = true;
+    } else if (thread->exiting &&
+               THREAD_TGKILL(motherpid, thread->tid, 0) == -1 &&
+               errno == ESRCH) {
+      JTRACE("Killing zombie thread") (thread->tid);
+      dead = true;
+    }
+
+    if (dead && unlinkThread(pred, thread)) {
+      releaseThread(thread);
+      continue;
+    }
 
+    pred = thread;
+  }
+}
+
+/*****************************************************************************
+ *
+ *  Push the new thread onto activeThreads.  This does not take
+ *  threadlistLock; descriptors of dead threads (including one with the same
+ *  tid as ours) are removed in batches, once enough threads have exited, and
+ *  before every checkpoint.
+ *
+ *****************************************************************************/
+void
+ThreadList::addToActiveList(Thread *th)
+{
   // CONTEXT:  After fork(), we called:
   // ... -> initializeMtcpEngine() -> ThreadList::init() -> initThread()
   // -> addToActiveList()
@@ -880,47 +1137,22 @@ ThreadList::addToActiveList(Thread *th)
   // So, that solution seems less general.  So, we'll handle it here, too:
   curThread = th;
 
-  tid = curThread->tid;
-  JASSERT(tid != 0);
-
-  // First remove duplicate descriptors.
-  for (thread = activeThreads; thread != NULL; thread = next_thread) {
-    next_thread = thread->next;
-    if (thread != curThread && thread->tid == tid) {
-      JTRACE("Removing duplicate thread descriptor")
-        (thread->tid) (thread->virtual_tid);
-
-      // There will be at most one duplicate descriptor.
-      threadIsDead(thread);
-      continue;
-    }
-
-    // FIXME:  This causes segfault on second restart.  Why?
-    // JASSERT(thread != curThread)(thread)
-    // .Text("adding curThread, but it's already on activeThreads");
-
-    /* NOTE:  ST_ZOMBIE is used only for the sake of efficiency.  We
-     *   test threads in state ST_ZOMBIE using tgkill to remove them
-     *   early (before reaching a checkpoint) so that the
-     *   threadrdescriptor list does not grow too long.
-     */
-    if (thread->exiting) {
-      /* if no thread with this tid, then we can remove zombie descriptor */
-      if (-1 == THREAD_TGKILL(motherpid, thread->tid, 0)) {
-        JTRACE("Killing zombie thread") (thread->tid);
-        threadIsDead(thread);
-      }
-    }
-  }
+  JASSERT(curThread->tid != 0);
 
-  curThread->next = activeThreads;
-  curThread->prev = NULL;
-  if (activeThreads != NULL) {
-    activeThreads->prev = curThread;
+  Thread *head = __atomic_load_n(&activeThreads, __ATOMIC_SEQ_CST);
+  do {
+    curThread->next = head;
+  } while (!__atomic_compare_exchange_n(&activeThreads, &head, curThread,
+                                        true, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST));
+
+  // Amortize the cleanup over thread creations.  Never wait for the lock
+  // here; whoever holds it is removing dead threads already.
+  if (__atomic_load_n(&numExitingThreads, __ATOMIC_SEQ_CST) >=
+      REAP_EXITING_THREADS && DmtcpMutexTryLock(&threadlistLock) == 0) {
+    removeDeadThreads();
+    unlk_threads();
   }
-  activeThreads = curThread;
-
-  unlk_threads();
 }
 
 /*****************************************************************************
@@ -940,42 +1172,48 @@ void
 ThreadList::threadIsDead(Thread *thread)
 {
   JASSERT(thread != NULL);
-  JTRACE("Putting thread on freelist") (thread->tid);
 
-  /* Remove thread block from 'threads' list */
-  if (thread->prev != NULL) {
-    thread->prev->next = thread->next;
-  }
-  if (thread->next != NULL) {
-    thread->next->prev = thread->prev;
-  }
-  if (thread == activeThreads) {
-    activeThreads = activeThreads->next;
+  /* Remove thread block from 'threads' list.  A thread whose creation failed
+   * never ran initThread() (tid == 0) and was never added to it; otherwise
+   * the caller must hold threadlistLock.
+   */
+  if (thread->tid != 0) {
+    Thread *pred = NULL;
+    if (thread != activeThreads) {
+      for (pred = activeThreads; pred != NULL && pred->next != thread;
+           pred = pred->next) {
+      }
+    }
+    if (pred != NULL || thread == activeThreads) {
+      unlinkThread(pred, thread);
+    }
   }
 
-  thread->next = threads_freelist;
-  threads_freelist = thread;
+  releaseThread(thread);
 }
 
 /*****************************************************************************
  *
- * Return thread from freelist.
+ * Return thread from freelist.  A thread takes the whole freelist into its
+ * private cache when its cache is empty; taking all of it at once is safe
+ * against concurrent pushes without a lock.
  *
  *****************************************************************************/
 Thread *
 ThreadList::allocNewThread()
 {
-  Thread *thread;
+  Thread *thread = threads_cache;
 
-  lock_threads();
-  if (threads_freelist == NULL) {
+  if (thread == NULL) {
+    thread = __atomic_exchange_n(&threads_freelist, NULL, __ATOMIC_SEQ_CST);
+  }
+
+  if (thread == NULL) {
     thread = (Thread *)JALLOC_HELPER_MALLOC(sizeof(Thread));
     JASSERT(thread != NULL);
   } else {
-    thread = threads_freelist;
-    threads_freelist = threads_freelist->next;
+    threads_cache = thread->next;
   }
-  unlk_threads();
   memset(thread, 0, sizeof(*thread));
   return thread;
 }
@@ -988,13 +1226,12 @@ ThreadList::allocNewThread()
 void
 ThreadList::emptyFreeList()
 {
-  lock_threads();
+  Thread *thread = __atomic_exchange_n(&threads_freelist, NULL,
+                                       __ATOMIC_SEQ_CST);
 
-  while (threads_freelist != NULL) {
-    Thread *thread = threads_freelist;
-    threads_freelist = threads_freelist->next;
+  while (thread != NULL) {
+    Thread *next = thread->next;
     JALLOC_HELPER_FREE(thread);
+    thread = next;
   }
-
-  unlk_threads();
 }
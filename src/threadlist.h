@@ -25,6 +25,8 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <ucontext.h>
+#include "dmtcpalloc.h"
+#include "procmapsarea.h"
 #include "threadinfo.h"
 
 namespace dmtcp
@@ -43,6 +45,8 @@ void addToActiveList(Thread *th);
 void threadIsDead(Thread *thread);
 void emptyFreeList();
 
+void waitForWrapperExit();
+
 void suspendThreads();
 void resumeThreads();
 
@@ -50,6 +54,7 @@ void vforkSuspendThreads();
 void vforkResumeThreads();
 
 void waitForAllRestored(Thread *thisthread);
+void getUnusedStackRanges(vector<std::pair<VA, VA> > *ranges);
 void writeCkpt();
 void postRestartWork(double readTime = 0.0);
 void postRestart(double readTime, int restartPause);
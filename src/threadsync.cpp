@@ -19,50 +19,56 @@
  *  <http://www.gnu.org/licenses/>.                                         *
  ****************************************************************************/
 
+#include <limits.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "futex.h"
 #include "jassert.h"
 #include "syscallwrappers.h"
 #include "threadinfo.h"
+#include "threadlist.h"
 #include "threadsync.h"
 #include "workerstate.h"
 
 using namespace dmtcp;
 
 /*
- * _wrapperExecutionLock is used to make the checkpoint safe by making sure
- *   that no user-thread is executing any DMTCP wrapper code when it receives
- *   the checkpoint signal.
+ * The wrapper-execution lock is used to make the checkpoint safe by making
+ *   sure that no user-thread is executing any DMTCP wrapper code when it
+ *   receives the checkpoint signal.
  * Working:
- *   On entering the wrapper in DMTCP, the user-thread acquires the read lock,
- *     and releases it before leaving the wrapper.
+ *   It is a reader-writer lock without a shared reader count.  On entering
+ *     the wrapper in DMTCP, the user-thread sets its own Thread::inWrapper
+ *     flag, and clears it before leaving the wrapper.  Readers only write to
+ *     their own Thread struct, so concurrent wrappers do not contend on a
+ *     shared cache line.
  *   When the Checkpoint-thread wants to send the SUSPEND signal to user
- *     threads, it must acquire the write lock. It is blocked until all the
- *     existing read-locks by user threads have been released. NOTE that this
- *     is a WRITER-PREFERRED lock.
+ *     threads, it must acquire the write lock: it publishes itself in
+ *     _wrapperExecutionWriter and then waits for the inWrapper flag of every
+ *     other thread to clear.  A reader that finds a writer published backs
+ *     off and waits for it.  NOTE that this is a WRITER-PREFERRED lock.
  *
  * There is a corner case too -- the newly created thread that has not been
  *   initialized yet; we need to take some extra efforts for that.
  * Here are the steps to handle the newly created uninitialized thread:
  *   A counter (_uninitializedThreadCount) for the number of newly
- *     created uninitialized threads is kept.  The counter is made
- *     thread-safe by using a mutex.
- *   The calling thread (parent) increments the counter before calling clone.
- *   The newly created child thread decrements the counter at the end of
- *     initialization in MTCP/DMTCP.
- *   After acquiring the Write lock, the checkpoint thread waits until the
- *     number of uninitialized threads is zero. At that point, no thread is
+ *     created uninitialized threads is kept.
+ *   The calling thread (parent) increments the counter and sets the child's
+ *     inWrapper flag before calling clone.
+ *   The newly created child thread clears its flag and decrements the counter
+ *     at the end of initialization in MTCP/DMTCP.
+ *   After all inWrapper flags are clear, the checkpoint thread waits until
+ *     the number of uninitialized threads is zero. At that point, no thread is
  *     executing in the clone wrapper and it is safe to do a checkpoint.
- *
- * XXX: Currently this security is provided only for the clone wrapper; this
- * should be extended to other calls as well.           -- KAPIL
  */
 
-// NOTE: PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP is not POSIX.
-static DmtcpRWLock _wrapperExecutionLock;
+// Virtual tid of the thread holding the write lock, or 0.
+static uint32_t _wrapperExecutionWriter = 0;
+static DmtcpMutex _wrapperExecutionWriterLock = DMTCP_MUTEX_INITIALIZER;
+static uint32_t _uninitializedThreadCount = 0;
 
 static DmtcpMutex libdlLock = DMTCP_MUTEX_INITIALIZER;
 static pid_t libdlLockOwner = 0;
@@ -85,10 +91,71 @@ dmtcp_libdlLockUnlock()
   ThreadSync::libdlLockUnlock();
 }
 
+static void
+wrapperExecutionLockInit()
+{
+  _wrapperExecutionWriter = 0;
+  DmtcpMutexInit(&_wrapperExecutionWriterLock, DMTCP_MUTEX_NORMAL);
+  _uninitializedThreadCount = 0;
+}
+
+static void
+wrapperExecutionLockRdLock(Thread *thread)
+{
+  while (1) {
+    __atomic_store_n(&thread->inWrapper, 1, __ATOMIC_SEQ_CST);
+    uint32_t writer = __atomic_load_n(&_wrapperExecutionWriter,
+                                      __ATOMIC_SEQ_CST);
+    if (writer == 0) {
+      return;
+    }
+
+    // A writer is waiting for us to leave.  Back off until it is done.
+    __atomic_store_n(&thread->inWrapper, 0, __ATOMIC_SEQ_CST);
+    futex_wake(&thread->inWrapper, 1);
+    while ((writer = __atomic_load_n(&_wrapperExecutionWriter,
+                                     __ATOMIC_SEQ_CST)) != 0) {
+      futex_wait(&_wrapperExecutionWriter, writer);
+    }
+  }
+}
+
+static void
+wrapperExecutionLockRdUnlock(Thread *thread)
+{
+  __atomic_store_n(&thread->inWrapper, 0, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&_wrapperExecutionWriter, __ATOMIC_SEQ_CST) != 0) {
+    futex_wake(&thread->inWrapper, 1);
+  }
+}
+
+static void
+wrapperExecutionLockWrLock()
+{
+  JASSERT(DmtcpMutexLock(&_wrapperExecutionWriterLock) == 0);
+  __atomic_store_n(&_wrapperExecutionWriter, dmtcp_gettid(), __ATOMIC_SEQ_CST);
+
+  ThreadList::waitForWrapperExit();
+
+  uint32_t count;
+  while ((count = __atomic_load_n(&_uninitializedThreadCount,
+                                  __ATOMIC_SEQ_CST)) != 0) {
+    futex_wait(&_uninitializedThreadCount, count);
+  }
+}
+
+static void
+wrapperExecutionLockWrUnlock()
+{
+  __atomic_store_n(&_wrapperExecutionWriter, 0, __ATOMIC_SEQ_CST);
+  futex_wake(&_wrapperExecutionWriter, INT_MAX);
+  JASSERT(DmtcpMutexUnlock(&_wrapperExecutionWriterLock) == 0);
+}
+
 void
 ThreadSync::initMotherOfAll()
 {
-  DmtcpRWLockInit(&_wrapperExecutionLock);
+  wrapperExecutionLockInit();
 }
 
 void
@@ -104,7 +171,7 @@ ThreadSync::acquireLocks()
   JASSERT(DmtcpMutexLock(&libdlLock) == 0);
 
   JTRACE("Waiting for other threads to exit DMTCP-Wrappers");
-  JASSERT(DmtcpRWLockWrLock(&_wrapperExecutionLock) == 0);
+  wrapperExecutionLockWrLock();
 
   JTRACE("Done acquiring all locks");
 }
@@ -115,15 +182,16 @@ ThreadSync::releaseLocks()
   JASSERT(WorkerState::currentState() == WorkerState::SUSPENDED);
 
   JTRACE("Releasing ThreadSync locks");
-  JASSERT(DmtcpRWLockUnlock(&_wrapperExecutionLock) == 0);
+  wrapperExecutionLockWrUnlock();
   JASSERT(DmtcpMutexUnlock(&libdlLock) == 0);
 }
 
 void
 ThreadSync::resetLocks(bool resetPresuspendEventHookLock)
 {
-  DmtcpRWLockInit(&_wrapperExecutionLock);
+  wrapperExecutionLockInit();
   curThread->wrapperLockCount = 0;
+  curThread->inWrapper = 0;
 
   DmtcpMutexInit(&libdlLock, DMTCP_MUTEX_NORMAL);
 
@@ -175,15 +243,13 @@ ThreadSync::wrapperExecutionLockLock()
     return lockAcquired;
   }
 
+  // Nothing to do if we already hold the lock exclusively.
   if ((WorkerState::currentState() == WorkerState::RUNNING ||
-       WorkerState::currentState() == WorkerState::PRESUSPEND)) {
+       WorkerState::currentState() == WorkerState::PRESUSPEND) &&
+      _wrapperExecutionWriter != (uint32_t)dmtcp_gettid()) {
     if (curThread->wrapperLockCount == 0) {
       // If we don't have a lock, acquire it now.
-      if (DmtcpRWLockRdLock(&_wrapperExecutionLock) != 0) {
-        fprintf(stderr, "ERROR %d at %s:%d %s: Failed to acquire lock\n",
-                errno, __FILE__, __LINE__, __PRETTY_FUNCTION__);
-        _exit(DMTCP_FAIL_RC);
-      }
+      wrapperExecutionLockRdLock(curThread);
     }
     curThread->wrapperLockCount++;
     lockAcquired = true;
@@ -199,11 +265,10 @@ ThreadSync::wrapperExecutionLockLockForNewThread(Thread *thread)
   JASSERT(thread != nullptr);
   JASSERT(thread->wrapperLockCount == 0);
 
-  if (DmtcpRWLockRdLockIgnoreQueuedWriter(&_wrapperExecutionLock) != 0) {
-    fprintf(stderr, "ERROR %d at %s:%d %s: Failed to acquire lock\n",
-            errno, __FILE__, __LINE__, __PRETTY_FUNCTION__);
-    _exit(DMTCP_FAIL_RC);
-  }
+  // We hold a read lock ourselves, so no writer can get past us; there is no
+  // need to check for one.
+  __atomic_add_fetch(&_uninitializedThreadCount, 1, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&thread->inWrapper, 1, __ATOMIC_SEQ_CST);
 
   thread->wrapperLockCount++;
 }
@@ -214,13 +279,14 @@ ThreadSync::wrapperExecutionLockUnlockForNewThread(Thread *thread)
   JASSERT(thread != nullptr);
   JASSERT(thread->wrapperLockCount == 1);
 
-  if (DmtcpRWLockUnlock(&_wrapperExecutionLock) != 0) {
-    fprintf(stderr, "ERROR %d at %s:%d %s: Failed to release lock\n",
-            errno, __FILE__, __LINE__, __PRETTY_FUNCTION__);
-    _exit(DMTCP_FAIL_RC);
-  }
-
   thread->wrapperLockCount = 0;
+  wrapperExecutionLockRdUnlock(thread);
+
+  if (__atomic_sub_fetch(&_uninitializedThreadCount, 1,
+                         __ATOMIC_SEQ_CST) == 0 &&
+      __atomic_load_n(&_wrapperExecutionWriter, __ATOMIC_SEQ_CST) != 0) {
+    futex_wake(&_uninitializedThreadCount, 1);
+  }
 }
 
 /*
@@ -267,11 +333,7 @@ ThreadSync::wrapperExecutionLockLockExcl()
 
   if (WorkerState::currentState() == WorkerState::RUNNING ||
       WorkerState::currentState() == WorkerState::PRESUSPEND) {
-    if (DmtcpRWLockWrLock(&_wrapperExecutionLock) != 0) {
-      fprintf(stderr, "ERROR %s:%d %s: Failed to acquire lock\n",
-              __FILE__, __LINE__, __PRETTY_FUNCTION__);
-      _exit(DMTCP_FAIL_RC);
-    }
+    wrapperExecutionLockWrLock();
     curThread->wrapperLockCount++;
   }
   errno = saved_errno;
@@ -292,11 +354,12 @@ ThreadSync::wrapperExecutionLockUnlock()
   JASSERT(curThread->wrapperLockCount != 0);
   curThread->wrapperLockCount -= 1;
 
-  if (curThread->wrapperLockCount == 0 &&
-      DmtcpRWLockUnlock(&_wrapperExecutionLock) != 0) {
-    fprintf(stderr, "ERROR %s:%d %s: Failed to release lock.\n",
-            __FILE__, __LINE__, __PRETTY_FUNCTION__);
-    _exit(DMTCP_FAIL_RC);
+  if (curThread->wrapperLockCount == 0) {
+    if (_wrapperExecutionWriter == (uint32_t)dmtcp_gettid()) {
+      wrapperExecutionLockWrUnlock();
+    } else {
+      wrapperExecutionLockRdUnlock(curThread);
+    }
   }
 
   errno = saved_errno;
@@ -64,7 +64,7 @@ processChildThread(Thread *thread)
   JASSERT(_real_pthread_sigmask(SIG_UNBLOCK, &set, NULL) == 0) (JASSERT_ERRNO);
 
   // Lock was acquired by the parent thread on our behalf.
-  ThreadSync::wrapperExecutionLockUnlock();
+  ThreadSync::wrapperExecutionLockUnlockForNewThread(thread);
 }
 
 // Invoked via pthread_create as start_routine
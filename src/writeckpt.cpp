@@ -29,6 +29,7 @@
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <algorithm>
 #include "jassert.h"
 #include "jfilesystem.h"
 #include "constants.h"
@@ -37,6 +38,7 @@
 #include "procmapsarea.h"
 #include "procselfmaps.h"
 #include "shareddata.h"
+#include "threadlist.h"
 #include "util.h"
 
 #define DEV_ZERO_DELETED_STR "/dev/zero (deleted)"
@@ -57,30 +59,45 @@ EXTERNC int dmtcp_infiniband_enabled(void) __attribute__((weak));
 ProcSelfMaps *procSelfMaps = NULL;
 vector<ProcMapsArea> *nscdAreas = NULL;
 
-// FIXME:  If we allocate in the middle of reading
-// /proc/self/maps, we modify the mapping.  But whenever we
-// add to nscdAreas, we risk allocating memory.  So, we're depending
-// on this memory being smaller than any pre-allocated memory,
-// so that the memory allocator does not call mmap in the middle
-// of reading /proc/self/maps.  A better design would be to create
-// an nscdArea method of the ProcSelfMaps class, and that
-// class can then be careful about allocating memory.
+// If we allocate in the middle of reading /proc/self/maps, we modify the
+// mapping.  So, nscdAreas keeps room for NSCD_AREAS_RESERVED entries, and is
+// only grown before /proc/self/maps is read again; see findNscdAreas().
+#define NSCD_AREAS_RESERVED 8
 
 
+/* Parts of the thread stacks below the saved stack pointers, sorted by
+ * address.  They are written as zero pages.  See
+ * ThreadList::getUnusedStackRanges().
+ */
+static vector<std::pair<VA, VA> > *unusedStackRanges = NULL;
+
 /* Internal routines */
 
 // static void sync_shared_mem(void);
 static void writememoryarea(int fd, Area area);
 static void mtcp_write_anonymous_pages(int fd, Area area);
 
+static size_t findNscdAreas();
 static void remap_nscd_areas(const vector<ProcMapsArea> &areas);
 
+// Uncompressed size of the memory section of the image being written.
+static uint64_t imageBytesWritten = 0;
+
+static void
+writeImageData(int fd, const void *buf, size_t len)
+{
+  JASSERT(Util::writeAll(fd, buf, len) == (ssize_t)len)
+    (buf) (len) (JASSERT_ERRNO)
+  .Text("writeAll failed during ckpt");
+  imageBytesWritten += len;
+}
+
 static void
 writeAreaHeader(int fd, Area *area)
 {
   JASSERT(area->addr + area->size == area->endAddr)
     ((void*)area->addr)((int)area->size);
-  JASSERT(Util::writeAll(fd, area, sizeof(*area)) == (ssize_t) sizeof(*area));
+  writeImageData(fd, area, sizeof(*area));
 }
 
 /*****************************************************************************
@@ -93,12 +110,13 @@ writeAreaHeader(int fd, Area *area)
  *  this function which can cause memory leaks.
  *
  *****************************************************************************/
-void
+uint64_t
 mtcp_writememoryareas(int fd)
 {
   Area area;
 
   JTRACE("Performing checkpoint.");
+  imageBytesWritten = 0;
 
   // Here we want to sync the shared memory pages with the backup files
   // FIXME: Why do we need this?
@@ -112,29 +130,16 @@ mtcp_writememoryareas(int fd)
   /* inconsistent state.  See note in restoreverything routine.             */
   /**************************************************************************/
 
-  {
-    if (nscdAreas == NULL) {
-      nscdAreas = new vector<ProcMapsArea>();
-    }
-    nscdAreas->clear();
-
-    // This block is to ensure that the object is deleted as soon as we leave
-    // this block.
-    ProcSelfMaps procSelfMaps;
-
-    // Preprocess memory regions as needed.
-    while (procSelfMaps.getNextArea(&area)) {
-      if (Util::isNscdArea(area)) {
-        /* Special Case Handling: nscd is enabled*/
-        JTRACE("NSCD daemon shared memory area present.\n"
-               "  DMTCP will now try to remap this area in read/write mode as\n"
-               "  private (zero pages), so that glibc will automatically\n"
-               "  stop using NSCD or ask NSCD daemon for new shared area\n")
-          (area.name);
+  // This must be populated before we start reading /proc/self/maps below.
+  if (unusedStackRanges == NULL) {
+    unusedStackRanges = new vector<std::pair<VA, VA> >();
+  }
+  ThreadList::getUnusedStackRanges(unusedStackRanges);
+  std::sort(unusedStackRanges->begin(), unusedStackRanges->end());
 
-        nscdAreas->push_back(area);
-      }
-    }
+  if (nscdAreas == NULL) {
+    nscdAreas = new vector<ProcMapsArea>();
+    nscdAreas->reserve(NSCD_AREAS_RESERVED);
   }
 
   if (procSelfMaps != NULL) {
@@ -149,6 +154,18 @@ mtcp_writememoryareas(int fd)
     (ProcessInfo::instance().restoreBufLen());
   procSelfMaps = new ProcSelfMaps();
 
+  // The nscd areas come from the same snapshot.  If there are more of them
+  // than nscdAreas has room for, growing it may mmap, so take the snapshot
+  // again afterwards.
+  size_t numNscdAreas = findNscdAreas();
+  if (numNscdAreas > nscdAreas->capacity()) {
+    nscdAreas->reserve(numNscdAreas);
+    delete procSelfMaps;
+    procSelfMaps = new ProcSelfMaps();
+    findNscdAreas();
+  }
+  procSelfMaps->rewind();
+
   // We must not cause an mmap() here, or the mem regions will not be correct.
   while (procSelfMaps->getNextArea(&area)) {
     // TODO(kapil): Verify that we are not doing any operation that might
@@ -241,7 +258,8 @@ mtcp_writememoryareas(int fd)
       continue;
     } else if (0 == strcmp(area.name, "[vsyscall]") ||
                0 == strcmp(area.name, "[vectors]") ||
-               0 == strcmp(area.name, "[vvar]")) {
+               0 == strcmp(area.name, "[vvar]") ||
+               0 == strcmp(area.name, "[vvar_vclock]")) {
       // NOTE: We can't trust kernel's "[vdso]" label here.  See below.
       JTRACE("skipping over memory special section")
         (area.name) ((void*)area.addr) (area.size);
@@ -345,10 +363,39 @@ mtcp_writememoryareas(int fd)
 
   area.addr = NULL; // End of data
   area.size = -1; // End of data
-  JASSERT(Util::writeAll(fd, &area, sizeof(area)) == sizeof(area));
+  writeImageData(fd, &area, sizeof(area));
 
   /* That's all folks */
   JASSERT(_real_close(fd) == 0);
+  return imageBytesWritten;
+}
+
+/* Collects the nscd areas of procSelfMaps into nscdAreas, as far as it has
+ * room for them without allocating.  Returns the number of nscd areas.
+ */
+static size_t
+findNscdAreas()
+{
+  ProcMapsArea area;
+  size_t numNscdAreas = 0;
+
+  nscdAreas->clear();
+  procSelfMaps->rewind();
+  while (procSelfMaps->getNextArea(&area)) {
+    if (Util::isNscdArea(area)) {
+      /* Special Case Handling: nscd is enabled*/
+      JTRACE("NSCD daemon shared memory area present.\n"
+             "  DMTCP will now try to remap this area in read/write mode as\n"
+             "  private (zero pages), so that glibc will automatically\n"
+             "  stop using NSCD or ask NSCD daemon for new shared area\n")
+        (area.name);
+      if (numNscdAreas < nscdAreas->capacity()) {
+        nscdAreas->push_back(area);
+      }
+      numNscdAreas++;
+    }
+  }
+  return numNscdAreas;
 }
 
 static void
@@ -392,6 +439,25 @@ mtcp_get_next_page_range(Area *area, size_t *size, int *is_zero)
   }
 }
 
+static bool
+range_end_less(const std::pair<VA, VA> &a, const std::pair<VA, VA> &b)
+{
+  return a.second < b.second;
+}
+
+/* Returns the first unused stack range that ends beyond 'addr', or NULL. */
+static const std::pair<VA, VA> *
+next_unused_stack_range(VA addr)
+{
+  vector<std::pair<VA, VA> >::const_iterator it;
+
+  // The ranges come from distinct thread stacks, so they don't overlap and
+  // their ends are sorted as well.
+  it = std::upper_bound(unusedStackRanges->begin(), unusedStackRanges->end(),
+                        std::make_pair(addr, addr), range_end_less);
+  return it == unusedStackRanges->end() ? NULL : &*it;
+}
+
 static void
 mtcp_write_anonymous_pages(int fd, Area area)
 {
@@ -406,12 +472,28 @@ mtcp_write_anonymous_pages(int fd, Area area)
   while (area.size > 0) {
     size_t size;
     int is_zero;
+    bool unused_stack = false;
     Area a = area;
-    if (dmtcp_infiniband_enabled && dmtcp_infiniband_enabled()) {
-      size = area.size;
-      is_zero = 0;
+    const std::pair<VA, VA> *stack = next_unused_stack_range(a.addr);
+    if (stack != NULL && stack->first <= a.addr) {
+      // Unused part of a thread stack; don't bother scanning it.  Its stale
+      // contents are left in place (no MADV_DONTNEED below); only a restarted
+      // process sees zeros there.
+      size = MIN(stack->second, a.endAddr) - a.addr;
+      is_zero = 1;
+      unused_stack = true;
     } else {
-      mtcp_get_next_page_range(&a, &size, &is_zero);
+      if (stack != NULL && stack->first < a.endAddr) {
+        // Stop at the unused part of a thread stack.
+        a.size = stack->first - a.addr;
+        a.endAddr = stack->first;
+      }
+      if (dmtcp_infiniband_enabled && dmtcp_infiniband_enabled()) {
+        size = a.size;
+        is_zero = 0;
+      } else {
+        mtcp_get_next_page_range(&a, &size, &is_zero);
+      }
     }
 
     a.properties = is_zero ? DMTCP_ZERO_PAGE : 0;
@@ -422,9 +504,8 @@ mtcp_write_anonymous_pages(int fd, Area area)
     writeAreaHeader(fd, &a);
 
     if (!is_zero) {
-      JASSERT(Util::writeAll(fd, a.addr, a.size) == (ssize_t) a.size)
-        .Text("writeAll failed during ckpt");
-    } else {
+      writeImageData(fd, a.addr, a.size);
+    } else if (!unused_stack) {
       if (madvise(a.addr, a.size, MADV_DONTNEED) == -1) {
         JTRACE("error doing madvise(..., MADV_DONTNEED)")
           (JASSERT_ERRNO) ((void *)a.addr) ((int)a.size);
@@ -480,10 +561,9 @@ writememoryarea(int fd, Area area)
     // NOTE: We cannot use lseek(SEEK_CUR) to detect how much data was
     // actually written here. This is because fd might be a pipe to gzip.
     if (area.mmapFileSize > 0) {
-      JASSERT(Util::writeAll(fd, area.addr, area.mmapFileSize) ==
-              (ssize_t)area.mmapFileSize);
+      writeImageData(fd, area.addr, area.mmapFileSize);
     } else {
-      JASSERT(Util::writeAll(fd, area.addr, area.size) == (ssize_t)area.size);
+      writeImageData(fd, area.addr, area.size);
     }
   }
 }
@@ -213,6 +213,10 @@ coordinator_cmdline = BIN+"dmtcp_coordinator --timeout 10800"
 #Checkpoint command to send to coordinator
 CKPT_CMD=b'c'
 
+#Checkpoints taken before each restart; the later ones find the checkpoint
+#  directory left by the earlier ones
+CKPTS_PER_RESTART=1
+
 #Appears as S*SLOW in code.  If --slow, then SLOW=5
 SLOW = pow(5, args.slow)
 TIMEOUT *= SLOW
@@ -450,6 +454,13 @@ def coordinatorCmd(cmd):
     raise CheckFailed("failed to write '%s' to coordinator (pid: %d)" %
                       (cmd, coordinator.pid))
 
+#replace the coordinator with one run from a new command line, on the same port
+def restartCoordinator(cmdline):
+  global coordinator
+  coordinatorCmd(b'q')
+  coordinator.wait()
+  coordinator = runCmd(cmdline)
+
 #clean up after ourselves
 def SHUTDOWN():
   try:
@@ -633,6 +644,13 @@ def runTestRaw(name, numProcs, cmds):
       CHECK(doesStatusSatisfy(getStatus(), status),
             "error: processes checkpointed, but died upon resume")
 
+  def removeCkptImages():
+    #keep the files saved with the images, so that the next checkpoint
+    #  updates them, but let testCheckpoint() wait for the new images
+    for f in os.listdir(ckptDir):
+      if f.startswith("ckpt_") and f.endswith(".dmtcp"):
+        os.remove(os.path.join(ckptDir, f))
+
   def testRestart():
     #build restart command
     cmd=BIN+"dmtcp_restart --quiet"
@@ -690,6 +708,10 @@ def runTestRaw(name, numProcs, cmds):
       #wait for launched processes to settle down, before we try to checkpoint
       sleep(S*SLOW)
       testCheckpoint()
+      for j in range(1, CKPTS_PER_RESTART):
+        removeCkptImages()
+        sleep(S*SLOW)
+        testCheckpoint()
       printFixed("PASSED; ")
       testKill()
 
@@ -828,6 +850,16 @@ runTest("dmtcp3",        1, ["./test/dmtcp3"])
 
 runTest("dmtcp4",        1, ["./test/dmtcp4"])
 
+# Checkpoint writes throttled to one writer at a time, with and without
+# forked checkpointing.  Forked workers are not throttled, but must still
+# checkpoint and restart under a coordinator that throttles.
+restartCoordinator(coordinator_cmdline + " --ckpt-write-limit 1")
+runTest("ckpt-write-limit", 2, ["./test/dmtcp1", "./test/dmtcp1"])
+os.environ['DMTCP_FORKED_CHECKPOINT'] = "1"
+runTest("forked-ckpt",   2, ["./test/dmtcp1", "./test/dmtcp1"])
+del os.environ['DMTCP_FORKED_CHECKPOINT']
+restartCoordinator(coordinator_cmdline)
+
 runTest("alarm",        1, ["./test/alarm"])
 
 runTest("sched_test",    2, ["./test/sched_test"])
@@ -875,6 +907,24 @@ S=10*DEFAULT_S
 runTest("file2",         1, ["./test/file2"])
 S=DEFAULT_S
 
+# Test for checkpointed copies of open files: a deleted file that changes
+# between checkpoints, and an unchanged file that still exists at restart.
+runTest("ckpt-file1",    1, ["--ckpt-open-files ./test/ckpt-file1"])
+
+# Same, but the unchanged file is overwritten with its saved copy at restart.
+runTest("ckpt-file2",    1, ["--ckpt-open-files --allow-file-overwrite "+
+                             "./test/ckpt-file1"])
+
+# Same, but checkpoint twice before each restart.  The second checkpoint
+# updates the saved copy of the deleted file in place; the file is recreated
+# from that copy at restart.  The longer S lets the file change and resize
+# between the two checkpoints.
+S=10*DEFAULT_S
+CKPTS_PER_RESTART=2
+runTest("ckpt-file3",    1, ["--ckpt-open-files ./test/ckpt-file1"])
+CKPTS_PER_RESTART=1
+S=DEFAULT_S
+
 # Test for normal file, /dev/tty, proc file, and illegal pathname
 runTest("stat",         1, ["./test/stat"])
 
@@ -914,6 +964,8 @@ runTest("shared-fd2",     2, ["./test/shared-fd2"])
 
 runTest("stale-fd",       2, ["./test/stale-fd"])
 
+runTest("socketpair1",    1, ["./test/socketpair1"])
+
 runTest("rlimit-restore", 1, ["./test/rlimit-restore"])
 
 runTest("rlimit-nofile",  2, ["./test/rlimit-nofile"])
@@ -1000,6 +1052,15 @@ if not USE_M32:  # waitpid forks a 64-bit child process, /bin/sleep
 
 runTest("client-server", 2, ["./test/client-server"])
 
+runTest("uds-client-server", 2, ["./test/uds-client-server"])
+
+# Many connections to reconnect at restart, only a few connects at a time.
+os.environ['DMTCP_RESTORE_MAX_CONNECTS'] = "4"
+runTest("many-sockets",  2, ["./test/many-sockets"])
+del os.environ['DMTCP_RESTORE_MAX_CONNECTS']
+
+runTest("datagram1",     1, ["./test/datagram1"])
+
 # frisbee creates three processes, each with 14 MB, if no gzip is used
 os.environ['DMTCP_GZIP'] = "1"
 POST_LAUNCH_SLEEP=2
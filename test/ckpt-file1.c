@@ -0,0 +1,129 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Checkpointed copies of open files.  The test keeps two files open:
+//   - a file opened read-write and then unlinked, so that it is saved with
+//     the checkpoint and recreated from the saved copy at restart.  Each
+//     round overwrites a few bytes at a random offset and sometimes grows or
+//     shrinks the file.  The file is checked against a copy kept in memory.
+//   - a file that is never modified.  Run with --ckpt-open-files, it is
+//     saved too, and at restart the existing file is checked against the
+//     saved copy.
+// Memory is always updated before the file, so that a checkpoint between the
+// two is caught up by the write that follows it.
+
+#define MAX_SIZE (3 * 1024 * 1024 / 2)
+#define FIXED_SIZE (200 * 1024 + 17)
+
+static char contents[MAX_SIZE];
+static char buf[MAX_SIZE];
+static off_t size;
+
+static void
+check(int fd, int round)
+{
+  struct stat st;
+
+  if (fstat(fd, &st) == -1 || st.st_size != size) {
+    fprintf(stderr, "round %d: file size %ld, expected %ld\n",
+            round, (long)st.st_size, (long)size);
+    exit(1);
+  }
+  if (pread(fd, buf, size, 0) != size || memcmp(buf, contents, size) != 0) {
+    fprintf(stderr, "round %d: file contents differ\n", round);
+    exit(1);
+  }
+}
+
+static int
+createFile(const char *dir, const char *name, off_t len, char *filename)
+{
+  int fd;
+
+  sprintf(filename, "%s/%s_XXXXXX", dir, name);
+  fd = mkstemp(filename);
+  if (fd == -1) {
+    perror("mkstemp");
+    exit(1);
+  }
+  if (write(fd, contents, len) != len) {
+    perror("write");
+    exit(1);
+  }
+  return fd;
+}
+
+int
+main()
+{
+  char *dir = getenv("DMTCP_TMPDIR");
+  char filename[256];
+  int fd;
+  int round;
+  off_t i;
+
+  if (!dir) {
+    dir = getenv("TMPDIR");
+  }
+  if (!dir) {
+    dir = "/tmp";
+  }
+  if (strlen(dir) + sizeof("/ckpt_file1_fixed_XXXXXX") > sizeof(filename)) {
+    printf("Directory string too large.\n");
+    return 1;
+  }
+
+  size = MAX_SIZE * 2 / 3 + 123;
+  for (i = 0; i < size; i++) {
+    contents[i] = (char)(i * 13);
+  }
+  // The unmodified file stays small: it is left behind when the test is
+  // killed.
+  createFile(dir, "ckpt_file1_fixed", FIXED_SIZE, filename);
+  fd = createFile(dir, "ckpt_file1", size, filename);
+  unlink(filename);
+  srand(getpid());
+
+  for (round = 0;; round++) {
+    int r = rand();
+    off_t offset = r % size;
+    off_t len = 1 + r % 100;
+    off_t newSize;
+
+    if (offset + len > size) {
+      len = size - offset;
+    }
+    for (i = offset; i < offset + len; i++) {
+      contents[i] = (char)(round + i);
+    }
+    if (pwrite(fd, contents + offset, len, offset) != len) {
+      perror("pwrite");
+      return 1;
+    }
+
+    if (round % 10 == 0) {
+      newSize = MAX_SIZE / 2 + r % (MAX_SIZE / 2);
+      if (newSize > size) {
+        memset(contents + size, 0, newSize - size);
+      }
+      size = newSize;
+      if (ftruncate(fd, size) == -1) {
+        perror("ftruncate");
+        return 1;
+      }
+    }
+
+    check(fd, round);
+    if (round % 10 == 0) {
+      printf("%d ", round);
+      fflush(stdout);
+    }
+    usleep(100000);
+  }
+  return 0;
+}
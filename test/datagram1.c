@@ -0,0 +1,148 @@
+#define _DEFAULT_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Datagram sockets with datagrams queued at checkpoint time.  Each round
+// sends a batch of datagrams to a UDP socket, to a UNIX domain socket bound
+// to a path, and over a connected UDP pair, sleeps with the datagrams queued,
+// and then reads them back without blocking.  A lost, reordered, truncated or
+// extra datagram ends the process.
+
+static const int sizes[] = { 10, 0, 5000, 100, 2048, 4096, 1, 60000, 33 };
+#define NUM_SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+static char buf[65536];
+static char expected[65536];
+
+static void
+fill(char *b, int size, int round, int seq)
+{
+  int i;
+
+  for (i = 0; i < size; i++) {
+    b[i] = (char)(round * 7 + seq * 31 + i);
+  }
+}
+
+static void
+sendBatch(int sd, const struct sockaddr *addr, socklen_t len, int round)
+{
+  int seq;
+
+  for (seq = 0; seq < NUM_SIZES; seq++) {
+    fill(buf, sizes[seq], round, seq);
+    if (sendto(sd, buf, sizes[seq], 0, addr, len) != sizes[seq]) {
+      perror("sendto");
+      exit(1);
+    }
+  }
+}
+
+static void
+checkBatch(const char *name, int sd, int round)
+{
+  int seq;
+  ssize_t rc;
+
+  for (seq = 0; seq < NUM_SIZES; seq++) {
+    rc = recv(sd, buf, sizeof(buf), MSG_DONTWAIT);
+    fill(expected, sizes[seq], round, seq);
+    if (rc != sizes[seq] || memcmp(buf, expected, sizes[seq]) != 0) {
+      fprintf(stderr, "%s: round %d, datagram %d: got %zd bytes, expected %d"
+                      " (errno %d)\n", name, round, seq, rc, sizes[seq], errno);
+      exit(1);
+    }
+  }
+  rc = recv(sd, buf, sizeof(buf), MSG_DONTWAIT);
+  if (rc != -1) {
+    fprintf(stderr, "%s: round %d: extra datagram of %zd bytes\n",
+            name, round, rc);
+    exit(1);
+  }
+}
+
+static int
+udpSocket(struct sockaddr_in *addr)
+{
+  socklen_t len = sizeof(*addr);
+  int sd = socket(AF_INET, SOCK_DGRAM, 0);
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (sd == -1 ||
+      bind(sd, (struct sockaddr *)addr, sizeof(*addr)) == -1 ||
+      getsockname(sd, (struct sockaddr *)addr, &len) == -1) {
+    perror("udp socket");
+    exit(1);
+  }
+  return sd;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sockaddr_in udpAddr, peerAddr, connAddr;
+  struct sockaddr_un unixAddr;
+  int udp, unixSd, peer, conn, sender, unixSender;
+  int round;
+
+  // A UDP receiver, and a UDP pair connected in one direction.
+  udp = udpSocket(&udpAddr);
+  peer = udpSocket(&peerAddr);
+  conn = udpSocket(&connAddr);
+  if (connect(conn, (struct sockaddr *)&peerAddr, sizeof(peerAddr)) == -1) {
+    perror("connect");
+    return 1;
+  }
+
+  // A UNIX domain receiver bound to a path.
+  memset(&unixAddr, 0, sizeof(unixAddr));
+  unixAddr.sun_family = AF_UNIX;
+  snprintf(unixAddr.sun_path, sizeof(unixAddr.sun_path),
+           "/tmp/dmtcp-datagram1-%d", getpid());
+  unlink(unixAddr.sun_path);
+  unixSd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (bind(unixSd, (struct sockaddr *)&unixAddr, sizeof(unixAddr)) == -1) {
+    perror("bind");
+    return 1;
+  }
+
+  sender = socket(AF_INET, SOCK_DGRAM, 0);
+  unixSender = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+  for (round = 0;; round++) {
+    sendBatch(sender, (struct sockaddr *)&udpAddr, sizeof(udpAddr), round);
+    sendBatch(unixSender, (struct sockaddr *)&unixAddr, sizeof(unixAddr),
+              round);
+    sendBatch(peer, (struct sockaddr *)&connAddr, sizeof(connAddr), round);
+
+    // Most checkpoints are taken here, with the datagrams queued.
+    usleep(500000);
+
+    checkBatch("udp", udp, round);
+    checkBatch("unix", unixSd, round);
+    checkBatch("connected", conn, round);
+
+    // The connected socket still sends to its peer.
+    if (send(conn, &round, sizeof(round), 0) != sizeof(round) ||
+        recv(peer, buf, sizeof(buf), MSG_DONTWAIT) != sizeof(round) ||
+        memcmp(buf, &round, sizeof(round)) != 0) {
+      fprintf(stderr, "connected: round %d: send to peer failed (errno %d)\n",
+              round, errno);
+      return 1;
+    }
+
+    printf("%d ", round);
+    fflush(stdout);
+  }
+  return 0;
+}
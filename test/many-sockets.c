@@ -0,0 +1,127 @@
+#define _DEFAULT_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Many connections between two processes, so that restart has many sockets
+// to reconnect at once: NUM_CONNS TCP and NUM_CONNS UNIX domain connections.
+// The client sends a sequence number over each connection in turn, and the
+// server adds one and sends it back.
+
+#define NUM_CONNS 64
+
+static void
+ping(int *sd, int num, int round)
+{
+  int i, reply;
+
+  for (i = 0; i < num; i++) {
+    int request = round * num + i;
+    if (write(sd[i], &request, sizeof(request)) != sizeof(request)) {
+      perror("write");
+      exit(1);
+    }
+  }
+  for (i = 0; i < num; i++) {
+    if (read(sd[i], &reply, sizeof(reply)) != sizeof(reply) ||
+        reply != round * num + i + 1) {
+      fprintf(stderr, "client: connection %d, round %d: got %d (errno %d)\n",
+              i, round, reply, errno);
+      exit(1);
+    }
+  }
+}
+
+static void
+pong(int *sd, int num)
+{
+  int i, request;
+
+  for (i = 0; i < num; i++) {
+    if (read(sd[i], &request, sizeof(request)) != sizeof(request)) {
+      exit(0);
+    }
+    request++;
+    if (write(sd[i], &request, sizeof(request)) != sizeof(request)) {
+      exit(0);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sockaddr_in inAddr;
+  struct sockaddr_un unAddr;
+  socklen_t len = sizeof(inAddr);
+  int inListener, unListener;
+  int sd[2 * NUM_CONNS];
+  int round, i;
+
+  memset(&inAddr, 0, sizeof(inAddr));
+  inAddr.sin_family = AF_INET;
+  inAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  inListener = socket(AF_INET, SOCK_STREAM, 0);
+  if (bind(inListener, (struct sockaddr *)&inAddr, sizeof(inAddr)) == -1 ||
+      getsockname(inListener, (struct sockaddr *)&inAddr, &len) == -1 ||
+      listen(inListener, NUM_CONNS) == -1) {
+    perror("tcp listener");
+    return 1;
+  }
+
+  memset(&unAddr, 0, sizeof(unAddr));
+  unAddr.sun_family = AF_UNIX;
+  snprintf(unAddr.sun_path, sizeof(unAddr.sun_path),
+           "/tmp/dmtcp-many-sockets-%d", getpid());
+  unlink(unAddr.sun_path);
+  unListener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (bind(unListener, (struct sockaddr *)&unAddr, sizeof(unAddr)) == -1 ||
+      listen(unListener, NUM_CONNS) == -1) {
+    perror("unix listener");
+    return 1;
+  }
+
+  if (fork() > 0) { /* parent: client */
+    close(inListener);
+    close(unListener);
+    for (i = 0; i < NUM_CONNS; i++) {
+      sd[i] = socket(AF_INET, SOCK_STREAM, 0);
+      sd[NUM_CONNS + i] = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (connect(sd[i], (struct sockaddr *)&inAddr, sizeof(inAddr)) == -1 ||
+          connect(sd[NUM_CONNS + i], (struct sockaddr *)&unAddr,
+                  sizeof(unAddr)) == -1) {
+        perror("connect");
+        return 1;
+      }
+    }
+    unlink(unAddr.sun_path);
+    for (round = 0;; round++) {
+      ping(sd, 2 * NUM_CONNS, round);
+      if (round % 100 == 0) {
+        printf("%d ", round);
+        fflush(stdout);
+      }
+      usleep(10000);
+    }
+  } else { /* child: server */
+    for (i = 0; i < NUM_CONNS; i++) {
+      sd[i] = accept(inListener, NULL, NULL);
+      sd[NUM_CONNS + i] = accept(unListener, NULL, NULL);
+      if (sd[i] == -1 || sd[NUM_CONNS + i] == -1) {
+        perror("accept");
+        return 1;
+      }
+    }
+    while (1) {
+      pong(sd, 2 * NUM_CONNS);
+    }
+  }
+  return 0;
+}
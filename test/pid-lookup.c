@@ -0,0 +1,90 @@
+/* Microbenchmark for pid translation in the pid plugin.
+ *
+ * Usage:  pid-lookup [NUM_CHILDREN [NUM_CALLS]]
+ *
+ * Forks NUM_CHILDREN idle children, so that the virtual pid table holds at
+ * least that many mappings, and then times:
+ *   kill(child, 0)  -- translates a virtual pid to a real one;
+ *   getpgrp()       -- translates a real pid to a virtual one.
+ * Run it natively and under dmtcp_launch; the difference is the cost of the
+ * translation.  The cost should not grow with NUM_CHILDREN.
+ *
+ * This is a benchmark, not a checkpoint test: it exits when done.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double
+now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int numChildren = argc > 1 ? atoi(argv[1]) : 256;
+  long numCalls = argc > 2 ? atol(argv[2]) : 1000000;
+  pid_t *children = malloc(numChildren * sizeof(pid_t));
+  int i;
+  long n;
+
+  if (numChildren < 1 || numCalls < 1 || children == NULL) {
+    fprintf(stderr, "Usage: %s [NUM_CHILDREN [NUM_CALLS]]\n", argv[0]);
+    return 1;
+  }
+
+  for (i = 0; i < numChildren; i++) {
+    children[i] = fork();
+    if (children[i] == -1) {
+      perror("fork");
+      numChildren = i;
+      break;
+    }
+    if (children[i] == 0) {
+      while (1) {
+        pause();
+      }
+    }
+  }
+
+  double start = now();
+  for (n = 0; n < numCalls; n++) {
+    if (kill(children[n % numChildren], 0) != 0) {
+      perror("kill");
+      return 1;
+    }
+  }
+  double virtualToReal = (now() - start) / numCalls * 1e9;
+
+  start = now();
+  for (n = 0; n < numCalls; n++) {
+    if (getpgrp() == -1) {
+      perror("getpgrp");
+      return 1;
+    }
+  }
+  double realToVirtual = (now() - start) / numCalls * 1e9;
+
+  printf("children: %d\n", numChildren);
+  printf("kill(child, 0): %.1f ns/call\n", virtualToReal);
+  printf("getpgrp(): %.1f ns/call\n", realToVirtual);
+
+  for (i = 0; i < numChildren; i++) {
+    kill(children[i], SIGKILL);
+  }
+  for (i = 0; i < numChildren; i++) {
+    waitpid(children[i], NULL, 0);
+  }
+  free(children);
+  return 0;
+}
@@ -0,0 +1,127 @@
+#define _DEFAULT_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Both ends of each connection in one process: a UNIX domain socketpair and
+// a TCP connection to ourselves.  Each round writes data into both ends of
+// each connection, sleeps with the data unread, and then reads it back.  The
+// amount varies from round to round, so that checkpoints find the buffers
+// empty, full in one direction, or full in both.
+
+#define MAX_BYTES (32 * 1024)
+
+static char buf[MAX_BYTES];
+static char expected[MAX_BYTES];
+
+static void
+fill(char *b, int size, int round, int fd)
+{
+  int i;
+
+  for (i = 0; i < size; i++) {
+    b[i] = (char)(round * 3 + fd * 11 + i);
+  }
+}
+
+static void
+writeData(int fd, int size, int round)
+{
+  fill(buf, size, round, fd);
+  if (write(fd, buf, size) != size) {
+    perror("write");
+    exit(1);
+  }
+}
+
+static void
+readData(const char *name, int fd, int peer, int size, int round)
+{
+  int n = 0;
+
+  fill(expected, size, round, peer);
+  while (n < size) {
+    ssize_t rc = read(fd, buf + n, size - n);
+    if (rc <= 0) {
+      fprintf(stderr, "%s: round %d: read returned %zd (errno %d)\n",
+              name, round, rc, errno);
+      exit(1);
+    }
+    n += rc;
+  }
+  if (memcmp(buf, expected, size) != 0) {
+    fprintf(stderr, "%s: round %d: data differs\n", name, round);
+    exit(1);
+  }
+  if (recv(fd, buf, 1, MSG_DONTWAIT) != -1) {
+    fprintf(stderr, "%s: round %d: extra data\n", name, round);
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int pair[2];
+  int tcp[2];
+  int listener;
+  int round;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+    perror("socketpair");
+    return 1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      getsockname(listener, (struct sockaddr *)&addr, &len) == -1 ||
+      listen(listener, 1) == -1) {
+    perror("listener");
+    return 1;
+  }
+  tcp[0] = socket(AF_INET, SOCK_STREAM, 0);
+  if (connect(tcp[0], (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    perror("connect");
+    return 1;
+  }
+  tcp[1] = accept(listener, NULL, NULL);
+  if (tcp[1] == -1) {
+    perror("accept");
+    return 1;
+  }
+  close(listener);
+
+  for (round = 0;; round++) {
+    // No data, data one way, then data both ways.
+    int size0 = (round % 3 == 0) ? 0 : 1 + (round * 4099) % MAX_BYTES;
+    int size1 = (round % 3 == 2) ? 1 + (round * 7919) % MAX_BYTES : 0;
+
+    writeData(pair[0], size0, round);
+    writeData(pair[1], size1, round);
+    writeData(tcp[0], size0, round);
+    writeData(tcp[1], size1, round);
+
+    // Most checkpoints are taken here, with the data unread.
+    usleep(200000);
+
+    readData("socketpair", pair[1], pair[0], size0, round);
+    readData("socketpair", pair[0], pair[1], size1, round);
+    readData("tcp", tcp[1], tcp[0], size0, round);
+    readData("tcp", tcp[0], tcp[1], size1, round);
+
+    printf("%d ", round);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Like client-server, but over a named UNIX domain socket.  At restart, both
+// ends of the connection are on the same node.  Each side checks the
+// sequence numbers and that the connection still looks like a connected
+// AF_UNIX socket to the peer's user.
+
+static void
+checkSocket(int sd, const char *me)
+{
+  struct sockaddr_un addr;
+  socklen_t len = sizeof(addr);
+  struct ucred cred;
+  socklen_t credLen = sizeof(cred);
+
+  if (getpeername(sd, (struct sockaddr *)&addr, &len) == -1) {
+    perror("getpeername");
+    exit(1);
+  }
+  if (addr.sun_family != AF_UNIX) {
+    fprintf(stderr, "%s: peer is not AF_UNIX: %d\n", me, addr.sun_family);
+    exit(1);
+  }
+  if (getsockopt(sd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == -1) {
+    perror("getsockopt(SO_PEERCRED)");
+    exit(1);
+  }
+  if (cred.uid != getuid()) {
+    fprintf(stderr, "%s: peer uid %d, expected %d\n", me, cred.uid, getuid());
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sockaddr_un sockaddr;
+  int listener_sd;
+  pid_t pid;
+
+  memset(&sockaddr, 0, sizeof(sockaddr));
+  sockaddr.sun_family = AF_UNIX;
+  snprintf(sockaddr.sun_path, sizeof(sockaddr.sun_path),
+           "/tmp/dmtcp-uds-client-server-%d", getpid());
+  unlink(sockaddr.sun_path);
+
+  listener_sd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (bind(listener_sd, (struct sockaddr *)&sockaddr, sizeof(sockaddr)) == -1) {
+    perror("bind");
+    return 1;
+  }
+  listen(listener_sd, 5);
+
+  pid = fork();
+  if (pid) { /* if parent process */
+    int sd;
+    int i;
+    close(listener_sd);
+    sd = socket(AF_UNIX, SOCK_STREAM, 0); /* create connection socket */
+    if (connect(sd, (struct sockaddr *)&sockaddr, sizeof(sockaddr)) == -1) {
+      perror("connect");
+      return 1;
+    }
+    unlink(sockaddr.sun_path);
+    for (i = 0;; i++) { /* client writes and then reads */
+      int reply;
+      if (i % 1000 == 0) {
+        checkSocket(sd, "client");
+        printf("."); fflush(stdout);
+      }
+      if (i % 50000 == 0) {
+        printf("\n");
+      }
+      while (write(sd, &i, sizeof(i)) != sizeof(i)) {}
+      while (read(sd, &reply, sizeof(reply)) != sizeof(reply)) {}
+      if (reply != i + 1) {
+        fprintf(stderr, "client: sent %d, got back %d\n", i, reply);
+        return 1;
+      }
+    }
+  } else { /* else child process */
+    int sd;
+    int i;
+    sd = accept(listener_sd, NULL, NULL);
+    for (i = 0;; i++) { /* server reads and then writes */
+      int request;
+      if (i % 1000 == 0) {
+        checkSocket(sd, "server");
+      }
+      while (read(sd, &request, sizeof(request)) != sizeof(request)) {}
+      if (request != i) {
+        fprintf(stderr, "server: expected %d, got %d\n", i, request);
+        return 1;
+      }
+      request++;
+      while (write(sd, &request, sizeof(request)) != sizeof(request)) {}
+    }
+  }
+}